@@ -7,15 +7,34 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "extern/stb/stb_image.h"
 
+#include "CpuProfiler.h"
+#include "LaunchOptions.h"
+#include "Mesh.h"
 #include "systems/SceneGraph.h"
 #include "systems/SceneManager.h"
 #include "systems/SystemManager.h"
 #include "systems/VulkanContext.h"
 
-int main()
+int main(int argc, char** argv)
 {
+    CpuProfiler::SetThreadName("Main");
+
+    const LaunchOptions options = LaunchOptions::Parse(argc, argv);
+
+    //offline step, the renderer is not needed
+    if (!options.cookPath.empty())
+    {
+        return Mesh::Cook(options.cookPath.c_str()) ? 0 : 1;
+    }
+
+    if (options.cullBenchmark)
+    {
+        CullingBounds::RunBenchmark(100000);
+        return 0;
+    }
+
     SystemManager manager;
-    manager.AddSystem(new VulkanContext());
+    manager.AddSystem(new VulkanContext(options));
     manager.AddSystem(new SceneGraph());
     manager.AddSystem(new SceneManager());
 
@@ -26,4 +45,9 @@ int main()
     {
         manager.Update();
     }
+
+    if (!options.tracePath.empty())
+    {
+        CpuProfiler::WriteChromeTrace(options.tracePath);
+    }
 }
@@ -0,0 +1,242 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "Camera.h"
+#include "json/json.hpp"
+
+// false when _object has no _name or it is not 3 numbers, _out is left as it is
+static bool ReadVec3(const nlohmann::json& _object, const char* _name, vec3& _out)
+{
+	if (!_object.is_object() || !_object.contains(_name))
+		return false;
+
+	const nlohmann::json& array = _object[_name];
+
+	if (!array.is_array() || array.size() != 3)
+		return false;
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		if (!array[i].is_number())
+			return false;
+	}
+
+	_out = vec3(array[0].get<float>(), array[1].get<float>(), array[2].get<float>());
+	return true;
+}
+
+static vec3 CatmullRom(const vec3& _p0, const vec3& _p1, const vec3& _p2, const vec3& _p3, float _t)
+{
+	const float t2 = _t * _t;
+	const float t3 = t2 * _t;
+
+	return 0.5f * (2.0f * _p1 + (_p2 - _p0) * _t + (2.0f * _p0 - 5.0f * _p1 + 4.0f * _p2 - _p3) * t2 + (3.0f * _p1 - _p0 - 3.0f * _p2 + _p3) * t3);
+}
+
+// nearest rank on sorted samples
+static float Percentile(const std::vector<float>& _sorted, float _percentile)
+{
+	const size_t rank = static_cast<size_t>(std::ceil(_percentile / 100.0f * static_cast<float>(_sorted.size())));
+	return _sorted[std::clamp<size_t>(rank, 1, _sorted.size()) - 1];
+}
+
+static nlohmann::json Summarize(std::vector<float> _samples)
+{
+	nlohmann::json summary = nlohmann::json::object();
+
+	if (_samples.empty())
+		return summary;
+
+	std::sort(_samples.begin(), _samples.end());
+
+	double total = 0.0;
+	for (const float ms : _samples)
+	{
+		total += ms;
+	}
+
+	summary["samples"] = _samples.size();
+	summary["avg"] = total / static_cast<double>(_samples.size());
+	summary["min"] = _samples.front();
+	summary["max"] = _samples.back();
+	summary["p50"] = Percentile(_samples, 50.0f);
+	summary["p95"] = Percentile(_samples, 95.0f);
+	summary["p99"] = Percentile(_samples, 99.0f);
+
+	return summary;
+}
+
+Benchmark::Benchmark(std::string _path) : m_path(std::move(_path))
+{
+	std::ifstream file(m_path);
+
+	if (!file.is_open())
+	{
+		std::cout << "[Benchmark] could not open " << m_path << std::endl;
+		return;
+	}
+
+	// no exception, a broken file is reported like a missing one
+	const nlohmann::json j = nlohmann::json::parse(file, nullptr, false);
+
+	if (j.is_discarded() || !j.is_object())
+	{
+		std::cout << "[Benchmark] " << m_path << " is not valid json" << std::endl;
+		return;
+	}
+
+	m_meshDescPath = j.value("meshDesc", m_meshDescPath);
+	m_frameCount = j.value("frames", m_frameCount);
+	m_warmupFrameCount = j.value("warmupFrames", m_warmupFrameCount);
+	m_isLooping = j.value("loop", m_isLooping);
+
+	if (j.contains("path"))
+	{
+		const nlohmann::json& path = j["path"];
+
+		if (!path.is_array())
+		{
+			std::cout << "[Benchmark] " << m_path << ": \"path\" is not an array" << std::endl;
+			return;
+		}
+
+		for (const auto& key : path)
+		{
+			Key parsed{};
+
+			// one broken key would move the camera somewhere else, the whole file is refused
+			if (!ReadVec3(key, "position", parsed.position) || !ReadVec3(key, "target", parsed.target))
+			{
+				std::cout << "[Benchmark] " << m_path << ": key " << m_keys.size() << " needs \"position\" and \"target\" as [x, y, z]" << std::endl;
+				m_keys.clear();
+				return;
+			}
+
+			m_keys.push_back(parsed);
+		}
+	}
+
+	// Evaluate() needs at least one key
+	if (m_keys.empty() || m_frameCount == 0)
+	{
+		std::cout << "[Benchmark] " << m_path << " needs at least one key in \"path\" and one frame" << std::endl;
+		m_keys.clear();
+		return;
+	}
+
+	m_cpuFrameTimesMs.reserve(m_frameCount);
+	m_gpuFrameTimesMs.reserve(m_frameCount);
+
+	std::cout << "[Benchmark] " << m_path << ": " << m_keys.size() << " keys, " << m_warmupFrameCount << " + " << m_frameCount << " frames" << std::endl;
+}
+
+Benchmark::Key Benchmark::Evaluate(float _t) const
+{
+	if (m_keys.size() == 1)
+		return m_keys[0];
+
+	const u32 keyCount = static_cast<u32>(m_keys.size());
+	const u32 segmentCount = m_isLooping ? keyCount : keyCount - 1;
+
+	const float segment = std::clamp(_t, 0.0f, 1.0f) * static_cast<float>(segmentCount);
+	const u32 index = std::min(static_cast<u32>(segment), segmentCount - 1);
+	const float localT = segment - static_cast<float>(index);
+
+	// the ends are clamped when not looping, the curve stops on the first and last keys
+	const auto key = [&](i32 _index) -> const Key&
+	{
+		if (m_isLooping)
+			return m_keys[(_index + keyCount) % keyCount];
+
+		return m_keys[std::clamp<i32>(_index, 0, static_cast<i32>(keyCount) - 1)];
+	};
+
+	const i32 i = static_cast<i32>(index);
+
+	return {
+		CatmullRom(key(i - 1).position, key(i).position, key(i + 1).position, key(i + 2).position, localT),
+		CatmullRom(key(i - 1).target, key(i).target, key(i + 1).target, key(i + 2).target, localT)
+	};
+}
+
+void Benchmark::ApplyCamera(u32 _frame, Camera& _camera) const
+{
+	float t = 0.0f;
+
+	if (_frame >= m_warmupFrameCount && m_frameCount > 1)
+	{
+		t = static_cast<float>(_frame - m_warmupFrameCount) / static_cast<float>(m_frameCount - 1);
+	}
+
+	const Key key = Evaluate(t);
+	_camera.LookAt(key.position, key.target);
+}
+
+void Benchmark::AddCpuFrameTime(u32 _frame, float _ms)
+{
+	if (_frame >= m_warmupFrameCount)
+	{
+		m_cpuFrameTimesMs.emplace_back(_ms);
+	}
+}
+
+void Benchmark::AddGpuFrameTime(u32 _frame, float _ms)
+{
+	if (_frame >= m_warmupFrameCount)
+	{
+		m_gpuFrameTimesMs.emplace_back(_ms);
+	}
+}
+
+void Benchmark::AddDrawCounts(u32 _frame, u32 _drawCount, u64 _triangleCount)
+{
+	if (_frame >= m_warmupFrameCount)
+	{
+		m_drawCountSum += _drawCount;
+		m_triangleCountSum += _triangleCount;
+		m_drawCountFrames++;
+	}
+}
+
+void Benchmark::WriteResults(const std::string& _path, const RunInfo& _info) const
+{
+	const double frames = static_cast<double>(std::max(m_drawCountFrames, 1u));
+
+	nlohmann::json j;
+	j["benchmark"] = m_path;
+	j["meshDesc"] = m_meshDescPath;
+	j["device"] = _info.deviceName;
+	j["resolution"] = { _info.width, _info.height };
+	j["headless"] = _info.headless;
+	j["frames"] = m_frameCount;
+	j["warmupFrames"] = m_warmupFrameCount;
+	j["avgDraws"] = static_cast<double>(m_drawCountSum) / frames;
+	j["avgTriangles"] = static_cast<double>(m_triangleCountSum) / frames;
+	j["cullingLastFrame"] = { { "gpu", _info.gpuCulling }, { "visible", _info.visibleDrawCount }, { "frustumCulled", _info.frustumCulledCount }
+		, { "occlusionCulled", _info.occlusionCulledCount } };
+	j["cpuMs"] = Summarize(m_cpuFrameTimesMs);
+	j["gpuMs"] = Summarize(m_gpuFrameTimesMs);
+	j["cpuFrameTimesMs"] = m_cpuFrameTimesMs;
+	j["gpuFrameTimesMs"] = m_gpuFrameTimesMs;
+
+	std::ofstream file(_path, std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cout << "[Benchmark] could not write " << _path << std::endl;
+		return;
+	}
+
+	file << j.dump(2);
+
+	const nlohmann::json& cpu = j["cpuMs"];
+	const nlohmann::json& gpu = j["gpuMs"];
+
+	std::cout << "[Benchmark] cpu p50 " << cpu.value("p50", 0.0f) << " / p95 " << cpu.value("p95", 0.0f) << " / p99 " << cpu.value("p99", 0.0f)
+		<< " ms, gpu p50 " << gpu.value("p50", 0.0f) << " / p95 " << gpu.value("p95", 0.0f) << " / p99 " << gpu.value("p99", 0.0f)
+		<< " ms, results written to " << _path << std::endl;
+}
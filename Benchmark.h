@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+class Camera;
+
+// Scripted run loaded from a json file:
+// {
+//   "meshDesc" : "assets/meshdesc/mesh.json",
+//   "frames" : 600,          recorded frames, after the warmup
+//   "warmupFrames" : 60,     rendered from the first key, not recorded
+//   "loop" : false,          the last key goes back to the first one
+//   "path" : [ { "position" : [x, y, z], "target" : [x, y, z] }, ... ]
+// }
+// The camera only depends on the frame index, two runs of the same file render exactly the same frames.
+class Benchmark
+{
+public:
+	struct Key
+	{
+		vec3 position;
+		vec3 target;
+	};
+
+	// what the frames were rendered with, written next to the timings
+	struct RunInfo
+	{
+		std::string deviceName;
+		u32 width = 0;
+		u32 height = 0;
+		bool headless = false;
+		// of the last frame read back, all 0 without the gpu culling, written as "cullingLastFrame"
+		bool gpuCulling = false;
+		u32 visibleDrawCount = 0;
+		u32 frustumCulledCount = 0;
+		u32 occlusionCulledCount = 0;
+	};
+
+	explicit Benchmark(std::string _path);
+
+	// warmup frames included
+	void ApplyCamera(u32 _frame, Camera& _camera) const;
+
+	void AddCpuFrameTime(u32 _frame, float _ms);
+	// _frame is the one that was measured, the results come back a few frames late
+	void AddGpuFrameTime(u32 _frame, float _ms);
+	// what was sent to the gpu, before the gpu culling, averaged over the recorded frames
+	void AddDrawCounts(u32 _frame, u32 _drawCount, u64 _triangleCount);
+
+	void WriteResults(const std::string& _path, const RunInfo& _info) const;
+
+	// false when the file could not be read or its camera path is missing or broken, the error is already logged, nothing else can be called
+	[[nodiscard]] bool IsValid() const { return !m_keys.empty(); }
+	[[nodiscard]] const std::string& GetMeshDescPath() const { return m_meshDescPath; }
+	[[nodiscard]] u32 GetTotalFrameCount() const { return m_warmupFrameCount + m_frameCount; }
+
+private:
+	[[nodiscard]] Key Evaluate(float _t) const;
+
+	std::string m_path;
+	std::string m_meshDescPath = "assets/meshdesc/mesh.json";
+
+	u32 m_frameCount = 600;
+	u32 m_warmupFrameCount = 60;
+	bool m_isLooping = false;
+
+	std::vector<Key> m_keys;
+
+	std::vector<float> m_cpuFrameTimesMs;
+	std::vector<float> m_gpuFrameTimesMs;
+
+	u64 m_drawCountSum = 0;
+	u64 m_triangleCountSum = 0;
+	u32 m_drawCountFrames = 0;
+};
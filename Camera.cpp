@@ -64,5 +64,18 @@ void Camera::SetPosition(glm::vec3 _position)
     position = _position;
     forward = _position + direction * 2.0f;
 
+    updateVectors();
+}
+
+void Camera::LookAt(glm::vec3 _position, glm::vec3 _target)
+{
+    position = _position;
+    direction = glm::normalize(_target - _position);
+    forward = _position + direction * 2.0f;
+
+    //keeps Rotate() going from where the camera looks now
+    angles.x = glm::degrees(atan2(direction.z, direction.x));
+    angles.y = glm::degrees(asin(direction.y));
+
     updateVectors();
 }
\ No newline at end of file
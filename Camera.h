@@ -21,10 +21,14 @@ public:
 
 	Camera(vec3 startingPosition);
 
+	static constexpr float FIELD_OF_VIEW_DEGREES = 65.0f; // vertical
+	static constexpr float NEAR_PLANE = 0.01f;
+	static constexpr float FAR_PLANE = 100.0f;
+
 	[[nodiscard]] mat4 GetProjection() const
 	{
 		const auto sizes = VulkanContext::GraphicInstance->GetWindowSize();
-		return perspective(radians(65.0f), static_cast<float>(sizes.width) / static_cast<float>(sizes.height), 0.01f, 100.0f);
+		return perspective(radians(FIELD_OF_VIEW_DEGREES), static_cast<float>(sizes.width) / static_cast<float>(sizes.height), NEAR_PLANE, FAR_PLANE);
 	}
 
 	[[nodiscard]] mat4 GetView() const
@@ -37,6 +41,7 @@ public:
 	void Rotate(vec2 delta);
 	void MoveWorld(glm::vec3 movement);
 	void SetPosition(glm::vec3 _position);
+	void LookAt(glm::vec3 _position, glm::vec3 _target);
 
 private:
 	void updateVectors();
@@ -0,0 +1,278 @@
+#include "CookedMesh.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr u32 COOKED_MESH_MAGIC = 0x434D5641; // "AVMC"
+
+static u64 AlignUp(u64 _value, u64 _alignment)
+{
+	return (_value + _alignment - 1) & ~(_alignment - 1);
+}
+
+bool CookedMesh::GetSourceStamp(const std::string& _sourcePath, SourceStamp& _stamp)
+{
+	std::error_code error;
+
+	const auto size = std::filesystem::file_size(_sourcePath, error);
+	if (error)
+		return false;
+
+	const auto writeTime = std::filesystem::last_write_time(_sourcePath, error);
+	if (error)
+		return false;
+
+	_stamp.size = size;
+	_stamp.writeTime = static_cast<i64>(writeTime.time_since_epoch().count());
+
+	return true;
+}
+
+bool CookedMesh::Write(const std::string& _path, const SourceStamp& _stamp, u32 _vertexStride, const std::vector<CookedSubMesh>& _subMeshes)
+{
+	Header header{};
+	header.magic = COOKED_MESH_MAGIC;
+	header.version = VERSION;
+	header.vertexStride = _vertexStride;
+	header.subMeshCount = static_cast<u32>(_subMeshes.size());
+	header.sourceSize = _stamp.size;
+	header.sourceWriteTime = _stamp.writeTime;
+
+	std::vector<SubMeshRecord> records(_subMeshes.size());
+	std::vector<TextureRef> textureRefs;
+	std::string stringTable;
+
+	for (u32 i = 0; i < _subMeshes.size(); ++i)
+	{
+		const CookedSubMesh& subMesh = _subMeshes[i];
+		SubMeshRecord& record = records[i];
+
+		record.vertexCount = subMesh.vertexCount;
+		record.indexCount = subMesh.indexCount;
+		record.lodCount = subMesh.lodCount;
+		record.meshletCount = subMesh.meshletCount;
+		record.meshletVertexCount = subMesh.meshletVertexCount;
+		record.meshletTriangleCount = subMesh.meshletTriangleCount;
+		record.firstTexture = static_cast<u32>(textureRefs.size());
+		record.textureCount = static_cast<u32>(subMesh.texturePaths.size());
+		memcpy(record.boundsMin, &subMesh.boundsMin, sizeof(record.boundsMin));
+		memcpy(record.boundsMax, &subMesh.boundsMax, sizeof(record.boundsMax));
+		record.boundsRadius = subMesh.boundsRadius;
+
+		for (const auto& path : subMesh.texturePaths)
+		{
+			textureRefs.push_back({ static_cast<u32>(stringTable.size()), static_cast<u32>(path.size()) });
+			stringTable += path;
+		}
+	}
+
+	header.textureCount = static_cast<u32>(textureRefs.size());
+	header.stringTableOffset = sizeof(Header) + records.size() * sizeof(SubMeshRecord) + textureRefs.size() * sizeof(TextureRef);
+	header.stringTableSize = stringTable.size();
+
+	// the blobs go after the tables, their offsets are known before writing anything
+	u64 offset = header.stringTableOffset + header.stringTableSize;
+
+	// same order as the records, each blob is written at its offset
+	struct Blob
+	{
+		u64 offset;
+		const void* data;
+		u64 size;
+	};
+
+	std::vector<Blob> blobs;
+	blobs.reserve(_subMeshes.size() * 6);
+
+	const auto addBlob = [&](u64& _recordOffset, const void* _data, u64 _size)
+	{
+		offset = AlignUp(offset, BLOB_ALIGNMENT);
+		_recordOffset = offset;
+		blobs.push_back({ offset, _data, _size });
+		offset += _size;
+	};
+
+	for (u32 i = 0; i < _subMeshes.size(); ++i)
+	{
+		const CookedSubMesh& subMesh = _subMeshes[i];
+		SubMeshRecord& record = records[i];
+
+		addBlob(record.vertexOffset, subMesh.vertices, static_cast<u64>(subMesh.vertexCount) * _vertexStride);
+		addBlob(record.indexOffset, subMesh.indices, static_cast<u64>(subMesh.indexCount) * sizeof(u16));
+		addBlob(record.lodOffset, subMesh.lods, static_cast<u64>(subMesh.lodCount) * sizeof(MeshLod));
+		addBlob(record.meshletOffset, subMesh.meshlets, static_cast<u64>(subMesh.meshletCount) * sizeof(Meshlet));
+		addBlob(record.meshletVertexOffset, subMesh.meshletVertices, static_cast<u64>(subMesh.meshletVertexCount) * sizeof(u16));
+		addBlob(record.meshletTriangleOffset, subMesh.meshletTriangles, static_cast<u64>(subMesh.meshletTriangleCount) * 3);
+	}
+
+	// written next to the real file first, a crash while cooking would leave a truncated cook otherwise
+	const std::string tmpPath = _path + ".tmp";
+
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+		{
+			std::cout << "[CookedMesh] could not write " << tmpPath << std::endl;
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(SubMeshRecord)));
+		file.write(reinterpret_cast<const char*>(textureRefs.data()), static_cast<std::streamsize>(textureRefs.size() * sizeof(TextureRef)));
+		file.write(stringTable.data(), static_cast<std::streamsize>(stringTable.size()));
+
+		constexpr char padding[BLOB_ALIGNMENT] = {};
+
+		for (const Blob& blob : blobs)
+		{
+			file.write(padding, static_cast<std::streamsize>(blob.offset - static_cast<u64>(file.tellp())));
+
+			if (blob.size > 0)
+			{
+				file.write(static_cast<const char*>(blob.data), static_cast<std::streamsize>(blob.size));
+			}
+		}
+
+		if (!file.good())
+		{
+			std::cout << "[CookedMesh] failed writing " << tmpPath << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmpPath, _path, error);
+
+	if (error)
+	{
+		std::cout << "[CookedMesh] could not replace " << _path << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	std::cout << "[CookedMesh] " << _subMeshes.size() << " submeshes cooked in " << _path << " (" << offset / 1024 << " KB)" << std::endl;
+
+	return true;
+}
+
+bool CookedMesh::Open(const std::string& _path, const SourceStamp& _stamp, u32 _vertexStride)
+{
+	m_subMeshes.clear();
+
+	if (!m_file.Open(_path))
+		return false;
+
+	const u8* data = m_file.GetData();
+	const u64 size = m_file.GetSize();
+
+	if (size < sizeof(Header))
+	{
+		m_file.Close();
+		return false;
+	}
+
+	Header header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != COOKED_MESH_MAGIC || header.version != VERSION || header.vertexStride != _vertexStride)
+	{
+		std::cout << "[CookedMesh] " << _path << " was cooked by another version, ignored" << std::endl;
+		m_file.Close();
+		return false;
+	}
+
+	if (header.sourceSize != _stamp.size || header.sourceWriteTime != _stamp.writeTime)
+	{
+		std::cout << "[CookedMesh] " << _path << " is stale, ignored" << std::endl;
+		m_file.Close();
+		return false;
+	}
+
+	const u64 recordsOffset = sizeof(Header);
+	const u64 textureRefsOffset = recordsOffset + static_cast<u64>(header.subMeshCount) * sizeof(SubMeshRecord);
+
+	// everything read below stays in the file, a truncated cook is rejected instead of read past its end
+	const auto isInFile = [size](u64 _offset, u64 _size) { return _offset <= size && _size <= size - _offset; };
+
+	if (header.stringTableOffset != textureRefsOffset + static_cast<u64>(header.textureCount) * sizeof(TextureRef)
+		|| !isInFile(header.stringTableOffset, header.stringTableSize))
+	{
+		std::cout << "[CookedMesh] " << _path << " is malformed, ignored" << std::endl;
+		m_file.Close();
+		return false;
+	}
+
+	const auto* records = reinterpret_cast<const SubMeshRecord*>(data + recordsOffset);
+	const auto* textureRefs = reinterpret_cast<const TextureRef*>(data + textureRefsOffset);
+	const auto* strings = reinterpret_cast<const char*>(data + header.stringTableOffset);
+
+	m_subMeshes.resize(header.subMeshCount);
+
+	for (u32 i = 0; i < header.subMeshCount; ++i)
+	{
+		const SubMeshRecord& record = records[i];
+
+		if (!isInFile(record.vertexOffset, static_cast<u64>(record.vertexCount) * _vertexStride)
+			|| !isInFile(record.indexOffset, static_cast<u64>(record.indexCount) * sizeof(u16))
+			|| !isInFile(record.lodOffset, static_cast<u64>(record.lodCount) * sizeof(MeshLod))
+			|| !isInFile(record.meshletOffset, static_cast<u64>(record.meshletCount) * sizeof(Meshlet))
+			|| !isInFile(record.meshletVertexOffset, static_cast<u64>(record.meshletVertexCount) * sizeof(u16))
+			|| !isInFile(record.meshletTriangleOffset, static_cast<u64>(record.meshletTriangleCount) * 3)
+			|| static_cast<u64>(record.firstTexture) + record.textureCount > header.textureCount)
+		{
+			std::cout << "[CookedMesh] " << _path << " is malformed, ignored" << std::endl;
+			m_subMeshes.clear();
+			m_file.Close();
+			return false;
+		}
+
+		const auto* lods = reinterpret_cast<const MeshLod*>(data + record.lodOffset);
+
+		for (u32 l = 0; l < record.lodCount; ++l)
+		{
+			if (static_cast<u64>(lods[l].firstIndex) + lods[l].indexCount > record.indexCount)
+			{
+				std::cout << "[CookedMesh] " << _path << " is malformed, ignored" << std::endl;
+				m_subMeshes.clear();
+				m_file.Close();
+				return false;
+			}
+		}
+
+		CookedSubMesh& subMesh = m_subMeshes[i];
+		subMesh.vertices = data + record.vertexOffset;
+		subMesh.vertexCount = record.vertexCount;
+		subMesh.indices = reinterpret_cast<const u16*>(data + record.indexOffset);
+		subMesh.indexCount = record.indexCount;
+		subMesh.lods = lods;
+		subMesh.lodCount = record.lodCount;
+		subMesh.meshlets = reinterpret_cast<const Meshlet*>(data + record.meshletOffset);
+		subMesh.meshletCount = record.meshletCount;
+		subMesh.meshletVertices = reinterpret_cast<const u16*>(data + record.meshletVertexOffset);
+		subMesh.meshletVertexCount = record.meshletVertexCount;
+		subMesh.meshletTriangles = data + record.meshletTriangleOffset;
+		subMesh.meshletTriangleCount = record.meshletTriangleCount;
+		subMesh.boundsMin = vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+		subMesh.boundsMax = vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+		subMesh.boundsRadius = record.boundsRadius;
+
+		for (u32 t = record.firstTexture; t < record.firstTexture + record.textureCount; ++t)
+		{
+			const TextureRef& ref = textureRefs[t];
+
+			if (static_cast<u64>(ref.offset) + ref.length > header.stringTableSize)
+			{
+				std::cout << "[CookedMesh] " << _path << " is malformed, ignored" << std::endl;
+				m_subMeshes.clear();
+				m_file.Close();
+				return false;
+			}
+
+			subMesh.texturePaths.emplace_back(strings + ref.offset, ref.length);
+		}
+	}
+
+	return true;
+}
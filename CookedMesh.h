@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+
+using namespace glm;
+
+// One submesh as it is cooked, the pointers either point in the importer's data (when writing)
+// or straight in the mapped file (when reading).
+struct CookedSubMesh
+{
+	const void* vertices = nullptr;
+	u32 vertexCount = 0;
+	const u16* indices = nullptr;
+	u32 indexCount = 0; // of all the lods
+
+	const MeshLod* lods = nullptr;
+	u32 lodCount = 0;
+
+	const Meshlet* meshlets = nullptr;
+	u32 meshletCount = 0;
+	const u16* meshletVertices = nullptr;
+	u32 meshletVertexCount = 0;
+	const u8* meshletTriangles = nullptr;
+	u32 meshletTriangleCount = 0; // 3 local indices each
+
+	std::vector<std::string> texturePaths;
+
+	vec3 boundsMin = vec3(0.0f);
+	vec3 boundsMax = vec3(0.0f);
+	float boundsRadius = 0.0f; // around the center of the box
+};
+
+// Binary cache of an imported mesh, written next to the source file (source + variant + ".cooked").
+// It is only used when it was cooked from the same source file (size and write time), with the same
+// vertex layout and the same format version, otherwise the caller imports the source again and re-cooks it.
+//
+// Layout:
+//   Header
+//   SubMeshRecord[subMeshCount]
+//   TextureRef[textureCount], paths in the string table
+//   string table
+//   vertex, index, lod, meshlet, meshlet vertex and meshlet triangle blobs of each submesh, each aligned on BLOB_ALIGNMENT
+class CookedMesh
+{
+public:
+	// identifies the version of the source file the cook comes from
+	struct SourceStamp
+	{
+		u64 size = 0;
+		i64 writeTime = 0;
+	};
+
+	CookedMesh() = default;
+
+	CookedMesh(const CookedMesh& other) = delete;
+	CookedMesh(CookedMesh&& other) = delete;
+	CookedMesh& operator=(const CookedMesh& other) = delete;
+	CookedMesh& operator=(CookedMesh&& other) = delete;
+
+	[[nodiscard]] static bool GetSourceStamp(const std::string& _sourcePath, SourceStamp& _stamp);
+	// _variant tells apart the cooks of one source with different settings (vertex format...)
+	[[nodiscard]] static std::string GetCookedPath(const std::string& _sourcePath, const std::string& _variant = "") { return _sourcePath + _variant + ".cooked"; }
+
+	static bool Write(const std::string& _path, const SourceStamp& _stamp, u32 _vertexStride, const std::vector<CookedSubMesh>& _subMeshes);
+
+	// maps the file, false if it is missing, stale or malformed
+	bool Open(const std::string& _path, const SourceStamp& _stamp, u32 _vertexStride);
+
+	// valid as long as this object lives
+	[[nodiscard]] const std::vector<CookedSubMesh>& GetSubMeshes() const { return m_subMeshes; }
+	[[nodiscard]] u64 GetFileSize() const { return m_file.GetSize(); }
+
+	static constexpr u32 VERSION = 7; // 2: optimized index and vertex order, 3: meshlets, 4: lods, 5: packed vertex count, 6: bounding sphere, 7: tangent frame per vertex
+	static constexpr u64 BLOB_ALIGNMENT = 16;
+
+private:
+	struct Header
+	{
+		u32 magic;
+		u32 version;
+		u32 vertexStride;
+		u32 subMeshCount;
+		u32 textureCount;
+		u32 padding;
+		u64 sourceSize;
+		i64 sourceWriteTime;
+		u64 stringTableOffset;
+		u64 stringTableSize;
+	};
+
+	struct SubMeshRecord
+	{
+		u64 vertexOffset;
+		u64 indexOffset;
+		u64 lodOffset;
+		u64 meshletOffset;
+		u64 meshletVertexOffset;
+		u64 meshletTriangleOffset;
+		u32 vertexCount;
+		u32 indexCount;
+		u32 lodCount;
+		u32 meshletCount;
+		u32 meshletVertexCount;
+		u32 meshletTriangleCount;
+		u32 firstTexture;
+		u32 textureCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		float boundsRadius;
+		u32 padding;
+	};
+
+	struct TextureRef
+	{
+		u32 offset;
+		u32 length;
+	};
+
+	MappedFile m_file;
+	std::vector<CookedSubMesh> m_subMeshes;
+};
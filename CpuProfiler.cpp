@@ -0,0 +1,142 @@
+#include "CpuProfiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct Zone
+	{
+		const char* name;
+		u64 start;
+		u64 end;
+	};
+
+	struct ThreadBuffer
+	{
+		u32 threadIndex = 0;
+		std::string threadName;
+
+		std::vector<Zone> zones;
+		// total written, the ring wraps on it
+		std::atomic<u64> writeCount{ 0 };
+	};
+
+	// owns the buffers, they outlive their threads so the zones of finished threads still end up in the trace
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	const std::chrono::steady_clock::time_point s_processStart = std::chrono::steady_clock::now();
+
+	thread_local ThreadBuffer* t_buffer = nullptr;
+
+	// only locks the first time a thread records something
+	ThreadBuffer& GetThreadBuffer()
+	{
+		if (!t_buffer)
+		{
+			auto buffer = std::make_unique<ThreadBuffer>();
+			buffer->zones.resize(CpuProfiler::ZONES_PER_THREAD);
+
+			Registry& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+
+			buffer->threadIndex = static_cast<u32>(registry.buffers.size());
+			t_buffer = buffer.get();
+			registry.buffers.emplace_back(std::move(buffer));
+		}
+
+		return *t_buffer;
+	}
+}
+
+void CpuProfiler::SetThreadName(const std::string& _name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	std::lock_guard lock(GetRegistry().mutex);
+	buffer.threadName = _name;
+}
+
+u64 CpuProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_processStart).count();
+}
+
+void CpuProfiler::Record(const char* _name, u64 _start, u64 _end)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	const u64 index = buffer.writeCount.load(std::memory_order_relaxed);
+	buffer.zones[index % ZONES_PER_THREAD] = { _name, _start, _end };
+
+	// published after the zone, a reader never sees a count ahead of the data
+	buffer.writeCount.store(index + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string& _path)
+{
+	std::ofstream file(_path, std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cout << "[CpuProfiler] could not write " << _path << std::endl;
+		return false;
+	}
+
+	Registry& registry = GetRegistry();
+	std::lock_guard lock(registry.mutex);
+
+	u64 zoneCount = 0;
+
+	// complete events ("X"), timestamps in us
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool isFirst = true;
+
+	for (const auto& buffer : registry.buffers)
+	{
+		if (!buffer->threadName.empty())
+		{
+			file << (isFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadIndex
+				<< ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+			isFirst = false;
+		}
+
+		const u64 written = buffer->writeCount.load(std::memory_order_acquire);
+		const u64 first = written > ZONES_PER_THREAD ? written - ZONES_PER_THREAD : 0;
+
+		for (u64 i = first; i < written; ++i)
+		{
+			const Zone& zone = buffer->zones[i % ZONES_PER_THREAD];
+
+			file << (isFirst ? "" : ",\n") << "{\"name\":\"" << zone.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadIndex
+				<< ",\"ts\":" << static_cast<double>(zone.start) / 1000.0 << ",\"dur\":" << static_cast<double>(zone.end - zone.start) / 1000.0 << "}";
+			isFirst = false;
+		}
+
+		zoneCount += written - first;
+	}
+
+	file << "\n]}\n";
+
+	std::cout << "[CpuProfiler] " << zoneCount << " zones from " << registry.buffers.size() << " threads written to " << _path << std::endl;
+
+	return true;
+}
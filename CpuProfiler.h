@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// set to 0 to compile every zone out, the trace is then written empty
+#ifndef ARKANE_PROFILE
+#define ARKANE_PROFILE 1
+#endif
+
+// Scoped cpu zones, dumped in the chrome trace format (chrome://tracing, ui.perfetto.dev).
+// Each thread writes its zones in its own ring buffer, nothing is locked or allocated per zone
+// and only the most recent ZONES_PER_THREAD zones of a thread are kept.
+// The names are not copied, they have to be string literals (or live until the trace is written).
+class CpuProfiler
+{
+public:
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const char* _name) : m_name(_name), m_start(Now()) {}
+		~ScopedZone() { Record(m_name, m_start, Now()); }
+
+		ScopedZone(const ScopedZone& other) = delete;
+		ScopedZone(ScopedZone&& other) = delete;
+		ScopedZone& operator=(const ScopedZone& other) = delete;
+		ScopedZone& operator=(ScopedZone&& other) = delete;
+
+	private:
+		const char* m_name;
+		u64 m_start;
+	};
+
+	// shown instead of the thread index in the trace
+	static void SetThreadName(const std::string& _name);
+
+	// the zones still being written by other threads while dumping may come out torn,
+	// call it when the workers are idle
+	static bool WriteChromeTrace(const std::string& _path);
+
+	// ns since the start of the process
+	[[nodiscard]] static u64 Now();
+
+	static constexpr u32 ZONES_PER_THREAD = 1 << 16;
+
+private:
+	static void Record(const char* _name, u64 _start, u64 _end);
+};
+
+#if ARKANE_PROFILE
+#define PROFILE_CONCAT_INNER(_a, _b) _a##_b
+#define PROFILE_CONCAT(_a, _b) PROFILE_CONCAT_INNER(_a, _b)
+#define PROFILE_ZONE(_name) const CpuProfiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(_name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#else
+#define PROFILE_ZONE(_name)
+#define PROFILE_FUNCTION()
+#endif
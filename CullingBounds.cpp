@@ -0,0 +1,353 @@
+#include "CullingBounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CpuProfiler.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_HAS_X86_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define CULLING_HAS_X86_SIMD 0
+#endif
+
+// msvc compiles any intrinsic, gcc and clang need the function to be built for the instruction set,
+// so the avx path is built whatever the flags of the project and only taken when the cpu supports it
+#if CULLING_HAS_X86_SIMD && !defined(_MSC_VER)
+#define CULLING_TARGET_AVX __attribute__((target("avx")))
+#else
+#define CULLING_TARGET_AVX
+#endif
+
+Frustum Frustum::FromViewProjection(const mat4& _viewProj)
+{
+	// glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const auto row = [&_viewProj](u32 _i) { return vec4(_viewProj[0][_i], _viewProj[1][_i], _viewProj[2][_i], _viewProj[3][_i]); };
+
+	Frustum frustum;
+	frustum.planes[0] = row(3) + row(0); // left, -w <= x
+	frustum.planes[1] = row(3) - row(0); // right, x <= w
+	frustum.planes[2] = row(3) + row(1); // -w <= y
+	frustum.planes[3] = row(3) - row(1); // y <= w
+	frustum.planes[4] = row(2); // near, 0 <= z
+	frustum.planes[5] = row(3) - row(2); // far, z <= w
+
+	for (vec4& plane : frustum.planes)
+	{
+		plane /= length(vec3(plane));
+	}
+
+	return frustum;
+}
+
+void CullingBounds::Reserve(u32 _count)
+{
+	for (std::vector<float>* component : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ, &m_sphereRadius })
+	{
+		component->reserve(_count);
+	}
+}
+
+void CullingBounds::Clear()
+{
+	for (std::vector<float>* component : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ, &m_sphereRadius })
+	{
+		component->clear();
+	}
+}
+
+u32 CullingBounds::Add(const vec3& _boundsMin, const vec3& _boundsMax, float _sphereRadius)
+{
+	const vec3 center = (_boundsMin + _boundsMax) * 0.5f;
+	const vec3 extent = (_boundsMax - _boundsMin) * 0.5f;
+
+	m_centerX.emplace_back(center.x);
+	m_centerY.emplace_back(center.y);
+	m_centerZ.emplace_back(center.z);
+	m_extentX.emplace_back(extent.x);
+	m_extentY.emplace_back(extent.y);
+	m_extentZ.emplace_back(extent.z);
+	m_sphereRadius.emplace_back(_sphereRadius);
+
+	return GetCount() - 1;
+}
+
+void CullingBounds::Cull(const Frustum& _frustum, std::vector<u32>& _visible, EPath _path) const
+{
+	PROFILE_ZONE("CullingBounds::Cull");
+
+	// every lane is written, only the visible ones move the cursor forward
+	_visible.resize(GetCount());
+
+	u32 visibleCount = 0;
+
+	switch (IsPathSupported(_path) ? _path : EPath::Scalar)
+	{
+	case EPath::Sse:
+		visibleCount = CullSse(_frustum, _visible.data());
+		break;
+	case EPath::Avx:
+		visibleCount = CullAvx(_frustum, _visible.data());
+		break;
+	default:
+		visibleCount = CullScalar(_frustum, 0, _visible.data(), 0);
+		break;
+	}
+
+	_visible.resize(visibleCount);
+}
+
+u32 CullingBounds::CullScalar(const Frustum& _frustum, u32 _begin, u32* _visible, u32 _visibleCount) const
+{
+	for (u32 i = _begin; i < GetCount(); ++i)
+	{
+		bool isInside = true;
+
+		for (const vec4& plane : _frustum.planes)
+		{
+			// distance of the center, plus the extent projected on the normal: negative when the whole box is behind
+			const float distance = plane.x * m_centerX[i] + plane.y * m_centerY[i] + plane.z * m_centerZ[i] + plane.w;
+			const float radius = std::abs(plane.x) * m_extentX[i] + std::abs(plane.y) * m_extentY[i] + std::abs(plane.z) * m_extentZ[i];
+
+			if (distance + radius < 0.0f)
+			{
+				isInside = false;
+				break;
+			}
+		}
+
+		_visible[_visibleCount] = i;
+		_visibleCount += isInside ? 1 : 0;
+	}
+
+	return _visibleCount;
+}
+
+u32 CullingBounds::CullSse(const Frustum& _frustum, u32* _visible) const
+{
+#if CULLING_HAS_X86_SIMD
+	const u32 count = GetCount();
+	u32 visibleCount = 0;
+	u32 i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 centerX = _mm_loadu_ps(m_centerX.data() + i);
+		const __m128 centerY = _mm_loadu_ps(m_centerY.data() + i);
+		const __m128 centerZ = _mm_loadu_ps(m_centerZ.data() + i);
+		const __m128 extentX = _mm_loadu_ps(m_extentX.data() + i);
+		const __m128 extentY = _mm_loadu_ps(m_extentY.data() + i);
+		const __m128 extentZ = _mm_loadu_ps(m_extentZ.data() + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const vec4& plane : _frustum.planes)
+		{
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)), _mm_mul_ps(centerY, _mm_set1_ps(plane.y)))
+				, _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y))))
+				, _mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z))));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		const u32 mask = static_cast<u32>(_mm_movemask_ps(inside));
+
+		for (u32 lane = 0; lane < 4; ++lane)
+		{
+			_visible[visibleCount] = i + lane;
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return CullScalar(_frustum, i, _visible, visibleCount);
+#else
+	return CullScalar(_frustum, 0, _visible, 0);
+#endif
+}
+
+#if CULLING_HAS_X86_SIMD
+CULLING_TARGET_AVX static u32 CullAvxLanes(const Frustum& _frustum, const float* const* _components, u32 _count, u32* _visible, u32& _visibleCount)
+{
+	u32 i = 0;
+
+	for (; i + 8 <= _count; i += 8)
+	{
+		const __m256 centerX = _mm256_loadu_ps(_components[0] + i);
+		const __m256 centerY = _mm256_loadu_ps(_components[1] + i);
+		const __m256 centerZ = _mm256_loadu_ps(_components[2] + i);
+		const __m256 extentX = _mm256_loadu_ps(_components[3] + i);
+		const __m256 extentY = _mm256_loadu_ps(_components[4] + i);
+		const __m256 extentZ = _mm256_loadu_ps(_components[5] + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const vec4& plane : _frustum.planes)
+		{
+			const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(plane.x)), _mm256_mul_ps(centerY, _mm256_set1_ps(plane.y)))
+				, _mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			const __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, _mm256_set1_ps(std::abs(plane.x))), _mm256_mul_ps(extentY, _mm256_set1_ps(std::abs(plane.y))))
+				, _mm256_mul_ps(extentZ, _mm256_set1_ps(std::abs(plane.z))));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		const u32 mask = static_cast<u32>(_mm256_movemask_ps(inside));
+
+		for (u32 lane = 0; lane < 8; ++lane)
+		{
+			_visible[_visibleCount] = i + lane;
+			_visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	// leaving avx code, avoids the penalty of the sse instructions after it
+	_mm256_zeroupper();
+
+	return i;
+}
+#endif
+
+u32 CullingBounds::CullAvx(const Frustum& _frustum, u32* _visible) const
+{
+#if CULLING_HAS_X86_SIMD
+	const float* components[] = { m_centerX.data(), m_centerY.data(), m_centerZ.data(), m_extentX.data(), m_extentY.data(), m_extentZ.data() };
+
+	u32 visibleCount = 0;
+	const u32 end = CullAvxLanes(_frustum, components, GetCount(), _visible, visibleCount);
+
+	return CullScalar(_frustum, end, _visible, visibleCount);
+#else
+	return CullScalar(_frustum, 0, _visible, 0);
+#endif
+}
+
+bool CullingBounds::IsPathSupported(EPath _path)
+{
+	switch (_path)
+	{
+	case EPath::Scalar:
+		return true;
+#if CULLING_HAS_X86_SIMD
+	case EPath::Sse:
+		// part of x64
+		return true;
+	case EPath::Avx:
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+
+		// the cpu has it and the os saves the ymm registers
+		const bool hasAvx = (info[2] & (1 << 28)) != 0;
+		const bool hasOsSave = (info[2] & (1 << 27)) != 0;
+
+		return hasAvx && hasOsSave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		// checks the os support too
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+CullingBounds::EPath CullingBounds::GetBestPath()
+{
+	// checked once, the cpu does not change while running
+	static const EPath bestPath = []()
+	{
+		for (EPath path : { EPath::Avx, EPath::Sse })
+		{
+			if (IsPathSupported(path))
+				return path;
+		}
+
+		return EPath::Scalar;
+	}();
+
+	return bestPath;
+}
+
+const char* CullingBounds::GetPathName(EPath _path)
+{
+	switch (_path)
+	{
+	case EPath::Scalar: return "scalar";
+	case EPath::Sse: return "sse";
+	case EPath::Avx: return "avx";
+	default: return "unknown";
+	}
+}
+
+void CullingBounds::RunBenchmark(u32 _objectCount)
+{
+	constexpr u32 ITERATION_COUNT = 200;
+
+	// boxes of 0.1 to 4 units spread around a camera at the origin, about a sixth of them in view
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	CullingBounds bounds;
+	bounds.Reserve(_objectCount);
+
+	for (u32 i = 0; i < _objectCount; ++i)
+	{
+		const vec3 center(position(random), position(random), position(random));
+		const vec3 extent(size(random), size(random), size(random));
+
+		bounds.Add(center - extent * 0.5f, center + extent * 0.5f, length(extent) * 0.5f);
+	}
+
+	mat4 proj = perspective(radians(70.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+	proj[1][1] *= -1;
+	const Frustum frustum = Frustum::FromViewProjection(proj * lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f)));
+
+	std::cout << "[CullBench] " << _objectCount << " objects, " << ITERATION_COUNT << " iterations per path" << std::endl;
+
+	std::vector<u32> reference;
+	bounds.Cull(frustum, reference, EPath::Scalar);
+
+	std::vector<u32> visible;
+	visible.reserve(_objectCount);
+
+	for (u32 i = 0; i < static_cast<u32>(EPath::Count); ++i)
+	{
+		const EPath path = static_cast<EPath>(i);
+
+		if (!IsPathSupported(path))
+		{
+			std::cout << "[CullBench]   " << GetPathName(path) << ": not supported" << std::endl;
+			continue;
+		}
+
+		float bestMs = FLT_MAX;
+		float totalMs = 0.0f;
+
+		for (u32 iteration = 0; iteration < ITERATION_COUNT; ++iteration)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			bounds.Cull(frustum, visible, path);
+			const float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+			bestMs = std::min(bestMs, ms);
+			totalMs += ms;
+		}
+
+		std::cout << "[CullBench]   " << GetPathName(path) << ": " << visible.size() << " visible, best " << bestMs << " ms, average "
+			<< totalMs / ITERATION_COUNT << " ms, " << bestMs * 1000000.0f / static_cast<float>(_objectCount) << " ns per object"
+			<< (visible == reference ? "" : ", DIFFERS FROM SCALAR") << std::endl;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// the 6 planes of a view projection, normalized, pointing inside: dot(plane.xyz, p) + plane.w >= 0 inside
+struct Frustum
+{
+	std::array<vec4, 6> planes;
+
+	// vulkan clip space, z in [0; w], the flip of y does not change the planes
+	static Frustum FromViewProjection(const mat4& _viewProj);
+};
+
+// Bounds of the objects to cull, a box and a bounding sphere each, one array per component (SoA),
+// so the frustum test loads 4 (sse) or 8 (avx) objects at once.
+// The test is on the boxes, the spheres are there for what only needs a distance (lod selection...).
+class CullingBounds
+{
+public:
+	// the instruction sets of the test, the best one the cpu supports is used by default
+	enum class EPath : u8
+	{
+		Scalar,
+		Sse, // 4 objects per iteration
+		Avx, // 8 objects per iteration
+		Count
+	};
+
+	CullingBounds() = default;
+
+	CullingBounds(const CullingBounds& other) = delete;
+	CullingBounds(CullingBounds&& other) = delete;
+	CullingBounds& operator=(const CullingBounds& other) = delete;
+	CullingBounds& operator=(CullingBounds&& other) = delete;
+
+	void Reserve(u32 _count);
+	void Clear();
+	// returns the index of the object, the sphere is centered on the box
+	u32 Add(const vec3& _boundsMin, const vec3& _boundsMax, float _sphereRadius);
+
+	[[nodiscard]] u32 GetCount() const { return static_cast<u32>(m_centerX.size()); }
+	[[nodiscard]] vec3 GetCenter(u32 _index) const { return vec3(m_centerX[_index], m_centerY[_index], m_centerZ[_index]); }
+	[[nodiscard]] float GetSphereRadius(u32 _index) const { return m_sphereRadius[_index]; }
+
+	// _visible gets the indices of the objects at least partly inside, in increasing order
+	// conservative: a box crossing the corner of two planes can be kept while outside
+	void Cull(const Frustum& _frustum, std::vector<u32>& _visible) const { Cull(_frustum, _visible, GetBestPath()); }
+	void Cull(const Frustum& _frustum, std::vector<u32>& _visible, EPath _path) const;
+
+	[[nodiscard]] static bool IsPathSupported(EPath _path);
+	[[nodiscard]] static EPath GetBestPath();
+	[[nodiscard]] static const char* GetPathName(EPath _path);
+
+	// --cull-bench: culls _objectCount random boxes with every supported path and prints the timings
+	static void RunBenchmark(u32 _objectCount);
+
+private:
+	// from _begin to the end, for the scalar path and the tails of the others, returns the new visible count
+	u32 CullScalar(const Frustum& _frustum, u32 _begin, u32* _visible, u32 _visibleCount) const;
+	u32 CullSse(const Frustum& _frustum, u32* _visible) const;
+	u32 CullAvx(const Frustum& _frustum, u32* _visible) const;
+
+	std::vector<float> m_centerX;
+	std::vector<float> m_centerY;
+	std::vector<float> m_centerZ;
+	// half sizes of the boxes
+	std::vector<float> m_extentX;
+	std::vector<float> m_extentY;
+	std::vector<float> m_extentZ;
+	std::vector<float> m_sphereRadius;
+};
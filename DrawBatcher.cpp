@@ -0,0 +1,77 @@
+#include "DrawBatcher.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "systems/VulkanContext.h"
+
+DrawBatcher::DrawBatcher(u32 _maxDraws, u32 _regionCount, vk::DeviceSize _minStorageAlignment, bool _keepCommands)
+	: m_maxDraws(_maxDraws), m_regionCount(_regionCount), m_keepCommands(_keepCommands)
+{
+	// the spec guarantees minStorageBufferOffsetAlignment is a power of two
+	assert((_minStorageAlignment & (_minStorageAlignment - 1)) == 0);
+
+	// draw data then commands, every region has to start on an aligned offset to be a dynamic offset, and so do the commands in it
+	m_commandSectionOffset = (GetDrawDataRange() + _minStorageAlignment - 1) & ~(_minStorageAlignment - 1);
+	const vk::DeviceSize size = m_commandSectionOffset + GetCommandRange();
+	m_regionSize = (size + _minStorageAlignment - 1) & ~(_minStorageAlignment - 1);
+
+	// also read by the culling on the compute queue
+	VulkanContext::GraphicInstance->CreateBuffer(m_regionSize * m_regionCount, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+		, EMemoryPool::Dynamic, m_buffer, m_allocation, VulkanContext::GraphicInstance->GetGraphicsComputeFamilies());
+
+	// kept mapped for the whole life of the batcher
+	m_data = static_cast<u8*>(VulkanContext::s_allocator.mapMemory(m_allocation));
+}
+
+DrawBatcher::~DrawBatcher()
+{
+	VulkanContext::s_allocator.unmapMemory(m_allocation);
+	VulkanContext::GraphicInstance->DestroyBuffer(m_buffer, m_allocation);
+}
+
+void DrawBatcher::BeginFrame(u32 _regionIndex)
+{
+	assert(_regionIndex < m_regionCount);
+
+	m_regionStart = m_regionSize * _regionIndex;
+	m_drawCount = 0;
+	m_groups.clear();
+	m_commands.clear();
+}
+
+void DrawBatcher::Add(vk::Pipeline _pipeline, const vk::DrawIndexedIndirectCommand& _command, const DrawData& _data)
+{
+	assert(m_drawCount < m_maxDraws);
+
+	if (m_groups.empty() || m_groups.back().pipeline != _pipeline)
+	{
+		m_groups.push_back({ _pipeline, m_drawCount, 0 });
+	}
+
+	m_groups.back().drawCount++;
+
+	vk::DrawIndexedIndirectCommand command = _command;
+	command.firstInstance = m_drawCount;
+
+	DrawData data = _data;
+	data.groupIndex = static_cast<u32>(m_groups.size()) - 1;
+
+	//write combined memory most of the time, only written, never read back
+	memcpy(m_data + m_regionStart + sizeof(DrawData) * m_drawCount, &data, sizeof(DrawData));
+	memcpy(m_data + GetCommandOffset(m_drawCount), &command, sizeof(command));
+
+	if (m_keepCommands)
+		m_commands.emplace_back(command);
+
+	m_drawCount++;
+}
+
+void DrawBatcher::EndFrame()
+{
+	if (m_drawCount == 0)
+		return;
+
+	VulkanContext::s_allocator.flushAllocation(m_allocation, m_regionStart, sizeof(DrawData) * m_drawCount);
+	VulkanContext::s_allocator.flushAllocation(m_allocation, GetCommandOffset(0), sizeof(vk::DrawIndexedIndirectCommand) * m_drawCount);
+}
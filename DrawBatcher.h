@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "vma/vk_mem_alloc.hpp"
+
+using namespace glm;
+
+// std430, one per draw, read by the vertex shader at gl_InstanceIndex (the firstInstance of its command)
+struct DrawData
+{
+	mat4 model;
+	vec4 boundsMin; // model space box, culled on the gpu, also dequantizes the positions of the packed format
+	vec4 boundsExtent;
+	u32 materialIndex; // in the texture array of the descriptor set
+	u32 groupIndex; // filled by the batcher, the gpu culling counts the visible draws per group
+	u32 padding[2];
+};
+
+static_assert(sizeof(DrawData) == 112, "DrawData has to match its std430 declaration in the shaders");
+
+// The draws of a frame built on the cpu: a VkDrawIndexedIndirectCommand and a DrawData per draw, grouped by pipeline,
+// each group is drawn with one drawIndexedIndirect whatever the number of objects in it.
+// Like the UniformAllocator, one persistently mapped buffer split in one region per swapchain image,
+// the caller guarantees the gpu is done with a region before calling BeginFrame() on it again.
+class DrawBatcher
+{
+public:
+	struct Group
+	{
+		vk::Pipeline pipeline;
+		u32 firstDraw = 0;
+		u32 drawCount = 0;
+
+		bool operator==(const Group& _other) const
+		{
+			return pipeline == _other.pipeline && firstDraw == _other.firstDraw && drawCount == _other.drawCount;
+		}
+	};
+
+	// _keepCommands keeps a cpu copy of the commands, for the devices drawing them one by one
+	DrawBatcher(u32 _maxDraws, u32 _regionCount, vk::DeviceSize _minStorageAlignment, bool _keepCommands);
+	~DrawBatcher();
+
+	DrawBatcher(const DrawBatcher& other) = delete;
+	DrawBatcher(DrawBatcher&& other) = delete;
+	DrawBatcher& operator=(const DrawBatcher& other) = delete;
+	DrawBatcher& operator=(DrawBatcher&& other) = delete;
+
+	void BeginFrame(u32 _regionIndex);
+	// written straight in the region, the draws have to come sorted by pipeline: a pipeline seen again starts another group
+	// the firstInstance of _command is replaced by the index of _data, the groupIndex of _data by the one of its group
+	void Add(vk::Pipeline _pipeline, const vk::DrawIndexedIndirectCommand& _command, const DrawData& _data);
+	// makes the writes of the frame visible to the gpu, does nothing on coherent memory
+	void EndFrame();
+
+	[[nodiscard]] const std::vector<Group>& GetGroups() const { return m_groups; }
+	[[nodiscard]] u32 GetDrawCount() const { return m_drawCount; }
+	[[nodiscard]] u32 GetMaxDraws() const { return m_maxDraws; }
+	[[nodiscard]] u32 GetRegionCount() const { return m_regionCount; }
+
+	[[nodiscard]] vk::Buffer GetBuffer() const { return m_buffer; }
+	// dynamic offset of the draw data of the current region, for an eStorageBufferDynamic descriptor of GetDrawDataRange() bytes
+	[[nodiscard]] u32 GetDrawDataOffset() const { return static_cast<u32>(m_regionStart); }
+	[[nodiscard]] vk::DeviceSize GetDrawDataRange() const { return sizeof(DrawData) * m_maxDraws; }
+	// the commands of the current region, tightly packed
+	[[nodiscard]] vk::DeviceSize GetCommandOffset(u32 _draw) const { return m_regionStart + m_commandSectionOffset + sizeof(vk::DrawIndexedIndirectCommand) * _draw; }
+	// from the start of a region, aligned so the commands can be bound on their own with the region as dynamic offset
+	[[nodiscard]] vk::DeviceSize GetCommandSectionOffset() const { return m_commandSectionOffset; }
+	[[nodiscard]] vk::DeviceSize GetCommandRange() const { return sizeof(vk::DrawIndexedIndirectCommand) * m_maxDraws; }
+	// only with _keepCommands, the firstInstance is the index of the draw data
+	[[nodiscard]] const vk::DrawIndexedIndirectCommand& GetCommand(u32 _draw) const { return m_commands[_draw]; }
+
+private:
+	vk::Buffer m_buffer;
+	vma::Allocation m_allocation;
+	u8* m_data = nullptr;
+
+	u32 m_maxDraws;
+	u32 m_regionCount;
+	vk::DeviceSize m_regionSize;
+	vk::DeviceSize m_commandSectionOffset;
+	vk::DeviceSize m_regionStart = 0;
+
+	u32 m_drawCount = 0;
+	std::vector<Group> m_groups;
+
+	bool m_keepCommands;
+	std::vector<vk::DrawIndexedIndirectCommand> m_commands;
+};
@@ -0,0 +1,95 @@
+#include "FreeListAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+FreeListAllocator::FreeListAllocator(u64 _capacity)
+	: m_capacity(_capacity)
+{
+	if (m_capacity > 0)
+	{
+		m_freeRanges.emplace(0, m_capacity);
+	}
+}
+
+bool FreeListAllocator::Allocate(u64 _size, u64 _alignment, u64& _offset)
+{
+	assert(_size > 0 && _alignment > 0);
+
+	for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it)
+	{
+		const u64 rangeOffset = it->first;
+		const u64 rangeEnd = it->first + it->second;
+		const u64 aligned = (rangeOffset + _alignment - 1) / _alignment * _alignment;
+
+		if (aligned + _size > rangeEnd)
+			continue;
+
+		m_freeRanges.erase(it);
+
+		// the padding before and the rest after stay free
+		if (aligned > rangeOffset)
+		{
+			m_freeRanges.emplace(rangeOffset, aligned - rangeOffset);
+		}
+
+		if (aligned + _size < rangeEnd)
+		{
+			m_freeRanges.emplace(aligned + _size, rangeEnd - aligned - _size);
+		}
+
+		m_usedSize += _size;
+		_offset = aligned;
+
+		return true;
+	}
+
+	return false;
+}
+
+void FreeListAllocator::Free(u64 _offset, u64 _size)
+{
+	assert(_size > 0 && _offset + _size <= m_capacity);
+
+	u64 offset = _offset;
+	u64 size = _size;
+
+	auto next = m_freeRanges.lower_bound(offset);
+
+	assert((next == m_freeRanges.end() || offset + size <= next->first) && "freeing a range that is already free");
+
+	if (next != m_freeRanges.begin())
+	{
+		const auto previous = std::prev(next);
+
+		assert(previous->first + previous->second <= offset && "freeing a range that is already free");
+
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			m_freeRanges.erase(previous);
+		}
+	}
+
+	if (next != m_freeRanges.end() && next->first == _offset + _size)
+	{
+		size += next->second;
+		m_freeRanges.erase(next);
+	}
+
+	m_freeRanges.emplace(offset, size);
+	m_usedSize -= _size;
+}
+
+u64 FreeListAllocator::GetLargestFreeRange() const
+{
+	u64 largest = 0;
+
+	for (const auto& [offset, size] : m_freeRanges)
+	{
+		largest = std::max(largest, size);
+	}
+
+	return largest;
+}
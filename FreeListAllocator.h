@@ -0,0 +1,37 @@
+#pragma once
+
+#include <map>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// Sub-allocates [0; capacity[ of something that lives elsewhere (a buffer...), only the bookkeeping is done here.
+// First fit in the free ranges sorted by offset, a freed range is merged with the free ranges around it.
+class FreeListAllocator
+{
+public:
+	explicit FreeListAllocator(u64 _capacity);
+
+	FreeListAllocator(const FreeListAllocator& other) = delete;
+	FreeListAllocator(FreeListAllocator&& other) = delete;
+	FreeListAllocator& operator=(const FreeListAllocator& other) = delete;
+	FreeListAllocator& operator=(FreeListAllocator&& other) = delete;
+
+	// _alignment does not have to be a power of two (a vertex stride...), false when no free range is big enough
+	[[nodiscard]] bool Allocate(u64 _size, u64 _alignment, u64& _offset);
+	// exactly what Allocate returned
+	void Free(u64 _offset, u64 _size);
+
+	[[nodiscard]] u64 GetCapacity() const { return m_capacity; }
+	[[nodiscard]] u64 GetUsedSize() const { return m_usedSize; }
+	[[nodiscard]] u32 GetFreeRangeCount() const { return static_cast<u32>(m_freeRanges.size()); }
+	[[nodiscard]] u64 GetLargestFreeRange() const;
+
+private:
+	// offset -> size
+	std::map<u64, u64> m_freeRanges;
+
+	u64 m_capacity;
+	u64 m_usedSize = 0;
+};
@@ -0,0 +1,90 @@
+#include "GeometryArena.h"
+
+#include <iostream>
+
+#include "imgui/imgui.h"
+#include "systems/VulkanContext.h"
+
+GeometryArena::GeometryArena(vk::DeviceSize _vertexCapacity, vk::DeviceSize _indexCapacity)
+	: m_vertexRanges(_vertexCapacity), m_indexRanges(_indexCapacity)
+{
+	VulkanContext* context = VulkanContext::GraphicInstance;
+
+	//transfer dst even with direct writes, it costs nothing and the buffers can be filled both ways
+	context->CreateBuffer(_vertexCapacity, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst
+		, EMemoryPool::Geometry, m_vertexBuffer, m_vertexMemory);
+	context->CreateBuffer(_indexCapacity, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst
+		, EMemoryPool::Geometry, m_indexBuffer, m_indexMemory);
+}
+
+GeometryArena::~GeometryArena()
+{
+	if (m_vertexRanges.GetUsedSize() > 0 || m_indexRanges.GetUsedSize() > 0)
+	{
+		std::cout << "[GeometryArena] destroyed with " << m_vertexRanges.GetUsedSize() << " vertex bytes and "
+			<< m_indexRanges.GetUsedSize() << " index bytes still allocated" << std::endl;
+	}
+
+	VulkanContext::GraphicInstance->DestroyBuffer(m_vertexBuffer, m_vertexMemory);
+	VulkanContext::GraphicInstance->DestroyBuffer(m_indexBuffer, m_indexMemory);
+}
+
+bool GeometryArena::AllocateVertices(vk::DeviceSize _size, u32 _stride, const std::function<void(void* _dst)>& _write, Range& _range)
+{
+	if (!m_vertexRanges.Allocate(_size, _stride, _range.offset))
+	{
+		std::cout << "[GeometryArena] no room left for " << _size << " vertex bytes" << std::endl;
+		return false;
+	}
+
+	_range.size = _size;
+
+	VulkanContext::GraphicInstance->WriteStaticBuffer(m_vertexBuffer, m_vertexMemory, _range.offset, _size, _write);
+
+	return true;
+}
+
+bool GeometryArena::AllocateIndices(vk::DeviceSize _size, const std::function<void(void* _dst)>& _write, Range& _range)
+{
+	//u32 alignment, the range can hold 16 or 32 bits indices
+	if (!m_indexRanges.Allocate(_size, sizeof(u32), _range.offset))
+	{
+		std::cout << "[GeometryArena] no room left for " << _size << " index bytes" << std::endl;
+		return false;
+	}
+
+	_range.size = _size;
+
+	VulkanContext::GraphicInstance->WriteStaticBuffer(m_indexBuffer, m_indexMemory, _range.offset, _size, _write);
+
+	return true;
+}
+
+void GeometryArena::FreeVertices(const Range& _range)
+{
+	if (_range.size > 0)
+	{
+		m_vertexRanges.Free(_range.offset, _range.size);
+	}
+}
+
+void GeometryArena::FreeIndices(const Range& _range)
+{
+	if (_range.size > 0)
+	{
+		m_indexRanges.Free(_range.offset, _range.size);
+	}
+}
+
+void GeometryArena::DrawGUI() const
+{
+	const auto drawAllocator = [](const char* _name, const FreeListAllocator& _allocator)
+	{
+		ImGui::Text("%s: %llu/%llu KB, %u free ranges, largest %llu KB", _name
+			, static_cast<unsigned long long>(_allocator.GetUsedSize() / 1024), static_cast<unsigned long long>(_allocator.GetCapacity() / 1024)
+			, _allocator.GetFreeRangeCount(), static_cast<unsigned long long>(_allocator.GetLargestFreeRange() / 1024));
+	};
+
+	drawAllocator("Vertex arena", m_vertexRanges);
+	drawAllocator("Index arena", m_indexRanges);
+}
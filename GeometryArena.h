@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "FreeListAllocator.h"
+#include "vma/vk_mem_alloc.hpp"
+
+using namespace glm;
+
+// One vertex buffer and one index buffer in the geometry pool, shared by every mesh.
+// The submeshes are ranges in them: the whole scene is drawn with a single vertex and index binding,
+// a draw only carries its first index and vertex offset, which is what an indirect draw needs.
+class GeometryArena
+{
+public:
+	// in bytes
+	struct Range
+	{
+		u64 offset = 0;
+		u64 size = 0;
+	};
+
+	GeometryArena(vk::DeviceSize _vertexCapacity, vk::DeviceSize _indexCapacity);
+	~GeometryArena();
+
+	GeometryArena(const GeometryArena& other) = delete;
+	GeometryArena(GeometryArena&& other) = delete;
+	GeometryArena& operator=(const GeometryArena& other) = delete;
+	GeometryArena& operator=(GeometryArena&& other) = delete;
+
+	// _write fills the _size bytes in place (mapped memory or staging), false when there is no room left
+	// the vertices are aligned on _stride, the offset of the range is a whole number of vertices
+	[[nodiscard]] bool AllocateVertices(vk::DeviceSize _size, u32 _stride, const std::function<void(void* _dst)>& _write, Range& _range);
+	[[nodiscard]] bool AllocateIndices(vk::DeviceSize _size, const std::function<void(void* _dst)>& _write, Range& _range);
+
+	// the gpu must be done with the range
+	void FreeVertices(const Range& _range);
+	void FreeIndices(const Range& _range);
+
+	[[nodiscard]] vk::Buffer GetVertexBuffer() const { return m_vertexBuffer; }
+	[[nodiscard]] vk::Buffer GetIndexBuffer() const { return m_indexBuffer; }
+
+	void DrawGUI() const;
+
+private:
+	vk::Buffer m_vertexBuffer;
+	vma::Allocation m_vertexMemory;
+	FreeListAllocator m_vertexRanges;
+
+	vk::Buffer m_indexBuffer;
+	vma::Allocation m_indexMemory;
+	FreeListAllocator m_indexRanges;
+};
@@ -0,0 +1,721 @@
+#include "GpuCulling.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+#include "CpuProfiler.h"
+#include "DrawBatcher.h"
+#include "Shader.h"
+#include "systems/VulkanContext.h"
+
+// std140, the uniform buffer of shaders/Cull.glsl
+struct CullUniforms
+{
+	mat4 viewProj;
+	mat4 previousViewProj;
+	vec2 pyramidSize;
+	u32 drawCount;
+	u32 useOcclusion;
+	uvec4 groupFirstDraws[GpuCulling::MAX_DRAW_GROUPS / 4];
+};
+
+static_assert(sizeof(CullUniforms) == 400, "CullUniforms has to match its std140 declaration in shaders/Cull.glsl");
+
+// local_size_x of shaders/Cull.glsl, one draw per invocation
+static constexpr u32 CULL_GROUP_SIZE = 64;
+// local_size_x and y of shaders/HiZ.glsl, one texel per invocation
+static constexpr u32 PYRAMID_GROUP_SIZE = 8;
+
+static vk::DeviceSize AlignUp(vk::DeviceSize _value, vk::DeviceSize _alignment)
+{
+	return (_value + _alignment - 1) & ~(_alignment - 1);
+}
+
+static u32 PreviousPowerOfTwo(u32 _value)
+{
+	u32 result = 1;
+
+	while (result * 2 <= _value)
+	{
+		result *= 2;
+	}
+
+	return result;
+}
+
+GpuCulling::GpuCulling(vk::Device _device, vk::PhysicalDevice _physicalDevice, u32 _computeFamily, vk::Queue _computeQueue, vk::PipelineCache _pipelineCache
+	, std::vector<u32> _concurrentFamilies)
+	: m_device(_device), m_limits(_physicalDevice.getProperties().limits), m_concurrentFamilies(std::move(_concurrentFamilies))
+	, m_computeFamily(_computeFamily), m_computeQueue(_computeQueue)
+{
+	assert(IsSupported(_physicalDevice));
+
+	const u32 timestampValidBits = _physicalDevice.getQueueFamilyProperties()[m_computeFamily].timestampValidBits;
+	m_hasTimestamps = timestampValidBits > 0 && m_limits.timestampPeriod > 0.0f;
+	m_timestampPeriod = m_limits.timestampPeriod;
+	m_timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+
+	CreatePipelines(_pipelineCache);
+
+	vk::SemaphoreTypeCreateInfo timelineInfo;
+	timelineInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+	timelineInfo.initialValue = 0;
+
+	vk::SemaphoreCreateInfo semaphoreInfo;
+	semaphoreInfo.pNext = &timelineInfo;
+
+	m_cullSemaphore = m_device.createSemaphore(semaphoreInfo);
+	m_pyramidSemaphore = m_device.createSemaphore(semaphoreInfo);
+
+	vk::CommandPoolCreateInfo poolInfo;
+	poolInfo.queueFamilyIndex = m_computeFamily;
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+
+	m_commandPool = m_device.createCommandPool(poolInfo);
+
+	vk::SamplerReductionModeCreateInfo reductionInfo;
+	reductionInfo.reductionMode = vk::SamplerReductionMode::eMax;
+
+	vk::SamplerCreateInfo samplerInfo;
+	samplerInfo.pNext = &reductionInfo;
+	samplerInfo.magFilter = vk::Filter::eLinear;
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	// the level is always picked with textureLod
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	m_reductionSampler = m_device.createSampler(samplerInfo);
+}
+
+bool GpuCulling::IsSupported(vk::PhysicalDevice _physicalDevice)
+{
+	// the pyramid is reduced with a max sampler, from the depth first then from itself
+	for (const vk::Format format : { vk::Format::eD32Sfloat, vk::Format::eR32Sfloat })
+	{
+		const vk::FormatFeatureFlags features = _physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+
+		if (!(features & vk::FormatFeatureFlagBits::eSampledImageFilterMinmax))
+			return false;
+	}
+
+	return true;
+}
+
+GpuCulling::~GpuCulling()
+{
+	m_computeQueue.waitIdle();
+
+	DestroyTargets();
+
+	m_device.destroySampler(m_reductionSampler);
+	m_device.destroyCommandPool(m_commandPool);
+	m_device.destroySemaphore(m_cullSemaphore);
+	m_device.destroySemaphore(m_pyramidSemaphore);
+
+	m_device.destroyPipeline(m_cullPipeline);
+	m_device.destroyPipelineLayout(m_cullPipelineLayout);
+	m_device.destroyDescriptorSetLayout(m_cullSetLayout);
+
+	m_device.destroyPipeline(m_pyramidPipeline);
+	m_device.destroyPipelineLayout(m_pyramidPipelineLayout);
+	m_device.destroyDescriptorSetLayout(m_pyramidSetLayout);
+}
+
+void GpuCulling::CreatePipelines(vk::PipelineCache _pipelineCache)
+{
+	const auto makeBinding = [](u32 _binding, vk::DescriptorType _type)
+	{
+		vk::DescriptorSetLayoutBinding binding;
+		binding.binding = _binding;
+		binding.descriptorCount = 1;
+		binding.descriptorType = _type;
+		binding.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+		return binding;
+	};
+
+	// the batcher buffer follows the region of the frame with dynamic offsets, the rest has one set per image
+	const std::array cullBindings =
+	{
+		makeBinding(0, vk::DescriptorType::eStorageBufferDynamic), // draw data
+		makeBinding(1, vk::DescriptorType::eStorageBufferDynamic), // candidate commands
+		makeBinding(2, vk::DescriptorType::eStorageBuffer), // visible commands
+		makeBinding(3, vk::DescriptorType::eStorageBuffer), // counters
+		makeBinding(4, vk::DescriptorType::eUniformBuffer),
+		makeBinding(5, vk::DescriptorType::eCombinedImageSampler), // depth pyramid
+	};
+
+	vk::DescriptorSetLayoutCreateInfo cullSetInfo;
+	cullSetInfo.bindingCount = static_cast<u32>(cullBindings.size());
+	cullSetInfo.pBindings = cullBindings.data();
+
+	m_cullSetLayout = m_device.createDescriptorSetLayout(cullSetInfo);
+
+	vk::PipelineLayoutCreateInfo cullLayoutInfo;
+	cullLayoutInfo.setLayoutCount = 1;
+	cullLayoutInfo.pSetLayouts = &m_cullSetLayout;
+
+	m_cullPipelineLayout = m_device.createPipelineLayout(cullLayoutInfo);
+
+	// the level read then the level written
+	const std::array pyramidBindings =
+	{
+		makeBinding(0, vk::DescriptorType::eCombinedImageSampler),
+		makeBinding(1, vk::DescriptorType::eStorageImage),
+	};
+
+	vk::DescriptorSetLayoutCreateInfo pyramidSetInfo;
+	pyramidSetInfo.bindingCount = static_cast<u32>(pyramidBindings.size());
+	pyramidSetInfo.pBindings = pyramidBindings.data();
+
+	m_pyramidSetLayout = m_device.createDescriptorSetLayout(pyramidSetInfo);
+
+	// the size of the level written
+	vk::PushConstantRange pushConstant;
+	pushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(vec2);
+
+	vk::PipelineLayoutCreateInfo pyramidLayoutInfo;
+	pyramidLayoutInfo.setLayoutCount = 1;
+	pyramidLayoutInfo.pSetLayouts = &m_pyramidSetLayout;
+	pyramidLayoutInfo.pushConstantRangeCount = 1;
+	pyramidLayoutInfo.pPushConstantRanges = &pushConstant;
+
+	m_pyramidPipelineLayout = m_device.createPipelineLayout(pyramidLayoutInfo);
+
+	const auto createPipeline = [this, _pipelineCache](const char* _path, vk::PipelineLayout _layout)
+	{
+		const vk::ShaderModule module = Shader::LoadComputeModule(m_device, _path);
+
+		vk::ComputePipelineCreateInfo info;
+		info.stage.stage = vk::ShaderStageFlagBits::eCompute;
+		info.stage.module = module;
+		info.stage.pName = "main";
+		info.layout = _layout;
+
+		const vk::Pipeline pipeline = m_device.createComputePipeline(_pipelineCache, info).value;
+
+		// nothing needs it once the pipeline exists
+		m_device.destroyShaderModule(module);
+
+		return pipeline;
+	};
+
+	m_cullPipeline = createPipeline("shaders/Cull", m_cullPipelineLayout);
+	m_pyramidPipeline = createPipeline("shaders/HiZ", m_pyramidPipelineLayout);
+}
+
+void GpuCulling::CreateTargets(const DrawBatcher& _batcher, vk::Extent2D _extent, const std::vector<vk::ImageView>& _depthViews)
+{
+	VulkanContext* context = VulkanContext::GraphicInstance;
+
+	m_regionCount = _batcher.GetRegionCount();
+	assert(_depthViews.size() == m_regionCount);
+
+	// every region is bound at its start, like the ones of the batcher
+	m_visibleRegionSize = AlignUp(sizeof(vk::DrawIndexedIndirectCommand) * _batcher.GetMaxDraws(), m_limits.minStorageBufferOffsetAlignment);
+	m_counterRegionSize = AlignUp(sizeof(u32) * MAX_DRAW_GROUPS + sizeof(Stats), m_limits.minStorageBufferOffsetAlignment);
+	// the stats are invalidated on their own, the region has to cover whole atoms
+	m_hostRegionSize = AlignUp(sizeof(CullUniforms) + sizeof(Stats), std::max(m_limits.minUniformBufferOffsetAlignment, m_limits.nonCoherentAtomSize));
+
+	// written by the compute queue, drawn by the graphics one
+	context->CreateBuffer(m_visibleRegionSize * m_regionCount, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+		, EMemoryPool::GpuOnly, m_visibleCommands, m_visibleCommandsMemory, m_concurrentFamilies);
+	context->CreateBuffer(m_counterRegionSize * m_regionCount, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+		| vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, EMemoryPool::GpuOnly, m_counters, m_countersMemory, m_concurrentFamilies);
+	// only touched by the compute queue
+	context->CreateBuffer(m_hostRegionSize * m_regionCount, vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst
+		, EMemoryPool::Dynamic, m_hostData, m_hostDataMemory);
+
+	// kept mapped until the targets are destroyed
+	m_hostDataMapped = static_cast<u8*>(VulkanContext::s_allocator.mapMemory(m_hostDataMemory));
+	m_hasStats.assign(m_regionCount, false);
+	m_regionFrames.assign(m_regionCount, 0);
+
+	if (m_hasTimestamps)
+	{
+		vk::QueryPoolCreateInfo queryInfo;
+		queryInfo.queryType = vk::QueryType::eTimestamp;
+		queryInfo.queryCount = m_regionCount * 2;
+
+		m_timestampPool = m_device.createQueryPool(queryInfo);
+	}
+
+	vk::CommandBufferAllocateInfo allocInfo;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.commandBufferCount = m_regionCount;
+	allocInfo.level = vk::CommandBufferLevel::ePrimary;
+
+	m_commandBuffers = m_device.allocateCommandBuffers(allocInfo);
+
+	CreateDepthPyramid(_extent);
+	CreateDescriptorSets(_batcher, _depthViews);
+
+	// whatever was built before was at another size
+	m_pyramidFrameValue = 0;
+}
+
+void GpuCulling::DestroyTargets()
+{
+	if (!m_visibleCommands)
+		return;
+
+	// the regions go with the targets, what they hold is kept
+	ReadBackAll();
+
+	VulkanContext* context = VulkanContext::GraphicInstance;
+
+	if (m_timestampPool)
+	{
+		m_device.destroyQueryPool(m_timestampPool);
+		m_timestampPool = nullptr;
+	}
+
+	m_device.destroyDescriptorPool(m_descriptorPool);
+	m_descriptorPool = nullptr;
+	m_cullSets.clear();
+	m_pyramidSetsFromDepth.clear();
+	m_pyramidSetsFromLevel.clear();
+
+	m_device.freeCommandBuffers(m_commandPool, m_commandBuffers);
+	m_commandBuffers.clear();
+
+	for (const vk::ImageView view : m_pyramidLevelViews)
+	{
+		m_device.destroyImageView(view);
+	}
+
+	m_pyramidLevelViews.clear();
+	m_device.destroyImageView(m_pyramidView);
+	m_pyramidView = nullptr;
+	context->DestroyImage(m_pyramid, m_pyramidMemory);
+
+	VulkanContext::s_allocator.unmapMemory(m_hostDataMemory);
+	m_hostDataMapped = nullptr;
+
+	context->DestroyBuffer(m_visibleCommands, m_visibleCommandsMemory);
+	context->DestroyBuffer(m_counters, m_countersMemory);
+	context->DestroyBuffer(m_hostData, m_hostDataMemory);
+}
+
+void GpuCulling::CreateDepthPyramid(vk::Extent2D _extent)
+{
+	// a power of two, each level is exactly half the one before, a texel covers 2x2 texels of the previous level
+	m_pyramidExtent = vk::Extent2D(PreviousPowerOfTwo(_extent.width), PreviousPowerOfTwo(_extent.height));
+
+	u32 levelCount = 1;
+
+	while ((std::max(m_pyramidExtent.width, m_pyramidExtent.height) >> levelCount) > 0)
+	{
+		levelCount++;
+	}
+
+	vk::ImageCreateInfo imageInfo;
+	imageInfo.imageType = vk::ImageType::e2D;
+	imageInfo.format = vk::Format::eR32Sfloat;
+	imageInfo.extent = vk::Extent3D(m_pyramidExtent, 1);
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = vk::SampleCountFlagBits::e1;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage;
+	imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+	// built by the graphics queue, read by the compute one
+	if (!m_concurrentFamilies.empty())
+	{
+		imageInfo.sharingMode = vk::SharingMode::eConcurrent;
+		imageInfo.queueFamilyIndexCount = static_cast<u32>(m_concurrentFamilies.size());
+		imageInfo.pQueueFamilyIndices = m_concurrentFamilies.data();
+	}
+
+	vma::AllocationCreateInfo allocInfo;
+	allocInfo.usage = vma::MemoryUsage::eGpuOnly;
+
+	const auto [image, allocation] = VulkanContext::s_allocator.createImage(imageInfo, allocInfo);
+
+	m_pyramid = image;
+	m_pyramidMemory = allocation;
+
+	vk::ImageViewCreateInfo viewInfo;
+	viewInfo.image = m_pyramid;
+	viewInfo.viewType = vk::ImageViewType::e2D;
+	viewInfo.format = imageInfo.format;
+	viewInfo.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1);
+
+	// the cull picks its level in the whole chain
+	m_pyramidView = m_device.createImageView(viewInfo);
+
+	for (u32 level = 0; level < levelCount; ++level)
+	{
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+
+		m_pyramidLevelViews.emplace_back(m_device.createImageView(viewInfo));
+	}
+
+	// every level stays in general, it is written and sampled from there
+	vk::ImageMemoryBarrier barrier;
+	barrier.oldLayout = vk::ImageLayout::eUndefined;
+	barrier.newLayout = vk::ImageLayout::eGeneral;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_pyramid;
+	barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1);
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+	vk::CommandBuffer cmd = VulkanContext::GraphicInstance->BeginSingleTimeCommands();
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), nullptr, nullptr, barrier);
+	VulkanContext::GraphicInstance->EndSingleTimeCommands(cmd);
+}
+
+void GpuCulling::CreateDescriptorSets(const DrawBatcher& _batcher, const std::vector<vk::ImageView>& _depthViews)
+{
+	const u32 levelCount = static_cast<u32>(m_pyramidLevelViews.size());
+	// one per image from the depth, then one per level after the first
+	const u32 pyramidSetCount = m_regionCount + levelCount - 1;
+
+	const std::array poolSizes =
+	{
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBufferDynamic, 2 * m_regionCount),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 2 * m_regionCount),
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, m_regionCount),
+		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, m_regionCount + pyramidSetCount),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, pyramidSetCount),
+	};
+
+	vk::DescriptorPoolCreateInfo poolInfo;
+	poolInfo.maxSets = m_regionCount + pyramidSetCount;
+	poolInfo.poolSizeCount = static_cast<u32>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	m_descriptorPool = m_device.createDescriptorPool(poolInfo);
+
+	const auto allocateSets = [this](vk::DescriptorSetLayout _layout, u32 _count)
+	{
+		const std::vector<vk::DescriptorSetLayout> layouts(_count, _layout);
+
+		vk::DescriptorSetAllocateInfo allocInfo;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = _count;
+		allocInfo.pSetLayouts = layouts.data();
+
+		return m_device.allocateDescriptorSets(allocInfo);
+	};
+
+	m_cullSets = allocateSets(m_cullSetLayout, m_regionCount);
+	m_pyramidSetsFromDepth = allocateSets(m_pyramidSetLayout, m_regionCount);
+
+	if (levelCount > 1)
+	{
+		m_pyramidSetsFromLevel = allocateSets(m_pyramidSetLayout, levelCount - 1);
+	}
+
+	const auto makeWrite = [](vk::DescriptorSet _set, u32 _binding, vk::DescriptorType _type)
+	{
+		vk::WriteDescriptorSet write;
+		write.dstSet = _set;
+		write.dstBinding = _binding;
+		write.descriptorCount = 1;
+		write.descriptorType = _type;
+
+		return write;
+	};
+
+	// at the start of the batcher buffer, moved to the region of the frame by the dynamic offsets
+	const vk::DescriptorBufferInfo drawDataInfo(_batcher.GetBuffer(), 0, _batcher.GetDrawDataRange());
+	const vk::DescriptorBufferInfo candidatesInfo(_batcher.GetBuffer(), _batcher.GetCommandSectionOffset(), _batcher.GetCommandRange());
+	const vk::DescriptorImageInfo pyramidInfo(m_reductionSampler, m_pyramidView, vk::ImageLayout::eGeneral);
+
+	for (u32 i = 0; i < m_regionCount; ++i)
+	{
+		const vk::DescriptorBufferInfo visibleInfo(m_visibleCommands, m_visibleRegionSize * i, m_visibleRegionSize);
+		const vk::DescriptorBufferInfo countersInfo(m_counters, m_counterRegionSize * i, sizeof(u32) * MAX_DRAW_GROUPS + sizeof(Stats));
+		const vk::DescriptorBufferInfo uniformsInfo(m_hostData, m_hostRegionSize * i, sizeof(CullUniforms));
+
+		std::array writes =
+		{
+			makeWrite(m_cullSets[i], 0, vk::DescriptorType::eStorageBufferDynamic),
+			makeWrite(m_cullSets[i], 1, vk::DescriptorType::eStorageBufferDynamic),
+			makeWrite(m_cullSets[i], 2, vk::DescriptorType::eStorageBuffer),
+			makeWrite(m_cullSets[i], 3, vk::DescriptorType::eStorageBuffer),
+			makeWrite(m_cullSets[i], 4, vk::DescriptorType::eUniformBuffer),
+			makeWrite(m_cullSets[i], 5, vk::DescriptorType::eCombinedImageSampler),
+		};
+
+		writes[0].pBufferInfo = &drawDataInfo;
+		writes[1].pBufferInfo = &candidatesInfo;
+		writes[2].pBufferInfo = &visibleInfo;
+		writes[3].pBufferInfo = &countersInfo;
+		writes[4].pBufferInfo = &uniformsInfo;
+		writes[5].pImageInfo = &pyramidInfo;
+
+		m_device.updateDescriptorSets(writes, nullptr);
+	}
+
+	const auto writePyramidSet = [&](vk::DescriptorSet _set, vk::ImageView _source, vk::ImageLayout _sourceLayout, vk::ImageView _destination)
+	{
+		const vk::DescriptorImageInfo sourceInfo(m_reductionSampler, _source, _sourceLayout);
+		const vk::DescriptorImageInfo destinationInfo(nullptr, _destination, vk::ImageLayout::eGeneral);
+
+		std::array writes =
+		{
+			makeWrite(_set, 0, vk::DescriptorType::eCombinedImageSampler),
+			makeWrite(_set, 1, vk::DescriptorType::eStorageImage),
+		};
+
+		writes[0].pImageInfo = &sourceInfo;
+		writes[1].pImageInfo = &destinationInfo;
+
+		m_device.updateDescriptorSets(writes, nullptr);
+	};
+
+	for (u32 i = 0; i < m_regionCount; ++i)
+	{
+		writePyramidSet(m_pyramidSetsFromDepth[i], _depthViews[i], vk::ImageLayout::eShaderReadOnlyOptimal, m_pyramidLevelViews[0]);
+	}
+
+	for (u32 level = 1; level < levelCount; ++level)
+	{
+		writePyramidSet(m_pyramidSetsFromLevel[level - 1], m_pyramidLevelViews[level - 1], vk::ImageLayout::eGeneral, m_pyramidLevelViews[level]);
+	}
+}
+
+void GpuCulling::Cull(u32 _imageIndex, const DrawBatcher& _batcher, const mat4& _viewProj, bool _useOcclusion, u64 _frame)
+{
+	PROFILE_ZONE("GpuCulling::Cull");
+
+	const std::vector<DrawBatcher::Group>& groups = _batcher.GetGroups();
+	assert(groups.size() <= MAX_DRAW_GROUPS && "more pipelines than culling counters");
+
+	const vk::DeviceSize hostRegion = m_hostRegionSize * _imageIndex;
+
+	// the fence of the last frame that used this image was waited on, its cull is done
+	ReadBack(_imageIndex);
+
+	// only the depth of the frame right before this one is worth testing against
+	const bool isPyramidValid = m_pyramidFrameValue != 0 && m_pyramidFrameValue == m_frameValue;
+
+	CullUniforms uniforms{};
+	uniforms.viewProj = _viewProj;
+	uniforms.previousViewProj = m_previousViewProj;
+	uniforms.pyramidSize = vec2(static_cast<float>(m_pyramidExtent.width), static_cast<float>(m_pyramidExtent.height));
+	uniforms.drawCount = _batcher.GetDrawCount();
+	uniforms.useOcclusion = _useOcclusion && isPyramidValid ? 1 : 0;
+
+	for (u32 i = 0; i < groups.size(); ++i)
+	{
+		uniforms.groupFirstDraws[i / 4][i % 4] = groups[i].firstDraw;
+	}
+
+	memcpy(m_hostDataMapped + hostRegion, &uniforms, sizeof(uniforms));
+	VulkanContext::s_allocator.flushAllocation(m_hostDataMemory, hostRegion, sizeof(uniforms));
+
+	m_previousViewProj = _viewProj;
+
+	const vk::DeviceSize counterRegion = m_counterRegionSize * _imageIndex;
+	vk::CommandBuffer cmd = m_commandBuffers[_imageIndex];
+
+	cmd.reset();
+
+	vk::CommandBufferBeginInfo beginInfo;
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+	cmd.begin(beginInfo);
+
+	if (m_hasTimestamps)
+	{
+		cmd.resetQueryPool(m_timestampPool, _imageIndex * 2, 2);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_timestampPool, _imageIndex * 2);
+	}
+
+	// each visible draw takes its slot in its group with an atomic on these
+	cmd.fillBuffer(m_counters, counterRegion, sizeof(u32) * MAX_DRAW_GROUPS + sizeof(Stats), 0);
+
+	vk::MemoryBarrier clearBarrier;
+	clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+
+	if (uniforms.drawCount > 0)
+	{
+		// the draw data and the candidates are in the same region
+		const std::array dynamicOffsets = { _batcher.GetDrawDataOffset(), _batcher.GetDrawDataOffset() };
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_cullPipeline);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cullPipelineLayout, 0, 1, &m_cullSets[_imageIndex]
+			, static_cast<u32>(dynamicOffsets.size()), dynamicOffsets.data());
+		cmd.dispatch((uniforms.drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	}
+
+	// read back when the image comes back, a few frames late
+	vk::MemoryBarrier statsBarrier;
+	statsBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	statsBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), statsBarrier, nullptr, nullptr);
+
+	const vk::BufferCopy statsCopy(counterRegion + sizeof(u32) * MAX_DRAW_GROUPS, hostRegion + sizeof(CullUniforms), sizeof(Stats));
+	cmd.copyBuffer(m_counters, m_hostData, statsCopy);
+
+	vk::MemoryBarrier hostBarrier;
+	hostBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	hostBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), hostBarrier, nullptr, nullptr);
+
+	if (m_hasTimestamps)
+	{
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestampPool, _imageIndex * 2 + 1);
+	}
+
+	cmd.end();
+
+	// the previous frame rebuilds the pyramid after drawing, it has to be done before it is read here
+	const u64 waitValue = m_pyramidFrameValue;
+	const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eComputeShader;
+	const u64 signalValue = ++m_frameValue;
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.waitSemaphoreValueCount = 1;
+	timelineInfo.pWaitSemaphoreValues = &waitValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &m_pyramidSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmd;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_cullSemaphore;
+
+	m_computeQueue.submit(submitInfo);
+
+	m_hasStats[_imageIndex] = true;
+	m_regionFrames[_imageIndex] = _frame;
+}
+
+void GpuCulling::ReadBack(u32 _imageIndex)
+{
+	if (!m_hasStats[_imageIndex])
+		return;
+
+	const vk::DeviceSize hostRegion = m_hostRegionSize * _imageIndex;
+
+	VulkanContext::s_allocator.invalidateAllocation(m_hostDataMemory, hostRegion + sizeof(CullUniforms), sizeof(Stats));
+	memcpy(&m_stats, m_hostDataMapped + hostRegion + sizeof(CullUniforms), sizeof(Stats));
+
+	if (m_hasTimestamps)
+	{
+		// value + availability of the begin then the end, nothing waits
+		std::array<u64, 4> results{};
+
+		const auto res = m_device.getQueryPoolResults(m_timestampPool, _imageIndex * 2, 2, sizeof(results), results.data()
+			, sizeof(u64) * 2, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+		assert(res == vk::Result::eSuccess || res == vk::Result::eNotReady);
+
+		if (results[1] != 0 && results[3] != 0)
+		{
+			const u64 ticks = ((results[2] & m_timestampMask) - (results[0] & m_timestampMask)) & m_timestampMask;
+			m_cullSamples.push_back({ m_regionFrames[_imageIndex], static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod / 1000000.0) });
+		}
+	}
+
+	m_hasStats[_imageIndex] = false;
+}
+
+void GpuCulling::ReadBackAll()
+{
+	// oldest frame first, the stats end up being the ones of the last frame
+	std::vector<u32> regions;
+
+	for (u32 i = 0; i < m_hasStats.size(); ++i)
+	{
+		if (m_hasStats[i])
+			regions.emplace_back(i);
+	}
+
+	std::sort(regions.begin(), regions.end(), [this](u32 _a, u32 _b) { return m_regionFrames[_a] < m_regionFrames[_b]; });
+
+	for (const u32 region : regions)
+	{
+		ReadBack(region);
+	}
+}
+
+std::vector<GpuProfiler::FrameSample> GpuCulling::TakeCullSamples()
+{
+	std::vector<GpuProfiler::FrameSample> samples;
+	samples.swap(m_cullSamples);
+
+	return samples;
+}
+
+void GpuCulling::RecordDepthPyramid(vk::CommandBuffer _cmd, u32 _imageIndex, vk::Image _depthImage)
+{
+	// the render pass leaves it as an attachment, the first level samples it
+	vk::ImageMemoryBarrier depthBarrier;
+	depthBarrier.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	depthBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	depthBarrier.oldLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+	depthBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = _depthImage;
+	depthBarrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+
+	_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags()
+		, nullptr, nullptr, depthBarrier);
+
+	_cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pyramidPipeline);
+
+	const u32 levelCount = static_cast<u32>(m_pyramidLevelViews.size());
+
+	for (u32 level = 0; level < levelCount; ++level)
+	{
+		const vk::DescriptorSet set = level == 0 ? m_pyramidSetsFromDepth[_imageIndex] : m_pyramidSetsFromLevel[level - 1];
+		const u32 width = std::max(m_pyramidExtent.width >> level, 1u);
+		const u32 height = std::max(m_pyramidExtent.height >> level, 1u);
+		const vec2 outputSize(static_cast<float>(width), static_cast<float>(height));
+
+		_cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pyramidPipelineLayout, 0, set, nullptr);
+		_cmd.pushConstants(m_pyramidPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(outputSize), &outputSize);
+		_cmd.dispatch((width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+		if (level + 1 == levelCount)
+			break;
+
+		// the next level samples this one
+		vk::ImageMemoryBarrier levelBarrier;
+		levelBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		levelBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		levelBarrier.oldLayout = vk::ImageLayout::eGeneral;
+		levelBarrier.newLayout = vk::ImageLayout::eGeneral;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = m_pyramid;
+		levelBarrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level, 1, 0, 1);
+
+		_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags()
+			, nullptr, nullptr, levelBarrier);
+	}
+
+	// signaled by the graphics submit of this frame, with GetFrameValue()
+	m_pyramidFrameValue = m_frameValue;
+}
+
+vk::DeviceSize GpuCulling::GetVisibleCommandOffset(u32 _imageIndex, u32 _draw) const
+{
+	return m_visibleRegionSize * _imageIndex + sizeof(vk::DrawIndexedIndirectCommand) * _draw;
+}
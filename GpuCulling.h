@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "GpuProfiler.h"
+#include "vma/vk_mem_alloc.hpp"
+
+using namespace glm;
+
+class DrawBatcher;
+
+// Culls the draws of the DrawBatcher on the gpu, in a compute pass submitted to the compute queue before the main pass.
+// Each draw is tested against the frustum, then against a depth pyramid (hi-z) built from the depth of the previous frame,
+// the survivors are compacted per group in an indirect buffer drawn with drawIndexedIndirectCount.
+//
+// Every frame:
+//   compute: waits for the pyramid of the previous frame, culls, signals GetCullSemaphore() with GetFrameValue()
+//   graphics: waits for it, draws, rebuilds the pyramid from its depth, signals GetPyramidSemaphore() with GetFrameValue()
+// The pyramid only knows what was visible from the previous camera: what comes out from behind an occluder shows up one frame late.
+// The resources read by both queues are shared concurrently, there is no ownership transfer to record.
+class GpuCulling
+{
+public:
+	// the groups of the DrawBatcher
+	static constexpr u32 MAX_DRAW_GROUPS = 64;
+
+	struct Stats
+	{
+		u32 visible = 0;
+		u32 frustumCulled = 0;
+		u32 occlusionCulled = 0;
+	};
+
+	// _concurrentFamilies are the graphics and compute ones when they differ, empty otherwise
+	GpuCulling(vk::Device _device, vk::PhysicalDevice _physicalDevice, u32 _computeFamily, vk::Queue _computeQueue, vk::PipelineCache _pipelineCache
+		, std::vector<u32> _concurrentFamilies);
+	~GpuCulling();
+
+	// the formats of the depth pyramid, the device features are checked by the caller
+	[[nodiscard]] static bool IsSupported(vk::PhysicalDevice _physicalDevice);
+
+	GpuCulling(const GpuCulling& other) = delete;
+	GpuCulling(GpuCulling&& other) = delete;
+	GpuCulling& operator=(const GpuCulling& other) = delete;
+	GpuCulling& operator=(GpuCulling&& other) = delete;
+
+	// one region per region of _batcher, the pyramid follows the size of the depth images, created again with the swapchain
+	void CreateTargets(const DrawBatcher& _batcher, vk::Extent2D _extent, const std::vector<vk::ImageView>& _depthViews);
+	void DestroyTargets();
+
+	// culls the draws of the current region of _batcher, filled for the swapchain image _imageIndex, and submits it right away
+	// _viewProj is the one of the frame, the occlusion test is skipped when the pyramid is not the one of the previous frame
+	// the gpu time of the submission is tagged with _frame
+	void Cull(u32 _imageIndex, const DrawBatcher& _batcher, const mat4& _viewProj, bool _useOcclusion, u64 _frame);
+
+	// in the graphics command buffer of the frame, after the main pass, _depthImage is in eDepthStencilAttachmentOptimal
+	void RecordDepthPyramid(vk::CommandBuffer _cmd, u32 _imageIndex, vk::Image _depthImage);
+
+	[[nodiscard]] vk::Semaphore GetCullSemaphore() const { return m_cullSemaphore; }
+	[[nodiscard]] vk::Semaphore GetPyramidSemaphore() const { return m_pyramidSemaphore; }
+	[[nodiscard]] u64 GetFrameValue() const { return m_frameValue; }
+	// the indirect commands and counts, and the pyramid that is written after the cull read it
+	[[nodiscard]] static vk::PipelineStageFlags GetGraphicsWaitStages()
+	{
+		return vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader;
+	}
+
+	// the visible commands of a group start at the same index as in the DrawBatcher, GetCountOffset() holds how many there are
+	[[nodiscard]] vk::Buffer GetVisibleCommandBuffer() const { return m_visibleCommands; }
+	[[nodiscard]] vk::DeviceSize GetVisibleCommandOffset(u32 _imageIndex, u32 _draw) const;
+	[[nodiscard]] vk::Buffer GetCountBuffer() const { return m_counters; }
+	[[nodiscard]] vk::DeviceSize GetCountOffset(u32 _imageIndex, u32 _group) const { return m_counterRegionSize * _imageIndex + sizeof(u32) * _group; }
+
+	// of the last culled frame known to be done on the gpu
+	[[nodiscard]] const Stats& GetStats() const { return m_stats; }
+	// reads back the stats and timings of the regions that were not culled again since their frame, the compute queue has to be idle
+	void ReadBackAll();
+	// the gpu time of every cull read back since the last call, oldest first, empty when the compute queue has no timestamps
+	[[nodiscard]] std::vector<GpuProfiler::FrameSample> TakeCullSamples();
+
+private:
+	void CreatePipelines(vk::PipelineCache _pipelineCache);
+	void CreateDepthPyramid(vk::Extent2D _extent);
+	void CreateDescriptorSets(const DrawBatcher& _batcher, const std::vector<vk::ImageView>& _depthViews);
+	void ReadBack(u32 _imageIndex);
+
+	vk::Device m_device;
+	vk::PhysicalDeviceLimits m_limits;
+	std::vector<u32> m_concurrentFamilies;
+
+	u32 m_computeFamily;
+	vk::Queue m_computeQueue;
+	vk::CommandPool m_commandPool;
+	// [image]
+	std::vector<vk::CommandBuffer> m_commandBuffers;
+
+	vk::Semaphore m_cullSemaphore;
+	vk::Semaphore m_pyramidSemaphore;
+	u64 m_frameValue = 0;
+	// the frame whose depth is in the pyramid, 0 when it was never built
+	u64 m_pyramidFrameValue = 0;
+	// the camera the pyramid was seen from
+	mat4 m_previousViewProj = mat4(1.0f);
+
+	vk::DescriptorSetLayout m_cullSetLayout;
+	vk::PipelineLayout m_cullPipelineLayout;
+	vk::Pipeline m_cullPipeline;
+
+	vk::DescriptorSetLayout m_pyramidSetLayout;
+	vk::PipelineLayout m_pyramidPipelineLayout;
+	vk::Pipeline m_pyramidPipeline;
+
+	// max reduction, one linear fetch gives the farthest depth of the 2x2 texels around it
+	vk::Sampler m_reductionSampler;
+
+	vk::DescriptorPool m_descriptorPool;
+	// [image]
+	std::vector<vk::DescriptorSet> m_cullSets;
+	// [image], the depth of the image into the first level
+	std::vector<vk::DescriptorSet> m_pyramidSetsFromDepth;
+	// [level - 1], a level into the next one
+	std::vector<vk::DescriptorSet> m_pyramidSetsFromLevel;
+
+	// r32f, every level stays in eGeneral
+	vk::Image m_pyramid;
+	vma::Allocation m_pyramidMemory;
+	vk::ImageView m_pyramidView;
+	std::vector<vk::ImageView> m_pyramidLevelViews;
+	vk::Extent2D m_pyramidExtent;
+
+	u32 m_regionCount = 0;
+
+	// gpu only, [image]: compacted commands
+	vk::Buffer m_visibleCommands;
+	vma::Allocation m_visibleCommandsMemory;
+	vk::DeviceSize m_visibleRegionSize = 0;
+
+	// gpu only, [image]: one draw count per group then the stats
+	vk::Buffer m_counters;
+	vma::Allocation m_countersMemory;
+	vk::DeviceSize m_counterRegionSize = 0;
+
+	// host visible, [image]: the uniforms of the cull then the stats copied back
+	vk::Buffer m_hostData;
+	vma::Allocation m_hostDataMemory;
+	u8* m_hostDataMapped = nullptr;
+	vk::DeviceSize m_hostRegionSize = 0;
+	// [image], the region holds the stats of a frame that was culled and not read back yet
+	std::vector<bool> m_hasStats;
+	// [image], the frame given to Cull
+	std::vector<u64> m_regionFrames;
+
+	Stats m_stats;
+
+	// the cull is timed on its own queue, the timestamps of two queues can't be compared
+	bool m_hasTimestamps = false;
+	// ns per tick
+	double m_timestampPeriod = 1.0;
+	u64 m_timestampMask = ~0ull;
+	// [image]: begin and end of the cull
+	vk::QueryPool m_timestampPool;
+	std::vector<GpuProfiler::FrameSample> m_cullSamples;
+};
@@ -0,0 +1,310 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+
+#include "imgui/imgui.h"
+#include "json/json.hpp"
+
+GpuProfiler::GpuProfiler(vk::Device _device, const vk::PhysicalDeviceProperties& _properties, u32 _timestampValidBits, u32 _slotCount)
+	: m_device(_device)
+{
+	// the graphics queue is the only one profiled, its family tells if it can write timestamps at all
+	m_isSupported = _timestampValidBits > 0 && _properties.limits.timestampPeriod > 0.0f;
+	m_timestampPeriod = _properties.limits.timestampPeriod;
+	m_timestampMask = _timestampValidBits >= 64 ? ~0ull : (1ull << _timestampValidBits) - 1;
+
+	if (!m_isSupported)
+	{
+		std::cout << "[GpuProfiler] timestamps are not supported on the graphics queue, gpu timings disabled" << std::endl;
+		return;
+	}
+
+	vk::QueryPoolCreateInfo info;
+	info.queryType = vk::QueryType::eTimestamp;
+	info.queryCount = MAX_SCOPES * 2;
+
+	m_queryPools.resize(_slotCount);
+	m_isSlotUsed.assign(_slotCount, false);
+	m_slotFrames.assign(_slotCount, 0);
+
+	for (auto& pool : m_queryPools)
+	{
+		pool = m_device.createQueryPool(info);
+	}
+
+	m_scopes.reserve(MAX_SCOPES);
+
+	m_frameScope = RegisterScope("Frame");
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (const auto& pool : m_queryPools)
+	{
+		m_device.destroyQueryPool(pool);
+	}
+}
+
+u32 GpuProfiler::RegisterScope(const std::string& _name)
+{
+	for (u32 i = 0; i < m_scopes.size(); ++i)
+	{
+		if (m_scopes[i].name == _name)
+			return i;
+	}
+
+	// the query pools are already created, a scope past them is never written
+	if (m_scopes.size() >= MAX_SCOPES)
+	{
+		std::cout << "[GpuProfiler] more than " << MAX_SCOPES << " scopes, " << _name << " is not timed" << std::endl;
+		return INVALID_SCOPE;
+	}
+
+	Scope scope;
+	scope.name = _name;
+	scope.history.assign(HISTORY_SIZE, 0.0f);
+
+	m_scopes.emplace_back(std::move(scope));
+
+	return static_cast<u32>(m_scopes.size() - 1);
+}
+
+void GpuProfiler::BeginFrame(u32 _slot, vk::CommandBuffer _cmd, u64 _frame)
+{
+	if (!m_isSupported)
+		return;
+
+	m_currentSlot = _slot;
+
+	ReadBack(_slot);
+
+	_cmd.resetQueryPool(m_queryPools[_slot], 0, MAX_SCOPES * 2);
+	m_isSlotUsed[_slot] = true;
+	m_slotFrames[_slot] = _frame;
+
+	Begin(_cmd, m_frameScope);
+}
+
+void GpuProfiler::EndFrame(vk::CommandBuffer _cmd) const
+{
+	End(_cmd, m_frameScope);
+}
+
+void GpuProfiler::ReadBackAll()
+{
+	if (!m_isSupported)
+		return;
+
+	// oldest frame first, like they would have been read back by BeginFrame
+	std::vector<u32> slots;
+
+	for (u32 i = 0; i < m_isSlotUsed.size(); ++i)
+	{
+		if (m_isSlotUsed[i])
+			slots.emplace_back(i);
+	}
+
+	std::sort(slots.begin(), slots.end(), [this](u32 _a, u32 _b) { return m_slotFrames[_a] < m_slotFrames[_b]; });
+
+	for (const u32 slot : slots)
+	{
+		ReadBack(slot);
+		m_isSlotUsed[slot] = false;
+	}
+}
+
+std::vector<GpuProfiler::FrameSample> GpuProfiler::TakeFrameSamples()
+{
+	std::vector<FrameSample> samples;
+	samples.swap(m_frameSamples);
+
+	return samples;
+}
+
+void GpuProfiler::ReadBack(u32 _slot)
+{
+	const vk::QueryPool pool = m_queryPools[_slot];
+
+	if (m_isSlotUsed[_slot] && !m_scopes.empty() && !m_isPaused)
+	{
+		// value + availability for each query, nothing waits: a query that is not written (or not done) reads as unavailable
+		const u32 queryCount = static_cast<u32>(m_scopes.size()) * 2;
+		std::vector<u64> results(queryCount * 2);
+
+		const auto res = m_device.getQueryPoolResults(pool, 0, queryCount, results.size() * sizeof(u64), results.data()
+			, sizeof(u64) * 2, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+		assert(res == vk::Result::eSuccess || res == vk::Result::eNotReady);
+
+		for (u32 i = 0; i < m_scopes.size(); ++i)
+		{
+			const u64* begin = &results[i * 4];
+			const u64* end = &results[i * 4 + 2];
+
+			if (begin[1] == 0 || end[1] == 0)
+				continue;
+
+			const u64 ticks = ((end[0] & m_timestampMask) - (begin[0] & m_timestampMask)) & m_timestampMask;
+			const float ms = static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod / 1000000.0);
+
+			Scope& scope = m_scopes[i];
+			scope.lastMs = ms;
+			scope.history[scope.historyHead] = ms;
+			scope.historyHead = (scope.historyHead + 1) % HISTORY_SIZE;
+			scope.sampleCount = std::min(scope.sampleCount + 1, HISTORY_SIZE);
+
+			if (i == m_frameScope)
+			{
+				m_frameSamples.push_back({ m_slotFrames[_slot], ms });
+			}
+		}
+	}
+}
+
+void GpuProfiler::Begin(vk::CommandBuffer _cmd, u32 _scope) const
+{
+	if (!m_isSupported || _scope == INVALID_SCOPE)
+		return;
+
+	_cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPools[m_currentSlot], _scope * 2);
+}
+
+void GpuProfiler::End(vk::CommandBuffer _cmd, u32 _scope) const
+{
+	if (!m_isSupported || _scope == INVALID_SCOPE)
+		return;
+
+	_cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPools[m_currentSlot], _scope * 2 + 1);
+}
+
+std::vector<float> GpuProfiler::GetOrderedHistory(const Scope& _scope) const
+{
+	std::vector<float> ordered;
+	ordered.reserve(_scope.sampleCount);
+
+	// the oldest sample is at the head once the ring has wrapped
+	const u32 first = _scope.sampleCount < HISTORY_SIZE ? 0 : _scope.historyHead;
+
+	for (u32 i = 0; i < _scope.sampleCount; ++i)
+	{
+		ordered.emplace_back(_scope.history[(first + i) % HISTORY_SIZE]);
+	}
+
+	return ordered;
+}
+
+void GpuProfiler::DrawGUI()
+{
+	ImGui::Begin("GPU Profiler");
+
+	if (!m_isSupported)
+	{
+		ImGui::Text("Timestamps are not supported on this queue");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Checkbox("Pause", &m_isPaused);
+	ImGui::SameLine();
+
+	if (ImGui::Button("Export gpu_timings.json"))
+	{
+		ExportJson("gpu_timings.json");
+	}
+
+	if (ImGui::BeginTable("gpuScopes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("Last (ms)");
+		ImGui::TableSetupColumn("Avg (ms)");
+		ImGui::TableSetupColumn("Max (ms)");
+		ImGui::TableSetupColumn("History");
+		ImGui::TableHeadersRow();
+
+		for (const auto& scope : m_scopes)
+		{
+			// registered but never written, the batches of the threads that are not used for example
+			if (scope.sampleCount == 0)
+				continue;
+
+			const std::vector<float> history = GetOrderedHistory(scope);
+
+			float total = 0.0f;
+			float maxMs = 0.0f;
+
+			for (const float ms : history)
+			{
+				total += ms;
+				maxMs = std::max(maxMs, ms);
+			}
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(scope.name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", scope.lastMs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", total / static_cast<float>(history.size()));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", maxMs);
+			ImGui::TableNextColumn();
+			ImGui::PushID(scope.name.c_str());
+			ImGui::PlotLines("", history.data(), static_cast<int>(history.size()), 0, nullptr, 0.0f, maxMs * 1.1f, ImVec2(200.0f, 30.0f));
+			ImGui::PopID();
+		}
+
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
+
+void GpuProfiler::ExportJson(const std::string& _path) const
+{
+	nlohmann::json j;
+	j["timestampPeriodNs"] = m_timestampPeriod;
+	j["scopes"] = nlohmann::json::array();
+
+	for (const auto& scope : m_scopes)
+	{
+		if (scope.sampleCount == 0)
+			continue;
+
+		std::vector<float> samples = GetOrderedHistory(scope);
+
+		nlohmann::json jsonScope;
+		jsonScope["name"] = scope.name;
+		jsonScope["samplesMs"] = samples;
+
+		std::sort(samples.begin(), samples.end());
+
+		float total = 0.0f;
+		for (const float ms : samples)
+		{
+			total += ms;
+		}
+
+		jsonScope["avgMs"] = total / static_cast<float>(samples.size());
+		jsonScope["minMs"] = samples.front();
+		jsonScope["maxMs"] = samples.back();
+		jsonScope["p50Ms"] = samples[samples.size() / 2];
+		jsonScope["p95Ms"] = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+
+		j["scopes"].emplace_back(std::move(jsonScope));
+	}
+
+	std::ofstream file(_path, std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cout << "[GpuProfiler] could not write " << _path << std::endl;
+		return;
+	}
+
+	file << j.dump(2);
+
+	std::cout << "[GpuProfiler] timings written to " << _path << std::endl;
+}
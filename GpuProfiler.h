@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+using namespace glm;
+
+// Timestamp queries around passes and draw batches.
+// Scopes are registered once and keep the same queries for the whole run, so they can be written
+// by command buffers that are recorded once and replayed (the cached geometry secondaries).
+// There is one query pool per frame slot, the results of a slot are read back the next time it is begun,
+// by then the gpu is done with it and reading never stalls. Queries that were not written are just skipped.
+// The "Frame" scope spans the whole command buffer, from BeginFrame to EndFrame.
+class GpuProfiler
+{
+public:
+	// the duration of the "Frame" scope of a frame, with the _frame given to BeginFrame
+	struct FrameSample
+	{
+		u64 frame;
+		float ms;
+	};
+
+	GpuProfiler(vk::Device _device, const vk::PhysicalDeviceProperties& _properties, u32 _timestampValidBits, u32 _slotCount);
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler& other) = delete;
+	GpuProfiler(GpuProfiler&& other) = delete;
+	GpuProfiler& operator=(const GpuProfiler& other) = delete;
+	GpuProfiler& operator=(GpuProfiler&& other) = delete;
+
+	// returns the id to pass to Begin/End, registering the same name twice returns the same id
+	// INVALID_SCOPE past MAX_SCOPES, Begin/End ignore it
+	u32 RegisterScope(const std::string& _name);
+
+	// reads back the previous results of the slot and resets its queries, must be recorded outside of a render pass
+	// before any Begin/End of the frame, _slot has to be done on the gpu (its fence waited)
+	// the results of the slot are tagged with _frame until it is begun again
+	void BeginFrame(u32 _slot, vk::CommandBuffer _cmd, u64 _frame);
+	// last command of the frame, closes the "Frame" scope
+	void EndFrame(vk::CommandBuffer _cmd) const;
+	// reads back the slots that were not begun again since their frame, the device has to be idle
+	void ReadBackAll();
+	// every frame read back since the last call, oldest first
+	[[nodiscard]] std::vector<FrameSample> TakeFrameSamples();
+
+	// every registered scope can be written at most once per frame
+	void Begin(vk::CommandBuffer _cmd, u32 _scope) const;
+	void End(vk::CommandBuffer _cmd, u32 _scope) const;
+
+	void DrawGUI();
+	// every sample still in the history, plus a summary per scope
+	void ExportJson(const std::string& _path) const;
+
+	[[nodiscard]] bool IsSupported() const { return m_isSupported; }
+
+	static constexpr u32 MAX_SCOPES = 64;
+	static constexpr u32 INVALID_SCOPE = ~0u;
+	static constexpr u32 HISTORY_SIZE = 240;
+
+private:
+	struct Scope
+	{
+		std::string name;
+
+		// ring buffer of the last HISTORY_SIZE durations, in ms
+		std::vector<float> history;
+		u32 historyHead = 0;
+		u32 sampleCount = 0;
+
+		float lastMs = 0.0f;
+	};
+
+	void ReadBack(u32 _slot);
+	// history in chronological order
+	[[nodiscard]] std::vector<float> GetOrderedHistory(const Scope& _scope) const;
+
+	vk::Device m_device;
+
+	bool m_isSupported = false;
+	// ns per tick
+	double m_timestampPeriod = 1.0;
+	u64 m_timestampMask = ~0ull;
+
+	std::vector<vk::QueryPool> m_queryPools;
+	// false until the slot has been submitted once, and once it has been read back by ReadBackAll
+	std::vector<bool> m_isSlotUsed;
+	// the frame each slot was last begun for
+	std::vector<u64> m_slotFrames;
+
+	u32 m_currentSlot = 0;
+
+	std::vector<Scope> m_scopes;
+	u32 m_frameScope = INVALID_SCOPE;
+	std::vector<FrameSample> m_frameSamples;
+
+	bool m_isPaused = false;
+};
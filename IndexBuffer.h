@@ -3,34 +3,56 @@
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.hpp>
 
+#include "GeometryArena.h"
 #include "systems/VulkanContext.h"
 
+// a range of the index buffer of the geometry arena
 class IndexBuffer
 {
 public:
 	IndexBuffer(std::vector<u16>&& _indices)
-		: m_size(_indices.size()),
-	      m_buffer(nullptr),
-	      m_memory(nullptr)
+		: m_size(_indices.size())
 	{
-		const auto [buf, mem] = VulkanContext::GraphicInstance->CreateIndexBuffer(_indices);
+		AllocateInArena(_indices.data());
+	}
 
-		m_buffer = buf;
-		m_memory = mem;
+	// uploaded straight from _indices, nothing is kept on the cpu
+	IndexBuffer(const u16* _indices, u32 _count)
+		: m_size(_count)
+	{
+		AllocateInArena(_indices);
 	}
 
 	~IndexBuffer()
 	{
-		VulkanContext::GraphicInstance->GetLogicalDevice().destroyBuffer(m_buffer);
-		VulkanContext::GraphicInstance->GetLogicalDevice().freeMemory(m_memory);
+		VulkanContext::GraphicInstance->GetGeometryArena().FreeIndices(m_range);
 	}
 
-	[[nodiscard]] const vk::Buffer& GetBuffer() const { return m_buffer; }
+	IndexBuffer(const IndexBuffer& other) = delete;
+	IndexBuffer(IndexBuffer&& other) = delete;
+	IndexBuffer& operator=(const IndexBuffer& other) = delete;
+	IndexBuffer& operator=(IndexBuffer&& other) = delete;
+
+	// shared with every other mesh
+	[[nodiscard]] vk::Buffer GetBuffer() const { return VulkanContext::GraphicInstance->GetGeometryArena().GetIndexBuffer(); }
+
+	// firstIndex of the draws, to add to the lod ones
+	[[nodiscard]] u32 GetFirstIndex() const { return static_cast<u32>(m_range.offset / sizeof(u16)); }
 
 	[[nodiscard]] u32 GetSize() const { return m_size; }
+	// false when the arena was full, the range is empty and must not be drawn
+	[[nodiscard]] bool IsAllocated() const { return m_isAllocated; }
 private:
+	void AllocateInArena(const u16* _indices)
+	{
+		const vk::DeviceSize size = static_cast<vk::DeviceSize>(m_size) * sizeof(u16);
+
+		//the arena logs it, the owner checks IsAllocated()
+		m_isAllocated = VulkanContext::GraphicInstance->GetGeometryArena().AllocateIndices(size
+			, [_indices, size](void* _dst) { memcpy(_dst, _indices, size); }, m_range);
+	}
+
 	u32 m_size;
-	vk::Buffer m_buffer;
-	vk::DeviceMemory m_memory;
+	GeometryArena::Range m_range;
+	bool m_isAllocated = false;
 };
-
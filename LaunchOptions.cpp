@@ -0,0 +1,74 @@
+#include "LaunchOptions.h"
+
+#include <cstring>
+#include <iostream>
+
+static constexpr u32 DEFAULT_HEADLESS_FRAME_COUNT = 1000;
+
+LaunchOptions LaunchOptions::Parse(int _argc, char** _argv)
+{
+	LaunchOptions options;
+
+	for (int i = 1; i < _argc; ++i)
+	{
+		const char* arg = _argv[i];
+		const bool hasValue = i + 1 < _argc;
+
+		if (strcmp(arg, "--headless") == 0)
+		{
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue)
+		{
+			options.frameCount = static_cast<u32>(std::stoul(_argv[++i]));
+		}
+		else if (strcmp(arg, "--width") == 0 && hasValue)
+		{
+			options.width = static_cast<u32>(std::stoul(_argv[++i]));
+		}
+		else if (strcmp(arg, "--height") == 0 && hasValue)
+		{
+			options.height = static_cast<u32>(std::stoul(_argv[++i]));
+		}
+		else if (strcmp(arg, "--timings") == 0 && hasValue)
+		{
+			options.timingsPath = _argv[++i];
+		}
+		else if (strcmp(arg, "--gpu-timings") == 0 && hasValue)
+		{
+			options.gpuTimingsPath = _argv[++i];
+		}
+		else if (strcmp(arg, "--trace") == 0 && hasValue)
+		{
+			options.tracePath = _argv[++i];
+		}
+		else if (strcmp(arg, "--benchmark") == 0 && hasValue)
+		{
+			options.benchmarkPath = _argv[++i];
+		}
+		else if (strcmp(arg, "--benchmark-out") == 0 && hasValue)
+		{
+			options.benchmarkOutPath = _argv[++i];
+		}
+		else if (strcmp(arg, "--cook") == 0 && hasValue)
+		{
+			options.cookPath = _argv[++i];
+		}
+		else if (strcmp(arg, "--cull-bench") == 0)
+		{
+			options.cullBenchmark = true;
+		}
+		else
+		{
+			std::cout << "[Options] unknown or incomplete argument " << arg << ", ignored" << std::endl;
+		}
+	}
+
+	// there is nobody to close the window
+	if (options.headless && options.frameCount == 0)
+	{
+		options.frameCount = DEFAULT_HEADLESS_FRAME_COUNT;
+	}
+
+	return options;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// command line of the executable
+//   --headless             render offscreen, without window, surface or swapchain
+//   --frames <n>           stop after n frames (headless defaults to 1000)
+//   --width <w>            size of the window or of the offscreen targets
+//   --height <h>
+//   --timings <path>       writes the cpu time of every frame there, as csv
+//   --gpu-timings <path>   writes the gpu profiler scopes there at exit, as json
+//   --trace <path>         writes the cpu zones there at exit, as a chrome trace
+//   --benchmark <path>     replays the camera path of a benchmark file (see Benchmark.h), overrides --frames
+//   --benchmark-out <path> where the benchmark results go, benchmark_results.json by default
+//   --cook <meshdesc>      cooks the mesh of a mesh descriptor and exits, without starting the renderer
+//   --cull-bench           times the cpu frustum culling of 100k objects with every instruction set and exits
+struct LaunchOptions
+{
+	bool headless = false;
+	u32 frameCount = 0; // 0 runs until the window is closed
+	u32 width = 1280;
+	u32 height = 720;
+	std::string timingsPath;
+	std::string gpuTimingsPath;
+	std::string tracePath;
+	std::string benchmarkPath;
+	std::string benchmarkOutPath = "benchmark_results.json";
+	std::string cookPath;
+	bool cullBenchmark = false;
+
+	static LaunchOptions Parse(int _argc, char** _argv);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// Read only view of a whole file, mapped in memory instead of read.
+// The pages are only loaded when touched, and the data can be handed to the upload path as is.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile(MappedFile&& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	MappedFile& operator=(MappedFile&& other) = delete;
+
+	// false if the file does not exist or is empty
+	bool Open(const std::string& _path);
+	void Close();
+
+	[[nodiscard]] const u8* GetData() const { return m_data; }
+	[[nodiscard]] u64 GetSize() const { return m_size; }
+	[[nodiscard]] bool IsOpen() const { return m_data != nullptr; }
+
+private:
+	const u8* m_data = nullptr;
+	u64 m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
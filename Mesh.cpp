@@ -1,11 +1,18 @@
 #include "Mesh.h"
 
+#include <cfloat>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <unordered_map>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
+#include <glm/gtc/packing.hpp>
 
+#include "CpuProfiler.h"
+#include "MeshOptimizer.h"
 #include "Texture2D.h"
+#include "ThreadPool.h"
 #include "imgui/imgui.h"
 #include "json/json.hpp"
 
@@ -24,31 +31,353 @@ std::string readFile2(const std::string& fileName)
 
 Mesh::Mesh(const char* _path) : path(_path)
 {
+    PROFILE_ZONE("Mesh import");
+
     nlohmann::json j = nlohmann::json::parse(readFile2(_path));
 
     const std::string& shaderPath = j["shaderPath"];
     const std::string& meshPath = j["meshDataPath"];
 
+    m_vertexFormat = ParseVertexFormat(j.value("vertexFormat", "full"));
+    const u32 vertexStride = MeshVertexDecl::GetStride(m_vertexFormat);
+
     const auto index = meshPath.find_last_of('/') + 1; // +1 to include the /
     pathCleaned = meshPath.substr(0, index);
 
-    const std::ifstream file(meshPath);
+    CookedMesh::SourceStamp stamp;
 
-    if (!file.bad())
+    if (CookedMesh::GetSourceStamp(meshPath, stamp))
     {
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(meshPath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_CalcTangentSpace);
+        const std::string cookedPath = CookedMesh::GetCookedPath(meshPath, GetCookVariant(m_vertexFormat));
 
-        subMeshes.reserve(scene->mNumMeshes);
+        //either points in the mapped cook, or in the imported data when the cook is stale
+        CookedMesh cooked;
+        std::vector<ImportedSubMesh> imported;
+        std::vector<CookedSubMesh> views;
 
-        RecursivelyLoadNode(scene->mRootNode, scene);
+        ThreadPool& threadPool = VulkanContext::GraphicInstance->GetThreadPool();
 
-        importer.FreeScene();
+        if (cooked.Open(cookedPath, stamp, vertexStride))
+        {
+            views = cooked.GetSubMeshes();
+        }
+        else
+        {
+            Import(meshPath, m_vertexFormat, threadPool, imported);
+            views = ToCooked(imported, m_vertexFormat);
+
+            //uploaded from the mapped cook like on the next runs, the imported arrays are freed before the textures are decoded
+            //a failed write only costs the import next time, the imported arrays are uploaded instead
+            if (CookedMesh::Write(cookedPath, stamp, vertexStride, views) && cooked.Open(cookedPath, stamp, vertexStride))
+            {
+                views = cooked.GetSubMeshes();
+
+                imported.clear();
+                imported.shrink_to_fit();
+            }
+        }
+
+        //the submeshes share most of their textures, each file is decoded once
+        std::vector<std::string> texturePaths;
+        std::unordered_map<std::string, u32> textureIndices;
+
+        for (const auto& view : views)
+        {
+            for (const auto& texturePath : view.texturePaths)
+            {
+                if (textureIndices.emplace(texturePath, static_cast<u32>(texturePaths.size())).second)
+                {
+                    texturePaths.emplace_back(texturePath);
+                }
+            }
+        }
+
+        std::vector<Texture2D::DecodedImage> decoded(texturePaths.size());
+
+        threadPool.ParallelFor(static_cast<u32>(texturePaths.size()), [&](u32 _index)
+        {
+            decoded[_index] = Texture2D::Decode(texturePaths[_index].c_str());
+        });
+
+        //everything below only creates resources and queues copies, they are sent in one go by the caller
+        subMeshes.reserve(views.size());
+        m_cullingBounds.Reserve(static_cast<u32>(views.size()));
+
+        //models with hundreds of submeshes only have a few materials, the submeshes sharing their textures share a slot
+        std::unordered_map<std::string, u32> materialIndices;
+        bool isArenaFull = false;
+
+        for (const auto& view : views)
+        {
+            std::vector<Texture2D> textures(view.texturePaths.size());
+
+            for (u32 i = 0; i < textures.size(); ++i)
+            {
+                textures[i].CreateFrom(view.texturePaths[i].c_str(), decoded[textureIndices[view.texturePaths[i]]], vk::ImageLayout::eGeneral);
+            }
+
+            subMeshes.emplace_back(new SubMesh(view, m_vertexFormat, std::move(textures)));
+            m_cullingBounds.Add(view.boundsMin, view.boundsMax, view.boundsRadius);
+
+            //only the first texture is sampled for now, it is the material
+            const std::string materialKey = view.texturePaths.empty() ? std::string() : view.texturePaths[0];
+            subMeshes.back()->materialIndex = materialIndices.emplace(materialKey, static_cast<u32>(materialIndices.size())).first->second;
+
+            //a submesh without its range would draw whatever sits at the start of the arena
+            if (!subMeshes.back()->vertices.IsAllocated() || !subMeshes.back()->indices.IsAllocated())
+            {
+                isArenaFull = true;
+                break;
+            }
+        }
+
+        for (auto& image : decoded)
+        {
+            Texture2D::FreeDecoded(image);
+        }
+
+        m_materialCount = static_cast<u32>(materialIndices.size());
+
+        //nothing of it is drawn rather than a part of it, the ranges already taken go back to the arena
+        if (isArenaFull)
+        {
+            std::cout << "[Mesh] the geometry arena is full, " << meshPath << " is not loaded" << std::endl;
+
+            subMeshes.clear();
+            m_cullingBounds.Clear();
+            m_materialCount = 0;
+        }
+    }
+    else
+    {
+        std::cout << "[Mesh] could not find " << meshPath << std::endl;
     }
 
     m_shader = std::make_unique<Shader>(VulkanContext::GraphicInstance->GetLogicalDevice(), shaderPath.c_str());
 }
 
+bool Mesh::Cook(const char* _descPath)
+{
+    PROFILE_ZONE("Mesh cook");
+
+    nlohmann::json j = nlohmann::json::parse(readFile2(_descPath));
+
+    const std::string& meshPath = j["meshDataPath"];
+    const MeshVertexDecl::Format format = ParseVertexFormat(j.value("vertexFormat", "full"));
+
+    CookedMesh::SourceStamp stamp;
+
+    if (!CookedMesh::GetSourceStamp(meshPath, stamp))
+    {
+        std::cout << "[Mesh] could not find " << meshPath << std::endl;
+        return false;
+    }
+
+    std::vector<ImportedSubMesh> imported;
+    ThreadPool threadPool(ThreadPool::GetHardwareThreadCount() - 1);
+
+    if (!Import(meshPath, format, threadPool, imported))
+        return false;
+
+    return CookedMesh::Write(CookedMesh::GetCookedPath(meshPath, GetCookVariant(format)), stamp, MeshVertexDecl::GetStride(format), ToCooked(imported, format));
+}
+
+bool Mesh::Import(const std::string& _meshPath, MeshVertexDecl::Format _format, ThreadPool& _threadPool, std::vector<ImportedSubMesh>& _subMeshes)
+{
+    const auto index = _meshPath.find_last_of('/') + 1; // +1 to include the /
+    const std::string directory = _meshPath.substr(0, index);
+
+    Assimp::Importer importer;
+    const aiScene* scene;
+
+    {
+        PROFILE_ZONE("Assimp ReadFile");
+        //the vertices have to be shared between triangles for the post transform cache to hit at all
+        scene = importer.ReadFile(_meshPath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_CalcTangentSpace);
+    }
+
+    if (!scene)
+    {
+        std::cout << "[Mesh] could not import " << _meshPath << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    //the walk is cheap, it only fixes the order of the submeshes
+    std::vector<const aiMesh*> meshes;
+    meshes.reserve(scene->mNumMeshes);
+
+    RecursivelyLoadNode(scene->mRootNode, scene, meshes);
+
+    //every submesh is converted in its own slot, the scene order is kept without any sorting
+    _subMeshes.resize(meshes.size());
+
+    std::vector<MeshOptimizer::Stats> statsBefore(meshes.size());
+    std::vector<MeshOptimizer::Stats> statsAfter(meshes.size());
+
+    _threadPool.ParallelFor(static_cast<u32>(meshes.size()), [&](u32 _index)
+    {
+        PROFILE_ZONE("Mesh::LoadMeshFrom");
+        ImportedSubMesh& subMesh = _subMeshes[_index];
+
+        subMesh = LoadMeshFrom(*meshes[_index], scene, directory);
+
+        //only the order changes, the bounds stay valid
+        MeshOptimizer::Optimize(subMesh.indices, subMesh.vertices, statsBefore[_index], statsAfter[_index]);
+
+        //built on the final order, the meshlets follow the index buffer
+        MeshletBuilder::Build(subMesh.indices, reinterpret_cast<const u8*>(subMesh.vertices.data())
+            , static_cast<u32>(subMesh.vertices.size()), sizeof(MeshVertexDecl::Decl), subMesh.meshlets);
+
+        //appended after lod 0, the meshlets stay valid
+        MeshSimplifier::BuildLods(subMesh.indices, reinterpret_cast<const u8*>(subMesh.vertices.data())
+            , static_cast<u32>(subMesh.vertices.size()), sizeof(MeshVertexDecl::Decl), subMesh.lods);
+
+        //last, everything above works on the full precision vertices
+        if (_format == MeshVertexDecl::Format::Packed)
+        {
+            subMesh.packedVertices = PackVertices(subMesh.vertices, subMesh.boundsMin, subMesh.boundsMax);
+
+            //nothing reads the full precision ones anymore
+            subMesh.vertices.clear();
+            subMesh.vertices.shrink_to_fit();
+        }
+    });
+
+    importer.FreeScene();
+
+    MeshOptimizer::Stats totalBefore;
+    MeshOptimizer::Stats totalAfter;
+    size_t meshletCount = 0;
+    size_t lodCount = 0;
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        totalBefore += statsBefore[i];
+        totalAfter += statsAfter[i];
+        meshletCount += _subMeshes[i].meshlets.meshlets.size();
+        lodCount += _subMeshes[i].lods.size();
+    }
+
+    std::cout << "[MeshOptimizer] " << _meshPath << ": ACMR " << totalBefore.GetACMR() << " -> " << totalAfter.GetACMR()
+        << ", ATVR " << totalBefore.GetATVR() << " -> " << totalAfter.GetATVR()
+        << " over " << meshes.size() << " submeshes" << std::endl;
+    std::cout << "[Meshlet] " << meshletCount << " meshlets, " << (meshletCount ? totalAfter.triangleCount / meshletCount : 0) << " triangles each on average" << std::endl;
+    std::cout << "[MeshSimplifier] " << lodCount << " lods over " << meshes.size() << " submeshes" << std::endl;
+
+    return true;
+}
+
+std::vector<CookedSubMesh> Mesh::ToCooked(const std::vector<ImportedSubMesh>& _imported, MeshVertexDecl::Format _format)
+{
+    std::vector<CookedSubMesh> cooked(_imported.size());
+
+    for (u32 i = 0; i < _imported.size(); ++i)
+    {
+        //the full precision vertices of a packed submesh are freed after the packing, only the packed ones are left
+        if (_format == MeshVertexDecl::Format::Packed)
+        {
+            cooked[i].vertices = _imported[i].packedVertices.data();
+            cooked[i].vertexCount = static_cast<u32>(_imported[i].packedVertices.size());
+        }
+        else
+        {
+            cooked[i].vertices = _imported[i].vertices.data();
+            cooked[i].vertexCount = static_cast<u32>(_imported[i].vertices.size());
+        }
+        cooked[i].indices = _imported[i].indices.data();
+        cooked[i].indexCount = static_cast<u32>(_imported[i].indices.size());
+        cooked[i].lods = _imported[i].lods.data();
+        cooked[i].lodCount = static_cast<u32>(_imported[i].lods.size());
+        cooked[i].meshlets = _imported[i].meshlets.meshlets.data();
+        cooked[i].meshletCount = static_cast<u32>(_imported[i].meshlets.meshlets.size());
+        cooked[i].meshletVertices = _imported[i].meshlets.vertices.data();
+        cooked[i].meshletVertexCount = static_cast<u32>(_imported[i].meshlets.vertices.size());
+        cooked[i].meshletTriangles = _imported[i].meshlets.triangles.data();
+        cooked[i].meshletTriangleCount = static_cast<u32>(_imported[i].meshlets.triangles.size() / 3);
+        cooked[i].texturePaths = _imported[i].texturePaths;
+        cooked[i].boundsMin = _imported[i].boundsMin;
+        cooked[i].boundsMax = _imported[i].boundsMax;
+        cooked[i].boundsRadius = _imported[i].boundsRadius;
+    }
+
+    return cooked;
+}
+
+MeshVertexDecl::Format Mesh::ParseVertexFormat(const std::string& _name)
+{
+    if (_name == "packed")
+        return MeshVertexDecl::Format::Packed;
+
+    if (_name != "full")
+    {
+        std::cout << "[Mesh] unknown vertex format " << _name << ", full is used" << std::endl;
+    }
+
+    return MeshVertexDecl::Format::Full;
+}
+
+std::string Mesh::GetCookVariant(MeshVertexDecl::Format _format)
+{
+    return _format == MeshVertexDecl::Format::Packed ? ".packed" : "";
+}
+
+//the unit sphere folded on an octahedron then unfolded on a square, two values in [-1;1]
+static vec2 EncodeOctahedral(vec3 _direction)
+{
+    const float sum = abs(_direction.x) + abs(_direction.y) + abs(_direction.z);
+
+    if (sum == 0.0f)
+        return vec2(0.0f);
+
+    vec2 encoded = vec2(_direction.x, _direction.y) / sum;
+
+    //the lower half is folded over the diagonals
+    if (_direction.z < 0.0f)
+    {
+        const vec2 signs(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        encoded = (1.0f - abs(vec2(encoded.y, encoded.x))) * signs;
+    }
+
+    return encoded;
+}
+
+std::vector<MeshVertexDecl::PackedDecl> Mesh::PackVertices(const std::vector<MeshVertexDecl::Decl>& _vertices, vec3 _boundsMin, vec3 _boundsMax)
+{
+    std::vector<MeshVertexDecl::PackedDecl> packed(_vertices.size());
+
+    const vec3 extent = _boundsMax - _boundsMin;
+    //a flat submesh has no extent on one axis, everything is at its min there
+    const vec3 inverseExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    for (size_t i = 0; i < _vertices.size(); ++i)
+    {
+        const MeshVertexDecl::Decl& vertex = _vertices[i];
+        MeshVertexDecl::PackedDecl& out = packed[i];
+
+        const vec3 position = clamp((vertex.pos - _boundsMin) * inverseExtent, 0.0f, 1.0f);
+
+        for (u32 c = 0; c < 3; ++c)
+        {
+            out.pos[c] = static_cast<u16>(std::round(position[c] * 65535.0f));
+        }
+
+        //the shader rebuilds the bitangent as cross(normal, tangent) * handedness
+        out.pos[3] = dot(cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f ? 0 : 65535;
+
+        const vec2 normal = EncodeOctahedral(vertex.normal);
+        const vec2 tangent = EncodeOctahedral(vertex.tangent);
+
+        for (u32 c = 0; c < 2; ++c)
+        {
+            out.normal[c] = static_cast<i16>(std::round(clamp(normal[c], -1.0f, 1.0f) * 32767.0f));
+            out.tangent[c] = static_cast<i16>(std::round(clamp(tangent[c], -1.0f, 1.0f) * 32767.0f));
+            out.uv[c] = packHalf1x16(vertex.uv[c]);
+        }
+    }
+
+    return packed;
+}
+
 void Mesh::Start()
 {
 
@@ -65,28 +394,32 @@ void Mesh::GUI()
     ImGui::Button("Yes");
 }
 
-void Mesh::RecursivelyLoadNode(const aiNode* const pNode, const aiScene* pScene)
+void Mesh::RecursivelyLoadNode(const aiNode* const pNode, const aiScene* pScene, std::vector<const aiMesh*>& _meshes)
 {
     for (u32 i = 0; i < pNode->mNumMeshes; i++)
     {
-        subMeshes.emplace_back(LoadMeshFrom(*pScene->mMeshes[pNode->mMeshes[i]], pScene));
+        _meshes.emplace_back(pScene->mMeshes[pNode->mMeshes[i]]);
     }
 
     for (u32 i = 0; i < pNode->mNumChildren; i++)
     {
-        RecursivelyLoadNode(pNode->mChildren[i], pScene);
+        RecursivelyLoadNode(pNode->mChildren[i], pScene, _meshes);
     }
 }
 
-SubMesh* Mesh::LoadMeshFrom(const aiMesh& mesh, const aiScene* scene)
+Mesh::ImportedSubMesh Mesh::LoadMeshFrom(const aiMesh& mesh, const aiScene* scene, const std::string& _directory)
 {
-    std::vector<MeshVertexDecl::Decl> vertices;
-    std::vector<u16> indices;
-    std::vector<Texture2D> textures;
+    ImportedSubMesh subMesh;
+
+    std::vector<MeshVertexDecl::Decl>& vertices = subMesh.vertices;
+    std::vector<u16>& indices = subMesh.indices;
 
     vertices.reserve(mesh.mNumVertices);
     indices.reserve(mesh.mNumFaces);
 
+    subMesh.boundsMin = vec3(FLT_MAX);
+    subMesh.boundsMax = vec3(-FLT_MAX);
+
     for (u32 i = 0; i < mesh.mNumVertices; i++)
     {
         MeshVertexDecl::Decl v{};
@@ -103,17 +436,42 @@ SubMesh* Mesh::LoadMeshFrom(const aiMesh& mesh, const aiScene* scene)
         v.uv.x = mesh.mTextureCoords[0][i].x;
         v.uv.y = mesh.mTextureCoords[0][i].y;
 
-        v.tangent.x = mesh.mTangents->x;
-        v.tangent.y = mesh.mTangents->y;
-        v.tangent.z = mesh.mTangents->z;
+        if (mesh.HasTangentsAndBitangents())
+        {
+            v.tangent.x = mesh.mTangents[i].x;
+            v.tangent.y = mesh.mTangents[i].y;
+            v.tangent.z = mesh.mTangents[i].z;
+
+            v.bitangent.x = mesh.mBitangents[i].x;
+            v.bitangent.y = mesh.mBitangents[i].y;
+            v.bitangent.z = mesh.mBitangents[i].z;
+        }
+        else
+        {
+            //no uvs to derive them from, any frame around the normal keeps the packed encoding valid
+            const vec3 axis = std::abs(v.normal.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+            v.tangent = normalize(cross(axis, v.normal));
+            v.bitangent = cross(v.normal, v.tangent);
+        }
 
-        v.bitangent.x = mesh.mBitangents->x;
-        v.bitangent.y = mesh.mBitangents->y;
-        v.bitangent.z = mesh.mBitangents->z;
+        subMesh.boundsMin = min(subMesh.boundsMin, v.pos);
+        subMesh.boundsMax = max(subMesh.boundsMax, v.pos);
 
         vertices.emplace_back(v);
     }
 
+    //the sphere is centered on the box for the culling, tighter than the half diagonal of the box
+    const vec3 boundsCenter = (subMesh.boundsMin + subMesh.boundsMax) * 0.5f;
+    float boundsRadiusSquared = 0.0f;
+
+    for (const auto& v : vertices)
+    {
+        const vec3 offset = v.pos - boundsCenter;
+        boundsRadiusSquared = max(boundsRadiusSquared, dot(offset, offset));
+    }
+
+    subMesh.boundsRadius = sqrt(boundsRadiusSquared);
+
     for (u32 i = 0; i < mesh.mNumFaces; i++)
     {
         const auto& face = mesh.mFaces[i];
@@ -129,7 +487,7 @@ SubMesh* Mesh::LoadMeshFrom(const aiMesh& mesh, const aiScene* scene)
     {
 	    const auto mat = scene->mMaterials[mesh.mMaterialIndex];
 
-        auto texAlbedo = LoadMaterialTexturesType(mat, aiTextureType_BASE_COLOR);
+        auto texAlbedo = GetMaterialTexturePaths(mat, aiTextureType_BASE_COLOR, _directory);
 
         aiString texture_file;
         mat->Get(AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), texture_file);
@@ -141,47 +499,45 @@ SubMesh* Mesh::LoadMeshFrom(const aiMesh& mesh, const aiScene* scene)
         }
 
         if (!texAlbedo.empty())
-            texAlbedo = LoadMaterialTexturesType(mat, aiTextureType_DIFFUSE);
+            texAlbedo = GetMaterialTexturePaths(mat, aiTextureType_DIFFUSE, _directory);
 
+        std::vector<std::string>& textures = subMesh.texturePaths;
         textures = texAlbedo;
 
-        auto texSpecular = LoadMaterialTexturesType(mat, aiTextureType_SPECULAR);
+        auto texSpecular = GetMaterialTexturePaths(mat, aiTextureType_SPECULAR, _directory);
 
         if (texSpecular.empty())
         {
-            texSpecular = LoadMaterialTexturesType(mat, aiTextureType_HEIGHT);
+            texSpecular = GetMaterialTexturePaths(mat, aiTextureType_HEIGHT, _directory);
         }
 
-        auto texMetallic = LoadMaterialTexturesType(mat, aiTextureType_METALNESS);
-        auto texRoughness = LoadMaterialTexturesType(mat, aiTextureType_DIFFUSE_ROUGHNESS);
-        auto texAO = LoadMaterialTexturesType(mat, aiTextureType_AMBIENT_OCCLUSION);
+        auto texMetallic = GetMaterialTexturePaths(mat, aiTextureType_METALNESS, _directory);
+        auto texRoughness = GetMaterialTexturePaths(mat, aiTextureType_DIFFUSE_ROUGHNESS, _directory);
+        auto texAO = GetMaterialTexturePaths(mat, aiTextureType_AMBIENT_OCCLUSION, _directory);
 
-        auto texNormal = LoadMaterialTexturesType(mat, aiTextureType_NORMALS);
+        auto texNormal = GetMaterialTexturePaths(mat, aiTextureType_NORMALS, _directory);
 
-        textures.insert(textures.end(), std::make_move_iterator(texSpecular.begin()), std::make_move_iterator(texSpecular.end()));
-        textures.insert(textures.end(), std::make_move_iterator(texMetallic.begin()), std::make_move_iterator(texMetallic.end()));
-        textures.insert(textures.end(), std::make_move_iterator(texRoughness.begin()), std::make_move_iterator(texRoughness.end()));
-        textures.insert(textures.end(), std::make_move_iterator(texAO.begin()), std::make_move_iterator(texAO.end()));
-        textures.insert(textures.end(), std::make_move_iterator(texNormal.begin()), std::make_move_iterator(texNormal.end()));
+        textures.insert(textures.end(), texSpecular.begin(), texSpecular.end());
+        textures.insert(textures.end(), texMetallic.begin(), texMetallic.end());
+        textures.insert(textures.end(), texRoughness.begin(), texRoughness.end());
+        textures.insert(textures.end(), texAO.begin(), texAO.end());
+        textures.insert(textures.end(), texNormal.begin(), texNormal.end());
     }
 
-    return new SubMesh(std::move(vertices), std::move(indices), std::move(textures));
+    return subMesh;
 }
 
-std::vector<Texture2D> Mesh::LoadMaterialTexturesType(aiMaterial* pMaterial, aiTextureType type)
+std::vector<std::string> Mesh::GetMaterialTexturePaths(aiMaterial* pMaterial, aiTextureType type, const std::string& _directory)
 {
-    std::vector<Texture2D> textures(pMaterial->GetTextureCount(type));
+    std::vector<std::string> paths(pMaterial->GetTextureCount(type));
 
-    for (u32 i = 0; i < textures.size(); ++i)
+    for (u32 i = 0; i < paths.size(); ++i)
     {
         aiString texpath;
         pMaterial->GetTexture(type, i, &texpath);
 
-        std::string texPath = pathCleaned;
-        texPath += texpath.C_Str();
-
-        textures[i].LoadFrom(texPath.c_str(), vk::ImageLayout::eGeneral);
+        paths[i] = _directory + texpath.C_Str();
     }
 
-    return textures;
+    return paths;
 }
@@ -2,20 +2,50 @@
 #include <vector>
 #include <assimp/scene.h>
 
+#include "CookedMesh.h"
+#include "CullingBounds.h"
 #include "IndexBuffer.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
 #include "Node.h"
 #include "Texture2D.h"
 #include "VerticesDeclarations.h"
 #include "Shader.h"
 
+class ThreadPool;
+
 struct SubMesh
 {
 	MeshVertexDecl vertices;
-	IndexBuffer indices;
+	IndexBuffer indices; // every lod, one after the other
+	std::vector<MeshLod> lods; // finest first
 	std::vector<Texture2D> textures;
 
-	SubMesh(std::vector<MeshVertexDecl::Decl>&& _vertices, std::vector<glm::u16>&& _indices, std::vector<Texture2D>&& _textures)
-		: vertices(std::move(_vertices)), indices(std::move(_indices)), textures(std::move(_textures)) {};
+	vec3 boundsMin;
+	vec3 boundsMax;
+	float boundsRadius; // around the center of the box
+	// shared by the submeshes with the same textures, index in the texture array of the renderer
+	u32 materialIndex = 0;
+
+	// of lod 0, kept on the cpu for now, for the culling of the clusters
+	MeshletData meshlets;
+
+	// the vertices and indices are uploaded from where the view points, the mapped cook most of the time
+	SubMesh(const CookedSubMesh& _data, MeshVertexDecl::Format _format, std::vector<Texture2D>&& _textures)
+		: vertices(_data.vertices, _data.vertexCount, _format), indices(_data.indices, _data.indexCount)
+		, textures(std::move(_textures)), boundsMin(_data.boundsMin), boundsMax(_data.boundsMax), boundsRadius(_data.boundsRadius)
+	{
+		lods.assign(_data.lods, _data.lods + _data.lodCount);
+
+		if (lods.empty())
+		{
+			lods.push_back({ 0, _data.indexCount, 0.0f });
+		}
+
+		meshlets.meshlets.assign(_data.meshlets, _data.meshlets + _data.meshletCount);
+		meshlets.vertices.assign(_data.meshletVertices, _data.meshletVertices + _data.meshletVertexCount);
+		meshlets.triangles.assign(_data.meshletTriangles, _data.meshletTriangles + _data.meshletTriangleCount * 3);
+	}
 };
 
 class Mesh : public Node
@@ -31,11 +61,46 @@ public:
 	= default;
 
 	std::vector<std::unique_ptr<SubMesh>>& GetSubMeshes() { return subMeshes; }
+	// false when the source could not be found or did not fit in the geometry arena, the mesh has no submesh then
+	[[nodiscard]] bool IsLoaded() const { return !subMeshes.empty(); }
+	Shader& GetShader() { return *m_shader; }
+	[[nodiscard]] MeshVertexDecl::Format GetVertexFormat() const { return m_vertexFormat; }
+	// the distinct texture sets of the submeshes, the materialIndex of every submesh is below it
+	[[nodiscard]] u32 GetMaterialCount() const { return m_materialCount; }
+	// one object per submesh, same order, in mesh space
+	[[nodiscard]] const CullingBounds& GetCullingBounds() const { return m_cullingBounds; }
+
+	// imports the mesh of the descriptor and writes its cook, nothing is uploaded
+	static bool Cook(const char* _descPath);
 
 private:
-	void RecursivelyLoadNode(const aiNode* const pNode, const aiScene* pScene);
-	SubMesh* LoadMeshFrom(const aiMesh& mesh, const aiScene* scene);
-	std::vector<Texture2D> LoadMaterialTexturesType(aiMaterial* pMaterial, aiTextureType type);
+	// what the importer produces for one submesh, cooked as is
+	struct ImportedSubMesh
+	{
+		std::vector<MeshVertexDecl::Decl> vertices;
+		std::vector<MeshVertexDecl::PackedDecl> packedVertices; // only for the packed format, the cook uses them instead
+		std::vector<u16> indices;
+		std::vector<MeshLod> lods;
+		MeshletData meshlets;
+		std::vector<std::string> texturePaths;
+		vec3 boundsMin;
+		vec3 boundsMax;
+		float boundsRadius;
+	};
+
+	// the submeshes are converted on _threadPool, in scene order
+	static bool Import(const std::string& _meshPath, MeshVertexDecl::Format _format, ThreadPool& _threadPool, std::vector<ImportedSubMesh>& _subMeshes);
+	// views on _imported, it has to outlive them
+	static std::vector<CookedSubMesh> ToCooked(const std::vector<ImportedSubMesh>& _imported, MeshVertexDecl::Format _format);
+
+	// "vertexFormat" of the descriptor
+	static MeshVertexDecl::Format ParseVertexFormat(const std::string& _name);
+	static std::string GetCookVariant(MeshVertexDecl::Format _format);
+	static std::vector<MeshVertexDecl::PackedDecl> PackVertices(const std::vector<MeshVertexDecl::Decl>& _vertices, vec3 _boundsMin, vec3 _boundsMax);
+
+	static void RecursivelyLoadNode(const aiNode* const pNode, const aiScene* pScene, std::vector<const aiMesh*>& _meshes);
+	static ImportedSubMesh LoadMeshFrom(const aiMesh& mesh, const aiScene* scene, const std::string& _directory);
+	static std::vector<std::string> GetMaterialTexturePaths(aiMaterial* pMaterial, aiTextureType type, const std::string& _directory);
 
 	std::string path;
 	std::string pathCleaned;
@@ -43,5 +108,9 @@ private:
 	std::vector<std::unique_ptr<SubMesh>> subMeshes; // todo: change this to a non pointer type, cache friendliness please !
 
 	std::unique_ptr<Shader> m_shader;
+	MeshVertexDecl::Format m_vertexFormat = MeshVertexDecl::Format::Full;
+
+	CullingBounds m_cullingBounds;
+	u32 m_materialCount = 0;
 };
 
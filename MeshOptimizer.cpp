@@ -0,0 +1,411 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+// the cache the vertex cache optimizer scores against, the real one is smaller on most gpus
+// but a bigger model keeps the result good on all of them
+static constexpr u32 SCORE_CACHE_SIZE = 32;
+
+static constexpr float CACHE_DECAY_POWER = 1.5f;
+static constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+static constexpr float VALENCE_BOOST_SCALE = 2.0f;
+static constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+static constexpr u32 INVALID_INDEX = ~0u;
+
+// a triangle only misses the vertices that are not in the fifo, the new ones push the oldest out
+static u32 SimulateFifo(const u16* _triangle, std::vector<u32>& _timestamps, u32& _time, u32 _cacheSize)
+{
+	u32 misses = 0;
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		const u16 vertex = _triangle[i];
+
+		if (_time - _timestamps[vertex] > _cacheSize)
+		{
+			_timestamps[vertex] = _time++;
+			misses++;
+		}
+	}
+
+	return misses;
+}
+
+static float VertexScore(i32 _cachePosition, u32 _remainingTriangles)
+{
+	// nothing left to draw with it, it should leave the cache
+	if (_remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (_cachePosition >= 0)
+	{
+		// the last triangle's vertices get a fixed score, the order they were used in does not matter
+		if (_cachePosition < 3)
+		{
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			const float scaler = 1.0f / static_cast<float>(SCORE_CACHE_SIZE - 3);
+			score = std::pow(1.0f - static_cast<float>(_cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// vertices with few triangles left are finished first, so they do not end up alone later
+	score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(_remainingTriangles), -VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+MeshOptimizer::Stats& MeshOptimizer::Stats::operator+=(const Stats& _other)
+{
+	triangleCount += _other.triangleCount;
+	vertexCount += _other.vertexCount;
+	cacheMisses += _other.cacheMisses;
+
+	return *this;
+}
+
+MeshOptimizer::Stats MeshOptimizer::Analyze(const std::vector<u16>& _indices, u32 _vertexCount, u32 _cacheSize)
+{
+	Stats stats;
+	stats.triangleCount = static_cast<u32>(_indices.size() / 3);
+
+	// the timestamps start far enough in the past for every vertex to miss
+	std::vector<u32> timestamps(_vertexCount, 0);
+	u32 time = _cacheSize + 1;
+
+	std::vector<bool> isUsed(_vertexCount, false);
+
+	for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+	{
+		stats.cacheMisses += SimulateFifo(&_indices[i], timestamps, time, _cacheSize);
+
+		for (u32 j = 0; j < 3; ++j)
+		{
+			if (!isUsed[_indices[i + j]])
+			{
+				isUsed[_indices[i + j]] = true;
+				stats.vertexCount++;
+			}
+		}
+	}
+
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<u16>& _indices, u32 _vertexCount)
+{
+	const u32 triangleCount = static_cast<u32>(_indices.size() / 3);
+
+	if (triangleCount == 0)
+		return;
+
+	// triangles of each vertex, [offsets[v]; offsets[v] + remaining[v][ are the ones not emitted yet
+	std::vector<u32> remaining(_vertexCount, 0);
+
+	for (const u16 index : _indices)
+	{
+		remaining[index]++;
+	}
+
+	std::vector<u32> offsets(_vertexCount + 1, 0);
+
+	for (u32 v = 0; v < _vertexCount; ++v)
+	{
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+
+	std::vector<u32> adjacency(_indices.size());
+	std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+
+	for (u32 t = 0; t < triangleCount; ++t)
+	{
+		for (u32 j = 0; j < 3; ++j)
+		{
+			adjacency[fill[_indices[t * 3 + j]]++] = t;
+		}
+	}
+
+	std::vector<i32> cachePositions(_vertexCount, -1);
+	std::vector<float> vertexScores(_vertexCount);
+
+	for (u32 v = 0; v < _vertexCount; ++v)
+	{
+		vertexScores[v] = VertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> isEmitted(triangleCount, false);
+
+	for (u32 t = 0; t < triangleCount; ++t)
+	{
+		triangleScores[t] = vertexScores[_indices[t * 3]] + vertexScores[_indices[t * 3 + 1]] + vertexScores[_indices[t * 3 + 2]];
+	}
+
+	std::vector<u16> result;
+	result.reserve(_indices.size());
+
+	// +3, the vertices of the emitted triangle are pushed before the old ones fall out
+	std::vector<u32> cache;
+	std::vector<u32> newCache;
+	cache.reserve(SCORE_CACHE_SIZE + 3);
+	newCache.reserve(SCORE_CACHE_SIZE + 3);
+
+	u32 bestTriangle = static_cast<u32>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+	u32 scanCursor = 0;
+
+	for (u32 emitted = 0; emitted < triangleCount; ++emitted)
+	{
+		// dead end, nothing in the cache has triangles left: restart from the first triangle not emitted
+		if (bestTriangle == INVALID_INDEX)
+		{
+			while (isEmitted[scanCursor])
+			{
+				scanCursor++;
+			}
+
+			bestTriangle = scanCursor;
+		}
+
+		const u16* triangle = &_indices[bestTriangle * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+		isEmitted[bestTriangle] = true;
+
+		newCache.clear();
+
+		for (u32 j = 0; j < 3; ++j)
+		{
+			const u16 vertex = triangle[j];
+
+			// the triangle is no longer adjacent to its vertices
+			u32* begin = &adjacency[offsets[vertex]];
+			u32* end = begin + remaining[vertex];
+			*std::find(begin, end, bestTriangle) = *(end - 1);
+			remaining[vertex]--;
+
+			newCache.emplace_back(vertex);
+		}
+
+		for (const u32 vertex : cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				newCache.emplace_back(vertex);
+			}
+		}
+
+		// the ones pushed out are scored as not cached
+		for (u32 i = SCORE_CACHE_SIZE; i < newCache.size(); ++i)
+		{
+			cachePositions[newCache[i]] = -1;
+			vertexScores[newCache[i]] = VertexScore(-1, remaining[newCache[i]]);
+		}
+
+		newCache.resize(std::min<size_t>(newCache.size(), SCORE_CACHE_SIZE));
+		std::swap(cache, newCache);
+
+		for (u32 i = 0; i < cache.size(); ++i)
+		{
+			cachePositions[cache[i]] = static_cast<i32>(i);
+			vertexScores[cache[i]] = VertexScore(static_cast<i32>(i), remaining[cache[i]]);
+		}
+
+		// only the triangles touching the cache changed score, the next one is picked among them
+		bestTriangle = INVALID_INDEX;
+		float bestScore = -1.0f;
+
+		for (const u32 vertex : cache)
+		{
+			for (u32 i = 0; i < remaining[vertex]; ++i)
+			{
+				const u32 t = adjacency[offsets[vertex] + i];
+				const float score = vertexScores[_indices[t * 3]] + vertexScores[_indices[t * 3 + 1]] + vertexScores[_indices[t * 3 + 2]];
+
+				triangleScores[t] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	_indices = std::move(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, float _threshold)
+{
+	const u32 triangleCount = static_cast<u32>(_indices.size() / 3);
+
+	if (triangleCount == 0)
+		return;
+
+	const auto position = [&](u16 _index)
+	{
+		vec3 p;
+		memcpy(&p, _vertices + static_cast<size_t>(_index) * _vertexStride, sizeof(vec3));
+		return p;
+	};
+
+	// hard boundaries: the cache optimizer jumped somewhere else, every vertex of the triangle misses
+	std::vector<u32> hardClusters;
+
+	{
+		std::vector<u32> timestamps(_vertexCount, 0);
+		u32 time = FIFO_CACHE_SIZE + 1;
+
+		for (u32 t = 0; t < triangleCount; ++t)
+		{
+			if (SimulateFifo(&_indices[t * 3], timestamps, time, FIFO_CACHE_SIZE) == 3)
+			{
+				hardClusters.emplace_back(t);
+			}
+		}
+	}
+
+	// soft boundaries: inside a hard cluster, cut as soon as the part since the last cut is within _threshold
+	// of the acmr of the whole cluster, restarting a cluster there costs little locality
+	std::vector<u32> clusters;
+
+	for (u32 c = 0; c < hardClusters.size(); ++c)
+	{
+		const u32 start = hardClusters[c];
+		const u32 end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+
+		std::vector<u32> timestamps(_vertexCount, 0);
+		u32 time = FIFO_CACHE_SIZE + 1;
+		u32 clusterMisses = 0;
+
+		for (u32 t = start; t < end; ++t)
+		{
+			clusterMisses += SimulateFifo(&_indices[t * 3], timestamps, time, FIFO_CACHE_SIZE);
+		}
+
+		const float clusterThreshold = _threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+		clusters.emplace_back(start);
+
+		std::fill(timestamps.begin(), timestamps.end(), 0);
+		time = FIFO_CACHE_SIZE + 1;
+
+		u32 softStart = start;
+		u32 softMisses = 0;
+
+		for (u32 t = start; t < end; ++t)
+		{
+			softMisses += SimulateFifo(&_indices[t * 3], timestamps, time, FIFO_CACHE_SIZE);
+
+			if (t + 1 < end && static_cast<float>(softMisses) <= clusterThreshold * static_cast<float>(t + 1 - softStart))
+			{
+				clusters.emplace_back(t + 1);
+
+				softStart = t + 1;
+				softMisses = 0;
+				std::fill(timestamps.begin(), timestamps.end(), 0);
+				time = FIFO_CACHE_SIZE + 1;
+			}
+		}
+	}
+
+	// area weighted centroids and normals
+	std::vector<vec3> clusterCentroids(clusters.size(), vec3(0.0f));
+	std::vector<vec3> clusterNormals(clusters.size(), vec3(0.0f));
+	vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (u32 c = 0; c < clusters.size(); ++c)
+	{
+		const u32 end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		float clusterArea = 0.0f;
+
+		for (u32 t = clusters[c]; t < end; ++t)
+		{
+			const vec3 p0 = position(_indices[t * 3]);
+			const vec3 p1 = position(_indices[t * 3 + 1]);
+			const vec3 p2 = position(_indices[t * 3 + 2]);
+
+			const vec3 normal = cross(p1 - p0, p2 - p0);
+			const float area = length(normal);
+			const vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterArea;
+
+		clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : position(_indices[clusters[c] * 3]);
+	}
+
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// facing away from the center means in front of the rest of the mesh from most view points, drawn first
+	std::vector<float> sortKeys(clusters.size());
+
+	for (u32 c = 0; c < clusters.size(); ++c)
+	{
+		const float normalLength = length(clusterNormals[c]);
+		const vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : vec3(0.0f);
+
+		sortKeys[c] = dot(clusterCentroids[c] - meshCentroid, normal);
+	}
+
+	std::vector<u32> order(clusters.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](u32 _a, u32 _b) { return sortKeys[_a] > sortKeys[_b]; });
+
+	std::vector<u16> result;
+	result.reserve(_indices.size());
+
+	for (const u32 c : order)
+	{
+		const u32 end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		result.insert(result.end(), _indices.begin() + clusters[c] * 3, _indices.begin() + end * 3);
+	}
+
+	_indices = std::move(result);
+}
+
+u32 MeshOptimizer::OptimizeVertexFetch(std::vector<u16>& _indices, u8* _vertices, u32 _vertexCount, u32 _vertexStride)
+{
+	std::vector<u32> remap(_vertexCount, INVALID_INDEX);
+	u32 newCount = 0;
+
+	for (u16& index : _indices)
+	{
+		if (remap[index] == INVALID_INDEX)
+		{
+			remap[index] = newCount++;
+		}
+
+		index = static_cast<u16>(remap[index]);
+	}
+
+	// the remap only moves vertices, a copy is needed since they can move both ways
+	const std::vector<u8> source(_vertices, _vertices + static_cast<size_t>(_vertexCount) * _vertexStride);
+
+	for (u32 v = 0; v < _vertexCount; ++v)
+	{
+		if (remap[v] != INVALID_INDEX)
+		{
+			memcpy(_vertices + static_cast<size_t>(remap[v]) * _vertexStride, source.data() + static_cast<size_t>(v) * _vertexStride, _vertexStride);
+		}
+	}
+
+	return newCount;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// Reorders the triangles and vertices of an indexed triangle list, nothing is added or removed
+// except the vertices that no triangle uses.
+//   - post transform vertex cache: Forsyth's linear speed vertex cache optimisation
+//   - overdraw: the cache ordered triangles are cut in clusters where the cache locality allows it,
+//     and the clusters facing away from the center of the mesh are drawn first (Sander et al. 2007)
+//   - vertex fetch: the vertices are sorted by first use, the gpu reads the vertex buffer linearly
+// The vertices are opaque blobs of _vertexStride bytes, with the position as a vec3 at their start.
+class MeshOptimizer
+{
+public:
+	struct Stats
+	{
+		u32 triangleCount = 0;
+		u32 vertexCount = 0; // referenced by the indices
+		u32 cacheMisses = 0;
+
+		// average cache miss ratio, transformed vertices per triangle, 0.5 at best on a regular grid
+		[[nodiscard]] float GetACMR() const { return triangleCount ? static_cast<float>(cacheMisses) / static_cast<float>(triangleCount) : 0.0f; }
+		// average transform to vertex ratio, 1.0 when every vertex is transformed once
+		[[nodiscard]] float GetATVR() const { return vertexCount ? static_cast<float>(cacheMisses) / static_cast<float>(vertexCount) : 0.0f; }
+
+		Stats& operator+=(const Stats& _other);
+	};
+
+	// simulated fifo post transform cache, the usual size for the metrics
+	static constexpr u32 FIFO_CACHE_SIZE = 16;
+
+	[[nodiscard]] static Stats Analyze(const std::vector<u16>& _indices, u32 _vertexCount, u32 _cacheSize = FIFO_CACHE_SIZE);
+
+	static void OptimizeVertexCache(std::vector<u16>& _indices, u32 _vertexCount);
+	// _indices should be cache optimized already, _threshold is how much the acmr of a cluster can degrade to allow a cut
+	static void OptimizeOverdraw(std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, float _threshold = 1.05f);
+	// returns the new vertex count
+	static u32 OptimizeVertexFetch(std::vector<u16>& _indices, u8* _vertices, u32 _vertexCount, u32 _vertexStride);
+
+	// the three passes in order, the stats are measured before and after
+	template<typename Vertex>
+	static void Optimize(std::vector<u16>& _indices, std::vector<Vertex>& _vertices, Stats& _before, Stats& _after)
+	{
+		auto* vertices = reinterpret_cast<u8*>(_vertices.data());
+		const u32 vertexCount = static_cast<u32>(_vertices.size());
+
+		_before = Analyze(_indices, vertexCount);
+
+		OptimizeVertexCache(_indices, vertexCount);
+		OptimizeOverdraw(_indices, vertices, vertexCount, sizeof(Vertex));
+		_vertices.resize(OptimizeVertexFetch(_indices, vertices, vertexCount, sizeof(Vertex)));
+
+		_after = Analyze(_indices, static_cast<u32>(_vertices.size()));
+	}
+};
@@ -0,0 +1,354 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "MeshOptimizer.h"
+
+// a collapse is refused when a triangle around it turns more than that (cos of the angle)
+static constexpr float MAX_NORMAL_CHANGE = 0.2f;
+
+namespace
+{
+	// symmetric 4x4 matrix of the sum of the squared distances to planes, weighted by their area
+	struct Quadric
+	{
+		double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		void AddPlane(const vec3& _normal, float _distance, float _weight)
+		{
+			const double x = _normal.x, y = _normal.y, z = _normal.z, d = _distance, w = _weight;
+
+			a00 += w * x * x; a11 += w * y * y; a22 += w * z * z;
+			a01 += w * x * y; a02 += w * x * z; a12 += w * y * z;
+			b0 += w * x * d; b1 += w * y * d; b2 += w * z * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		Quadric& operator+=(const Quadric& _other)
+		{
+			a00 += _other.a00; a11 += _other.a11; a22 += _other.a22;
+			a01 += _other.a01; a02 += _other.a02; a12 += _other.a12;
+			b0 += _other.b0; b1 += _other.b1; b2 += _other.b2;
+			c += _other.c;
+			weight += _other.weight;
+
+			return *this;
+		}
+
+		// mean squared distance of _p to the planes
+		[[nodiscard]] float Evaluate(const vec3& _p) const
+		{
+			const double x = _p.x, y = _p.y, z = _p.z;
+
+			const double error = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (b0 * x + b1 * y + b2 * z)
+				+ c;
+
+			return weight > 0.0 ? static_cast<float>(std::max(error, 0.0) / weight) : 0.0f;
+		}
+	};
+
+	struct Collapse
+	{
+		u32 from;
+		u32 to;
+		float cost;
+	};
+
+	u64 EdgeKey(u32 _a, u32 _b)
+	{
+		return _a < _b ? (static_cast<u64>(_a) << 32) | _b : (static_cast<u64>(_b) << 32) | _a;
+	}
+}
+
+float MeshSimplifier::Simplify(const std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, u32 _targetIndexCount, std::vector<u16>& _result)
+{
+	_result = _indices;
+
+	std::vector<vec3> positions(_vertexCount);
+
+	for (u32 v = 0; v < _vertexCount; ++v)
+	{
+		memcpy(&positions[v], _vertices + static_cast<size_t>(v) * _vertexStride, sizeof(vec3));
+	}
+
+	// the vertices at the same position are one point of the surface, split by an attribute seam
+	std::vector<u32> welded(_vertexCount);
+	std::vector<u32> weldedCount(_vertexCount, 0);
+
+	{
+		struct PositionHash
+		{
+			size_t operator()(const vec3& _p) const
+			{
+				u32 bits[3];
+				memcpy(bits, &_p, sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+
+		std::unordered_map<vec3, u32, PositionHash> firstAtPosition;
+		firstAtPosition.reserve(_vertexCount);
+
+		for (u32 v = 0; v < _vertexCount; ++v)
+		{
+			welded[v] = firstAtPosition.emplace(positions[v], v).first->second;
+			weldedCount[welded[v]]++;
+		}
+	}
+
+	std::vector<bool> isLocked(_vertexCount, false);
+
+	for (u32 v = 0; v < _vertexCount; ++v)
+	{
+		isLocked[v] = weldedCount[welded[v]] > 1;
+	}
+
+	// border edges only have one triangle once the seams are welded
+	{
+		std::unordered_map<u64, u32> edgeUses;
+		edgeUses.reserve(_indices.size());
+
+		for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+		{
+			for (u32 j = 0; j < 3; ++j)
+			{
+				edgeUses[EdgeKey(welded[_indices[i + j]], welded[_indices[i + (j + 1) % 3]])]++;
+			}
+		}
+
+		for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+		{
+			for (u32 j = 0; j < 3; ++j)
+			{
+				const u16 a = _indices[i + j];
+				const u16 b = _indices[i + (j + 1) % 3];
+
+				if (edgeUses[EdgeKey(welded[a], welded[b])] == 1)
+				{
+					isLocked[a] = true;
+					isLocked[b] = true;
+				}
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(_vertexCount);
+
+	for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+	{
+		const vec3& p0 = positions[_indices[i]];
+		const vec3 normal = cross(positions[_indices[i + 1]] - p0, positions[_indices[i + 2]] - p0);
+		const float area = length(normal);
+
+		if (area == 0.0f)
+			continue;
+
+		const vec3 unitNormal = normal / area;
+
+		for (u32 j = 0; j < 3; ++j)
+		{
+			quadrics[_indices[i + j]].AddPlane(unitNormal, -dot(unitNormal, p0), area);
+		}
+	}
+
+	const auto isDegenerate = [&](const u16* _triangle)
+	{
+		return welded[_triangle[0]] == welded[_triangle[1]] || welded[_triangle[0]] == welded[_triangle[2]] || welded[_triangle[1]] == welded[_triangle[2]];
+	};
+
+	float maxError = 0.0f;
+
+	std::vector<u32> offsets;
+	std::vector<u32> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<u32> remap(_vertexCount);
+	std::vector<bool> isTouched(_vertexCount);
+
+	// each pass collapses the cheapest edges that do not share a vertex, until the target is reached or nothing can go
+	while (_result.size() > _targetIndexCount)
+	{
+		const u32 triangleCount = static_cast<u32>(_result.size() / 3);
+
+		offsets.assign(_vertexCount + 1, 0);
+
+		for (const u16 index : _result)
+		{
+			offsets[index + 1]++;
+		}
+
+		for (u32 v = 0; v < _vertexCount; ++v)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+
+		adjacency.resize(_result.size());
+		std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+
+		for (u32 t = 0; t < triangleCount; ++t)
+		{
+			for (u32 j = 0; j < 3; ++j)
+			{
+				adjacency[fill[_result[t * 3 + j]]++] = t;
+			}
+		}
+
+		collapses.clear();
+
+		for (u32 t = 0; t < triangleCount; ++t)
+		{
+			for (u32 j = 0; j < 3; ++j)
+			{
+				const u16 a = _result[t * 3 + j];
+				const u16 b = _result[t * 3 + (j + 1) % 3];
+
+				// both directions, each edge is seen from its two triangles but the duplicates are harmless
+				if (!isLocked[a])
+				{
+					Quadric q = quadrics[a];
+					q += quadrics[b];
+					collapses.push_back({ a, b, q.Evaluate(positions[b]) });
+				}
+
+				if (!isLocked[b])
+				{
+					Quadric q = quadrics[b];
+					q += quadrics[a];
+					collapses.push_back({ b, a, q.Evaluate(positions[a]) });
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& _l, const Collapse& _r) { return _l.cost < _r.cost; });
+
+		for (u32 v = 0; v < _vertexCount; ++v)
+		{
+			remap[v] = v;
+		}
+
+		std::fill(isTouched.begin(), isTouched.end(), false);
+
+		const u32 trianglesToRemove = static_cast<u32>((_result.size() - _targetIndexCount) / 3);
+		u32 trianglesRemoved = 0;
+		u32 collapseCount = 0;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (trianglesRemoved >= trianglesToRemove)
+				break;
+
+			if (isTouched[collapse.from] || isTouched[collapse.to])
+				continue;
+
+			// the triangles around the removed vertex must not fold over
+			bool isValid = true;
+			u32 removed = 0;
+
+			for (u32 i = offsets[collapse.from]; i < offsets[collapse.from + 1] && isValid; ++i)
+			{
+				const u16* triangle = &_result[adjacency[i] * 3];
+
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+
+				vec3 p[3];
+				vec3 moved[3];
+
+				for (u32 j = 0; j < 3; ++j)
+				{
+					p[j] = positions[triangle[j]];
+					moved[j] = triangle[j] == collapse.from ? positions[collapse.to] : p[j];
+				}
+
+				const vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+				const vec3 after = cross(moved[1] - moved[0], moved[2] - moved[0]);
+				const float lengths = length(before) * length(after);
+
+				isValid = lengths > 0.0f && dot(before, after) >= MAX_NORMAL_CHANGE * lengths;
+			}
+
+			if (!isValid)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			maxError = std::max(maxError, collapse.cost);
+
+			// the neighbourhood changed, its flip tests would be wrong until the next pass
+			for (u32 i = offsets[collapse.from]; i < offsets[collapse.from + 1]; ++i)
+			{
+				for (u32 j = 0; j < 3; ++j)
+				{
+					isTouched[_result[adjacency[i] * 3 + j]] = true;
+				}
+			}
+
+			trianglesRemoved += removed;
+			collapseCount++;
+		}
+
+		if (collapseCount == 0)
+			break;
+
+		size_t write = 0;
+
+		for (size_t i = 0; i + 2 < _result.size(); i += 3)
+		{
+			const u16 triangle[3] = { static_cast<u16>(remap[_result[i]]), static_cast<u16>(remap[_result[i + 1]]), static_cast<u16>(remap[_result[i + 2]]) };
+
+			if (isDegenerate(triangle))
+				continue;
+
+			_result[write++] = triangle[0];
+			_result[write++] = triangle[1];
+			_result[write++] = triangle[2];
+		}
+
+		_result.resize(write);
+	}
+
+	return std::sqrt(maxError);
+}
+
+void MeshSimplifier::BuildLods(std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, std::vector<MeshLod>& _lods)
+{
+	_lods.clear();
+	_lods.push_back({ 0, static_cast<u32>(_indices.size()), 0.0f });
+
+	// every lod is simplified from lod 0, the quadrics of the full mesh give a better result than a chain of approximations
+	const std::vector<u16> source = _indices;
+	std::vector<u16> simplified;
+
+	while (_lods.size() < MAX_LOD_COUNT)
+	{
+		const MeshLod& previous = _lods.back();
+		const u32 targetIndexCount = static_cast<u32>(static_cast<float>(previous.indexCount / 3) * LOD_REDUCTION) * 3;
+
+		if (targetIndexCount < MIN_LOD_TRIANGLES * 3)
+			break;
+
+		const float error = Simplify(source, _vertices, _vertexCount, _vertexStride, targetIndexCount, simplified);
+
+		// stuck on the locked vertices, the lod would cost as much as the previous one
+		if (simplified.size() > previous.indexCount * 0.8f)
+			break;
+
+		MeshOptimizer::OptimizeVertexCache(simplified, _vertexCount);
+
+		// the errors only grow along the chain, the selection relies on it
+		_lods.push_back({ static_cast<u32>(_indices.size()), static_cast<u32>(simplified.size()), std::max(error, previous.error) });
+		_indices.insert(_indices.end(), simplified.begin(), simplified.end());
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// One level of detail of a submesh, all of them live in the same index buffer and share the vertices.
+struct MeshLod
+{
+	u32 firstIndex;
+	u32 indexCount;
+	// how far the surface moved from the full resolution one, in the units of the mesh
+	float error;
+};
+
+// Quadric error edge collapse (Garland & Heckbert), the vertices are never moved or created:
+// a vertex is collapsed on one of its neighbours, only the index buffer changes.
+// The vertices on a uv or normal seam (several vertices at the same position) and on the border of the mesh are locked,
+// the simplified mesh keeps its silhouette and its texture mapping.
+// The positions are read as a vec3 at the start of each vertex.
+class MeshSimplifier
+{
+public:
+	static constexpr u32 MAX_LOD_COUNT = 5;
+	// each lod aims for this ratio of the triangles of the previous one
+	static constexpr float LOD_REDUCTION = 0.5f;
+	// not worth a lod under that
+	static constexpr u32 MIN_LOD_TRIANGLES = 64;
+
+	// returns the error of the result
+	static float Simplify(const std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, u32 _targetIndexCount, std::vector<u16>& _result);
+
+	// _indices is lod 0, the coarser lods are appended to it, each one cache optimized
+	static void BuildLods(std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, std::vector<MeshLod>& _lods);
+};
@@ -0,0 +1,174 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// under this, the normals are too spread for the cone to ever cull anything
+static constexpr float MIN_CONE_DOT = 0.1f;
+
+static constexpr u8 NOT_IN_MESHLET = 0xFF;
+
+static vec3 ReadPosition(const u8* _vertices, u32 _vertexStride, u32 _index)
+{
+	vec3 position;
+	memcpy(&position, _vertices + static_cast<size_t>(_index) * _vertexStride, sizeof(vec3));
+	return position;
+}
+
+void MeshletBuilder::Build(const std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, MeshletData& _data)
+{
+	static_assert(MAX_VERTICES < NOT_IN_MESHLET, "the local indices are stored on a byte");
+
+	_data.meshlets.clear();
+	_data.vertices.clear();
+	_data.triangles.clear();
+
+	const u32 triangleCount = static_cast<u32>(_indices.size() / 3);
+
+	if (triangleCount == 0)
+		return;
+
+	// worst case is one meshlet per MAX_TRIANGLES, the vertices are shared most of the time
+	_data.meshlets.reserve((triangleCount + MAX_TRIANGLES - 1) / MAX_TRIANGLES);
+	_data.vertices.reserve(_vertexCount);
+	_data.triangles.reserve(_indices.size());
+
+	// index of each vertex in the current meshlet
+	std::vector<u8> localIndices(_vertexCount, NOT_IN_MESHLET);
+
+	Meshlet meshlet{};
+
+	const auto finish = [&]()
+	{
+		for (u32 i = 0; i < meshlet.vertexCount; ++i)
+		{
+			localIndices[_data.vertices[meshlet.vertexOffset + i]] = NOT_IN_MESHLET;
+		}
+
+		ComputeBounds(meshlet, _data, _vertices, _vertexStride);
+		_data.meshlets.emplace_back(meshlet);
+	};
+
+	for (u32 t = 0; t < triangleCount; ++t)
+	{
+		const u16* triangle = &_indices[t * 3];
+
+		const u32 newVertices = (localIndices[triangle[0]] == NOT_IN_MESHLET)
+			+ (localIndices[triangle[1]] == NOT_IN_MESHLET && triangle[1] != triangle[0])
+			+ (localIndices[triangle[2]] == NOT_IN_MESHLET && triangle[2] != triangle[0] && triangle[2] != triangle[1]);
+
+		if (meshlet.triangleCount > 0 && (meshlet.vertexCount + newVertices > MAX_VERTICES || meshlet.triangleCount + 1 > MAX_TRIANGLES))
+		{
+			finish();
+
+			meshlet = {};
+			meshlet.vertexOffset = static_cast<u32>(_data.vertices.size());
+			meshlet.triangleOffset = static_cast<u32>(_data.triangles.size() / 3);
+			meshlet.firstIndex = t * 3;
+		}
+
+		for (u32 j = 0; j < 3; ++j)
+		{
+			u8& local = localIndices[triangle[j]];
+
+			if (local == NOT_IN_MESHLET)
+			{
+				local = static_cast<u8>(meshlet.vertexCount++);
+				_data.vertices.emplace_back(triangle[j]);
+			}
+
+			_data.triangles.emplace_back(local);
+		}
+
+		meshlet.triangleCount++;
+	}
+
+	finish();
+}
+
+void MeshletBuilder::ComputeBounds(Meshlet& _meshlet, const MeshletData& _data, const u8* _vertices, u32 _vertexStride)
+{
+	const u16* vertices = &_data.vertices[_meshlet.vertexOffset];
+	const u8* triangles = &_data.triangles[static_cast<size_t>(_meshlet.triangleOffset) * 3];
+
+	// the sphere around the box is not the tightest, but it is stable and cheap
+	vec3 boundsMin(FLT_MAX);
+	vec3 boundsMax(-FLT_MAX);
+
+	for (u32 i = 0; i < _meshlet.vertexCount; ++i)
+	{
+		const vec3 position = ReadPosition(_vertices, _vertexStride, vertices[i]);
+
+		boundsMin = min(boundsMin, position);
+		boundsMax = max(boundsMax, position);
+	}
+
+	_meshlet.center = (boundsMin + boundsMax) * 0.5f;
+	_meshlet.radius = 0.0f;
+
+	for (u32 i = 0; i < _meshlet.vertexCount; ++i)
+	{
+		_meshlet.radius = std::max(_meshlet.radius, distance(_meshlet.center, ReadPosition(_vertices, _vertexStride, vertices[i])));
+	}
+
+	// the cone is built on the unit normals of the triangles (counter clockwise front faces)
+	std::vector<vec3> normals;
+	std::vector<vec3> origins;
+	normals.reserve(_meshlet.triangleCount);
+	origins.reserve(_meshlet.triangleCount);
+
+	vec3 normalSum(0.0f);
+
+	for (u32 t = 0; t < _meshlet.triangleCount; ++t)
+	{
+		const vec3 p0 = ReadPosition(_vertices, _vertexStride, vertices[triangles[t * 3]]);
+		const vec3 p1 = ReadPosition(_vertices, _vertexStride, vertices[triangles[t * 3 + 1]]);
+		const vec3 p2 = ReadPosition(_vertices, _vertexStride, vertices[triangles[t * 3 + 2]]);
+
+		const vec3 normal = cross(p1 - p0, p2 - p0);
+		const float area = length(normal);
+
+		// degenerate, it has no side to cull
+		if (area == 0.0f)
+			continue;
+
+		normals.emplace_back(normal / area);
+		origins.emplace_back(p0);
+		normalSum += normal / area;
+	}
+
+	// never culled by default
+	_meshlet.coneApex = _meshlet.center;
+	_meshlet.coneAxis = vec3(0.0f);
+	_meshlet.coneCutoff = 1.0f;
+
+	const float normalSumLength = length(normalSum);
+
+	if (normals.empty() || normalSumLength == 0.0f)
+		return;
+
+	const vec3 axis = normalSum / normalSumLength;
+	float minDot = 1.0f;
+
+	for (const vec3& normal : normals)
+	{
+		minDot = std::min(minDot, dot(axis, normal));
+	}
+
+	if (minDot <= MIN_CONE_DOT)
+		return;
+
+	// the apex goes back along the axis until it is behind the plane of every triangle
+	float maxDistance = 0.0f;
+
+	for (size_t i = 0; i < normals.size(); ++i)
+	{
+		maxDistance = std::max(maxDistance, dot(_meshlet.center - origins[i], normals[i]) / dot(axis, normals[i]));
+	}
+
+	_meshlet.coneApex = _meshlet.center - axis * maxDistance;
+	_meshlet.coneAxis = axis;
+	_meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// A small cluster of triangles of a submesh, with what is needed to cull it on its own.
+// The triangles of a meshlet are also a contiguous range of the index buffer of its submesh
+// ([firstIndex; firstIndex + triangleCount * 3[), a culled list of meshlets can be drawn without a new index buffer.
+// Laid out as a std430 struct, it can be read as is by a shader.
+struct Meshlet
+{
+	// bounding sphere, in the space of the submesh
+	vec3 center;
+	float radius;
+
+	// normal cone: every triangle faces away from a camera inside the cone opened at coneApex, around -coneAxis
+	vec3 coneApex;
+	float coneCutoff; // sin of the half angle of the cone, 1 when it can not be culled this way
+	vec3 coneAxis;
+	u32 firstIndex;
+
+	// in MeshletData::vertices and MeshletData::triangles
+	u32 vertexOffset;
+	u32 triangleOffset;
+	u32 vertexCount;
+	u32 triangleCount;
+
+	// backface culling of the whole meshlet, _cameraPosition in the space of the submesh
+	[[nodiscard]] bool IsBackfacing(const vec3& _cameraPosition) const
+	{
+		const vec3 toApex = coneApex - _cameraPosition;
+		const float distance = length(toApex);
+
+		return distance > 0.0f && dot(toApex, coneAxis) >= coneCutoff * distance;
+	}
+};
+
+static_assert(sizeof(Meshlet) == 64, "Meshlet is read by shaders, keep it std430");
+
+// The meshlets of a submesh, the local triangles index the vertices of their meshlet,
+// which index the vertex buffer of the submesh.
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<u16> vertices;
+	std::vector<u8> triangles; // 3 per triangle
+};
+
+class MeshletBuilder
+{
+public:
+	// the sizes usually advised for mesh shaders, a meshlet fits in a 64 wide workgroup
+	static constexpr u32 MAX_VERTICES = 64;
+	static constexpr u32 MAX_TRIANGLES = 124;
+
+	// the triangles are taken in the order of _indices, which should be cache optimized for the meshlets to be compact
+	// the positions are read as a vec3 at the start of each vertex
+	static void Build(const std::vector<u16>& _indices, const u8* _vertices, u32 _vertexCount, u32 _vertexStride, MeshletData& _data);
+
+private:
+	static void ComputeBounds(Meshlet& _meshlet, const MeshletData& _data, const u8* _vertices, u32 _vertexStride);
+};
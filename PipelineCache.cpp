@@ -0,0 +1,143 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr u32 PIPELINE_CACHE_MAGIC = 0x43505641; // "AVPC"
+static constexpr u32 PIPELINE_CACHE_VERSION = 1;
+
+PipelineCache::PipelineCache(vk::Device _device, const vk::PhysicalDeviceProperties& _properties, std::string _path)
+	: m_device(_device), m_properties(_properties), m_path(std::move(_path))
+{
+	const std::vector<u8> data = Load();
+
+	vk::PipelineCacheCreateInfo info;
+	info.initialDataSize = data.size();
+	info.pInitialData = data.empty() ? nullptr : data.data();
+
+	m_cache = m_device.createPipelineCache(info);
+	m_isLoadedFromDisk = !data.empty();
+}
+
+PipelineCache::~PipelineCache()
+{
+	Save();
+
+	m_device.destroyPipelineCache(m_cache);
+}
+
+void PipelineCache::Save() const
+{
+	const std::vector<u8> data = m_device.getPipelineCacheData(m_cache);
+
+	FileHeader header{};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = m_properties.vendorID;
+	header.deviceID = m_properties.deviceID;
+	header.driverVersion = m_properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+	header.dataSize = data.size();
+
+	// written next to the real file first, a crash while saving would leave a truncated cache otherwise
+	const std::string tmpPath = m_path + ".tmp";
+
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+		{
+			std::cout << "[PipelineCache] could not write " << tmpPath << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmpPath, m_path, error);
+
+	if (error)
+	{
+		std::cout << "[PipelineCache] could not replace " << m_path << ": " << error.message() << std::endl;
+		return;
+	}
+
+	std::cout << "[PipelineCache] saved " << data.size() / 1024 << " KB to " << m_path << std::endl;
+}
+
+std::vector<u8> PipelineCache::Load() const
+{
+	std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+
+	if (!file.is_open())
+	{
+		std::cout << "[PipelineCache] no cache at " << m_path << ", starting cold" << std::endl;
+		return {};
+	}
+
+	const auto fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+
+	FileHeader header{};
+
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		std::cout << "[PipelineCache] " << m_path << " is truncated, ignored" << std::endl;
+		return {};
+	}
+
+	if (header.dataSize != fileSize - sizeof(header))
+	{
+		std::cout << "[PipelineCache] " << m_path << " size does not match its header, ignored" << std::endl;
+		return {};
+	}
+
+	std::vector<u8> data(header.dataSize);
+	file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+	if (!IsCompatible(header, data))
+		return {};
+
+	std::cout << "[PipelineCache] loaded " << data.size() / 1024 << " KB from " << m_path << std::endl;
+
+	return data;
+}
+
+bool PipelineCache::IsCompatible(const FileHeader& _header, const std::vector<u8>& _data) const
+{
+	if (_header.magic != PIPELINE_CACHE_MAGIC || _header.version != PIPELINE_CACHE_VERSION)
+	{
+		std::cout << "[PipelineCache] unknown file format, ignored" << std::endl;
+		return false;
+	}
+
+	if (_header.vendorID != m_properties.vendorID || _header.deviceID != m_properties.deviceID)
+	{
+		std::cout << "[PipelineCache] made for another device, ignored" << std::endl;
+		return false;
+	}
+
+	if (_header.driverVersion != m_properties.driverVersion
+		|| memcmp(_header.pipelineCacheUUID, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0)
+	{
+		std::cout << "[PipelineCache] made by another driver version, ignored" << std::endl;
+		return false;
+	}
+
+	// the driver would reject a mismatching blob anyway, but some are known not to check it
+	VkPipelineCacheHeaderVersionOne driverHeader;
+
+	if (_data.size() < sizeof(driverHeader))
+		return false;
+
+	memcpy(&driverHeader, _data.data(), sizeof(driverHeader));
+
+	return driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& driverHeader.vendorID == m_properties.vendorID
+		&& driverHeader.deviceID == m_properties.deviceID
+		&& memcmp(driverHeader.pipelineCacheUUID, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+using namespace glm;
+
+// vk::PipelineCache backed by a file, loaded on creation and written back on destruction.
+// The blob is only reused when it was produced by the same device and driver,
+// otherwise the cache starts empty and the file gets replaced.
+class PipelineCache
+{
+public:
+	PipelineCache(vk::Device _device, const vk::PhysicalDeviceProperties& _properties, std::string _path);
+	~PipelineCache();
+
+	PipelineCache(const PipelineCache& other) = delete;
+	PipelineCache(PipelineCache&& other) = delete;
+	PipelineCache& operator=(const PipelineCache& other) = delete;
+	PipelineCache& operator=(PipelineCache&& other) = delete;
+
+	void Save() const;
+
+	[[nodiscard]] vk::PipelineCache Get() const { return m_cache; }
+	[[nodiscard]] bool IsLoadedFromDisk() const { return m_isLoadedFromDisk; }
+
+private:
+	// written before the driver blob, the driver header does not hold the driver version
+	struct FileHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 vendorID;
+		u32 deviceID;
+		u32 driverVersion;
+		u8 pipelineCacheUUID[VK_UUID_SIZE];
+		u64 dataSize;
+	};
+
+	[[nodiscard]] std::vector<u8> Load() const;
+	[[nodiscard]] bool IsCompatible(const FileHeader& _header, const std::vector<u8>& _data) const;
+
+	vk::Device m_device;
+	vk::PhysicalDeviceProperties m_properties;
+	std::string m_path;
+
+	vk::PipelineCache m_cache;
+	bool m_isLoadedFromDisk = false;
+};
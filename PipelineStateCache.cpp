@@ -0,0 +1,315 @@
+#include "PipelineStateCache.h"
+
+#include <iostream>
+
+#include "CpuProfiler.h"
+#include "ThreadPool.h"
+
+template<typename T>
+static void HashCombine(u64& _seed, const T& _value)
+{
+	_seed ^= std::hash<T>{}(_value) + 0x9e3779b97f4a7c15ull + (_seed << 6) + (_seed >> 2);
+}
+
+template<typename Handle>
+static void HashHandle(u64& _seed, Handle _handle)
+{
+	HashCombine(_seed, static_cast<typename Handle::CType>(_handle));
+}
+
+u64 PipelineDesc::Hash() const
+{
+	u64 hash = 0;
+
+	HashHandle(hash, vertexModule);
+	HashHandle(hash, fragmentModule);
+
+	HashCombine(hash, vertexBinding.binding);
+	HashCombine(hash, vertexBinding.stride);
+	HashCombine(hash, static_cast<u32>(vertexBinding.inputRate));
+
+	for (const auto& attribute : vertexAttributes)
+	{
+		HashCombine(hash, attribute.location);
+		HashCombine(hash, attribute.binding);
+		HashCombine(hash, static_cast<u32>(attribute.format));
+		HashCombine(hash, attribute.offset);
+	}
+
+	HashHandle(hash, layout);
+	HashHandle(hash, renderPass);
+	HashCombine(hash, subpass);
+
+	HashCombine(hash, static_cast<u32>(topology));
+	HashCombine(hash, static_cast<u32>(polygonMode));
+	HashCombine(hash, static_cast<u32>(cullMode));
+	HashCombine(hash, static_cast<u32>(frontFace));
+
+	HashCombine(hash, depthTest);
+	HashCombine(hash, depthWrite);
+	HashCombine(hash, static_cast<u32>(depthCompareOp));
+
+	HashCombine(hash, blend);
+
+	return hash;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& _other) const
+{
+	return vertexModule == _other.vertexModule && fragmentModule == _other.fragmentModule
+		&& vertexBinding == _other.vertexBinding && vertexAttributes == _other.vertexAttributes
+		&& layout == _other.layout && renderPass == _other.renderPass && subpass == _other.subpass
+		&& topology == _other.topology && polygonMode == _other.polygonMode && cullMode == _other.cullMode && frontFace == _other.frontFace
+		&& depthTest == _other.depthTest && depthWrite == _other.depthWrite && depthCompareOp == _other.depthCompareOp
+		&& blend == _other.blend;
+}
+
+PipelineStateCache::PipelineStateCache(vk::Device _device, vk::PipelineCache _pipelineCache, ThreadPool& _threadPool)
+	: m_device(_device), m_pipelineCache(_pipelineCache), m_threadPool(_threadPool)
+{
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+	Clear();
+}
+
+vk::Pipeline PipelineStateCache::GetOrCreate(const PipelineDesc& _desc)
+{
+	std::unique_lock lock(m_mutex);
+
+	bool isNew;
+	Entry& entry = FindOrAdd(_desc, isNew);
+
+	if (isNew)
+	{
+		// compiled without the lock, nobody else can see the entry as ready until it is
+		m_pendingCount++;
+		lock.unlock();
+
+		const vk::Pipeline pipeline = Compile(_desc);
+
+		lock.lock();
+		entry.pipeline = pipeline;
+		entry.isReady = true;
+		m_pendingCount--;
+		m_compiled.notify_all();
+	}
+	else
+	{
+		// already requested in the background, wait for it instead of compiling it twice
+		m_compiled.wait(lock, [&entry] { return entry.isReady; });
+	}
+
+	return entry.pipeline;
+}
+
+vk::Pipeline PipelineStateCache::Request(const PipelineDesc& _desc)
+{
+	std::unique_lock lock(m_mutex);
+
+	bool isNew;
+	Entry& entry = FindOrAdd(_desc, isNew);
+
+	if (entry.isReady)
+		return entry.pipeline;
+
+	if (isNew)
+	{
+		m_pendingCount++;
+
+		// the entry is owned by a unique_ptr, its address is stable
+		m_threadPool.Enqueue([this, &entry]
+		{
+			const vk::Pipeline pipeline = Compile(entry.desc);
+
+			std::lock_guard workerLock(m_mutex);
+			entry.pipeline = pipeline;
+			entry.isReady = true;
+			m_hasNewlyReady = true;
+			m_pendingCount--;
+			m_compiled.notify_all();
+		});
+	}
+
+	return nullptr;
+}
+
+bool PipelineStateCache::ConsumeNewlyReady()
+{
+	std::lock_guard lock(m_mutex);
+
+	const bool hasNewlyReady = m_hasNewlyReady;
+	m_hasNewlyReady = false;
+
+	return hasNewlyReady;
+}
+
+void PipelineStateCache::Clear()
+{
+	std::unique_lock lock(m_mutex);
+
+	WaitPending(lock);
+
+	for (const auto& [hash, entries] : m_entries)
+	{
+		for (const auto& entry : entries)
+		{
+			m_device.destroyPipeline(entry->pipeline);
+		}
+	}
+
+	m_entries.clear();
+	m_hasNewlyReady = false;
+}
+
+u32 PipelineStateCache::GetPipelineCount()
+{
+	std::lock_guard lock(m_mutex);
+
+	u32 count = 0;
+
+	for (const auto& [hash, entries] : m_entries)
+	{
+		count += static_cast<u32>(entries.size());
+	}
+
+	return count - m_pendingCount;
+}
+
+u32 PipelineStateCache::GetPendingCount()
+{
+	std::lock_guard lock(m_mutex);
+
+	return m_pendingCount;
+}
+
+PipelineStateCache::Entry& PipelineStateCache::FindOrAdd(const PipelineDesc& _desc, bool& _isNew)
+{
+	auto& entries = m_entries[_desc.Hash()];
+
+	for (const auto& entry : entries)
+	{
+		if (entry->desc == _desc)
+		{
+			_isNew = false;
+			return *entry;
+		}
+	}
+
+	_isNew = true;
+
+	auto& entry = entries.emplace_back(std::make_unique<Entry>());
+	entry->desc = _desc;
+
+	return *entry;
+}
+
+void PipelineStateCache::WaitPending(std::unique_lock<std::mutex>& _lock)
+{
+	m_compiled.wait(_lock, [this] { return m_pendingCount == 0; });
+}
+
+vk::Pipeline PipelineStateCache::Compile(const PipelineDesc& _desc) const
+{
+	PROFILE_ZONE("PipelineStateCache::Compile");
+
+	vk::PipelineShaderStageCreateInfo infoVert;
+
+	infoVert.module = _desc.vertexModule;
+	infoVert.stage = vk::ShaderStageFlagBits::eVertex;
+	infoVert.pName = "main";
+
+	vk::PipelineShaderStageCreateInfo infoFrag;
+
+	infoFrag.module = _desc.fragmentModule;
+	infoFrag.stage = vk::ShaderStageFlagBits::eFragment;
+	infoFrag.pName = "main";
+	//info.pSpecializationInfo todo: this is to add shader constants at runtime aka shader defines
+
+	vk::PipelineShaderStageCreateInfo shaderStages[] = { infoVert, infoFrag };
+
+	vk::PipelineVertexInputStateCreateInfo vertexInfo;
+	vertexInfo.pVertexAttributeDescriptions = _desc.vertexAttributes.data();
+	vertexInfo.vertexAttributeDescriptionCount = static_cast<u32>(_desc.vertexAttributes.size());
+	vertexInfo.pVertexBindingDescriptions = &_desc.vertexBinding;
+	vertexInfo.vertexBindingDescriptionCount = 1;
+
+	vk::PipelineInputAssemblyStateCreateInfo assemblyInfo;
+	assemblyInfo.topology = _desc.topology;
+	assemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+	// set when recording, the pipelines do not depend on the size of the swapchain
+	vk::PipelineViewportStateCreateInfo viewportState;
+	viewportState.scissorCount = 1;
+	viewportState.viewportCount = 1;
+
+	const vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+
+	vk::PipelineDynamicStateCreateInfo dynamicInfo;
+	dynamicInfo.dynamicStateCount = 2;
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	vk::PipelineRasterizationStateCreateInfo rasterizerInfo;
+	rasterizerInfo.depthClampEnable = VK_FALSE;
+	rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+
+	rasterizerInfo.polygonMode = _desc.polygonMode;
+	rasterizerInfo.lineWidth = 1.0f;
+
+	rasterizerInfo.cullMode = _desc.cullMode;
+	rasterizerInfo.frontFace = _desc.frontFace;
+
+	rasterizerInfo.depthBiasEnable = VK_FALSE;
+
+	vk::PipelineMultisampleStateCreateInfo msaaInfo;
+	msaaInfo.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+	vk::PipelineColorBlendAttachmentState colorBlendAttachment;
+	colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+		| vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+	colorBlendAttachment.blendEnable = _desc.blend;
+	colorBlendAttachment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+	colorBlendAttachment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+	colorBlendAttachment.colorBlendOp = vk::BlendOp::eAdd;
+	colorBlendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+	colorBlendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
+	colorBlendAttachment.alphaBlendOp = vk::BlendOp::eAdd;
+
+	vk::PipelineColorBlendStateCreateInfo blendInfo;
+	blendInfo.attachmentCount = 1;
+	blendInfo.logicOpEnable = VK_FALSE;
+	blendInfo.logicOp = vk::LogicOp::eCopy;
+	blendInfo.pAttachments = &colorBlendAttachment;
+
+	vk::PipelineDepthStencilStateCreateInfo depthStencilInfo;
+	depthStencilInfo.depthTestEnable = _desc.depthTest;
+	depthStencilInfo.depthWriteEnable = _desc.depthWrite;
+	depthStencilInfo.depthCompareOp = _desc.depthCompareOp;
+	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilInfo.setStencilTestEnable(false);
+
+	vk::GraphicsPipelineCreateInfo info;
+
+	info.stageCount = 2;
+	info.pStages = shaderStages;
+
+	info.pVertexInputState = &vertexInfo;
+	info.pInputAssemblyState = &assemblyInfo;
+	info.pViewportState = &viewportState;
+	info.pRasterizationState = &rasterizerInfo;
+	info.pMultisampleState = &msaaInfo;
+	info.pDepthStencilState = &depthStencilInfo;
+	info.pColorBlendState = &blendInfo;
+	info.pDynamicState = &dynamicInfo;
+
+	info.layout = _desc.layout;
+
+	info.renderPass = _desc.renderPass;
+	info.subpass = _desc.subpass;
+
+	info.basePipelineHandle = nullptr;
+	info.basePipelineIndex = -1;
+
+	return m_device.createGraphicsPipeline(m_pipelineCache, info).value;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+using namespace glm;
+
+class ThreadPool;
+
+// everything a graphics pipeline is built from, its hash is the key of the cache
+struct PipelineDesc
+{
+	vk::ShaderModule vertexModule;
+	vk::ShaderModule fragmentModule;
+
+	vk::VertexInputBindingDescription vertexBinding;
+	std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+
+	vk::PipelineLayout layout;
+	vk::RenderPass renderPass;
+	u32 subpass = 0;
+
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+	vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone;
+	vk::FrontFace frontFace = vk::FrontFace::eCounterClockwise;
+
+	bool depthTest = true;
+	bool depthWrite = true;
+	vk::CompareOp depthCompareOp = vk::CompareOp::eLess;
+
+	bool blend = false;
+
+	[[nodiscard]] u64 Hash() const;
+	bool operator==(const PipelineDesc& _other) const;
+};
+
+// Owns every graphics pipeline, keyed by the hash of their PipelineDesc.
+// GetOrCreate() compiles on the calling thread, Request() never blocks: a missing pipeline is compiled on the
+// thread pool and nullptr is returned until it is ready, the caller draws with a fallback in the meantime.
+// The pool should not be one the frame waits on, a ParallelFor queued behind the compiles would stall until they are done.
+class PipelineStateCache
+{
+public:
+	PipelineStateCache(vk::Device _device, vk::PipelineCache _pipelineCache, ThreadPool& _threadPool);
+	~PipelineStateCache();
+
+	PipelineStateCache(const PipelineStateCache& other) = delete;
+	PipelineStateCache(PipelineStateCache&& other) = delete;
+	PipelineStateCache& operator=(const PipelineStateCache& other) = delete;
+	PipelineStateCache& operator=(PipelineStateCache&& other) = delete;
+
+	[[nodiscard]] vk::Pipeline GetOrCreate(const PipelineDesc& _desc);
+	[[nodiscard]] vk::Pipeline Request(const PipelineDesc& _desc);
+
+	// true once after pipelines requested with Request() became ready, command buffers using a fallback can be re-recorded
+	[[nodiscard]] bool ConsumeNewlyReady();
+
+	// waits for the compilations in flight and destroys every pipeline, for when the render pass or the layouts go away
+	void Clear();
+
+	[[nodiscard]] u32 GetPipelineCount();
+	[[nodiscard]] u32 GetPendingCount();
+
+private:
+	struct Entry
+	{
+		PipelineDesc desc;
+		vk::Pipeline pipeline;
+		bool isReady = false;
+	};
+
+	[[nodiscard]] vk::Pipeline Compile(const PipelineDesc& _desc) const;
+	// returns the entry of _desc, creates it if missing, the mutex has to be locked
+	Entry& FindOrAdd(const PipelineDesc& _desc, bool& _isNew);
+	void WaitPending(std::unique_lock<std::mutex>& _lock);
+
+	vk::Device m_device;
+	vk::PipelineCache m_pipelineCache;
+	ThreadPool& m_threadPool;
+
+	std::mutex m_mutex;
+	std::condition_variable m_compiled;
+
+	// several entries per hash only on collisions
+	std::unordered_map<u64, std::vector<std::unique_ptr<Entry>>> m_entries;
+	u32 m_pendingCount = 0;
+	bool m_hasNewlyReady = false;
+};
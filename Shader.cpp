@@ -4,8 +4,12 @@
 #include <iostream>
 #include <spirvReflect/spirv_reflect.h>
 
+#include "CpuProfiler.h"
+
 Shader::Shader(vk::Device _device, const char* _path)
 {
+	PROFILE_ZONE("Shader load");
+
 	const std::string baseStr = _path;
 	const std::string vertexStr = baseStr + "_vert.spv";
 	const std::string fragStr = baseStr + "_frag.spv";
@@ -17,6 +21,15 @@ Shader::Shader(vk::Device _device, const char* _path)
 	shaderModuleFrag = createModuleFromString(_device , spirvFrag);
 }
 
+vk::ShaderModule Shader::LoadComputeModule(vk::Device _logicalDevice, const char* _path)
+{
+	const std::string computeStr = std::string(_path) + "_comp.spv";
+
+	std::vector<uint8_t> spirv = readEntireFile(computeStr.c_str());
+
+	return createModuleFromString(_logicalDevice, spirv);
+}
+
 void Shader::Reflect() const
 {
 	const spv_reflect::ShaderModule module(spirvVert);
@@ -51,6 +51,9 @@ public:
 
 	void Reflect() const;
 
+	// _path + "_comp.spv", the caller destroys the module once its pipeline is created
+	static vk::ShaderModule LoadComputeModule(vk::Device _logicalDevice, const char* _path);
+
 	void SetBinding(EShaderBindgType type, uint32_t set, uint32_t binding);
 
 	vk::ShaderModule shaderModuleVert;
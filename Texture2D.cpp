@@ -1,5 +1,7 @@
 #include "Texture2D.h"
 
+#include "CpuProfiler.h"
+#include "UploadContext.h"
 #include "extern/stb/stb_image.h"
 
 Texture2D::Texture2D(Texture2D&& tex) : size(tex.size), imageMemory(tex.imageMemory), image(tex.image), sampler(tex.sampler),
@@ -9,53 +11,57 @@ Texture2D::Texture2D(Texture2D&& tex) : size(tex.size), imageMemory(tex.imageMem
 	tex.isMoved = false;
 }
 
-void Texture2D::LoadFrom(const char* _path, vk::ImageLayout _layout)
+Texture2D::DecodedImage Texture2D::Decode(const char* _path)
 {
-	path = _path;
-	this->layout = _layout;
+	PROFILE_ZONE("stbi_load");
 
 	int x, y, channels;
-	const auto data = stbi_load(_path, &x, &y, &channels, STBI_rgb_alpha);
+	stbi_uc* data = stbi_load(_path, &x, &y, &channels, STBI_rgb_alpha);
 
 	if(!data)
 	{
 		assert(0);
 	}
 
-	const vk::DeviceSize texSize = y * x * 4;
+	return { data, static_cast<u32>(x), static_cast<u32>(y) };
+}
 
-	size.width = x;
-	size.height = y;
-	size.depth = 1;
+void Texture2D::FreeDecoded(DecodedImage& _image)
+{
+	stbi_image_free(_image.pixels);
+	_image.pixels = nullptr;
+}
+
+void Texture2D::LoadFrom(const char* _path, vk::ImageLayout _layout)
+{
+	PROFILE_ZONE("Texture2D::LoadFrom");
 
-	vk::Buffer stagingBuffer;
-	vk::DeviceMemory stagingMemory;
+	DecodedImage decoded = Decode(_path);
 
-	auto* instance = VulkanContext::GraphicInstance;
-	const auto& logicalDevice = instance->GetLogicalDevice();
+	CreateFrom(_path, decoded, _layout);
 
-	instance->CreateBuffer(texSize, vk::BufferUsageFlagBits::eTransferSrc
-		, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, stagingBuffer, stagingMemory);
+	//the pixels are copied in the staging ring, we can free them right away
+	FreeDecoded(decoded);
+}
 
-	void* mappedBuffer = logicalDevice.mapMemory(stagingMemory, 0, texSize);
+void Texture2D::CreateFrom(const char* _path, const DecodedImage& _image, vk::ImageLayout _layout)
+{
+	path = _path;
+	this->layout = _layout;
 
-	assert(mappedBuffer);
+	const vk::DeviceSize texSize = static_cast<vk::DeviceSize>(_image.width) * _image.height * 4;
 
-	memcpy(mappedBuffer, data, texSize);
+	size.width = _image.width;
+	size.height = _image.height;
+	size.depth = 1;
 
-	logicalDevice.unmapMemory(stagingMemory);
-	stbi_image_free(data);
+	auto* instance = VulkanContext::GraphicInstance;
 
 	instance->CreateImage(size.width, size.height, vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal
 		, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst
 		, vk::MemoryPropertyFlagBits::eDeviceLocal, image, imageMemory);
 
-	instance->TransitionImageLayout(image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-	instance->CopyBufferToImage(stagingBuffer, image, size.width, size.height);
-	instance->TransitionImageLayout(image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
-
-	logicalDevice.destroyBuffer(stagingBuffer);
-	logicalDevice.freeMemory(stagingMemory);
+	instance->GetUploadContext().UploadImage(image, _image.pixels, texSize, size.width, size.height);
 
 	imageView = instance->CreateImageView(image, vk::Format::eR8G8B8A8Srgb);
 
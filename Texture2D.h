@@ -90,15 +90,27 @@ public:
 			auto* instance = VulkanContext::GraphicInstance;
 
 			instance->GetLogicalDevice().destroyImageView(imageView);
-			instance->GetLogicalDevice().destroyImage(image);
 			instance->GetLogicalDevice().destroySampler(sampler);
-			instance->GetLogicalDevice().freeMemory(imageMemory);
+			instance->DestroyImage(image, imageMemory);
 		}
 	}
 
 	Texture2D(Texture2D&& tex);
 
+	// rgba8 pixels, decoding is thread safe, creating the texture from them is not
+	struct DecodedImage
+	{
+		u8* pixels = nullptr;
+		u32 width = 0;
+		u32 height = 0;
+	};
+
+	[[nodiscard]] static DecodedImage Decode(const char* _path);
+	static void FreeDecoded(DecodedImage& _image);
+
 	void LoadFrom(const char* _path, vk::ImageLayout _layout);
+	// the pixels are copied in the staging ring, _image can be freed right after
+	void CreateFrom(const char* _path, const DecodedImage& _image, vk::ImageLayout _layout);
 
 	vk::ImageView& GetView() { return imageView; }
 	vk::Extent3D& GetSize() { return size; }
@@ -109,8 +121,7 @@ public:
 private:
 	vk::Extent3D size;
 
-	//vma::Allocation memory;
-	vk::DeviceMemory imageMemory;
+	vma::Allocation imageMemory;
 	vk::Image image;
 
 	vk::Sampler sampler;
@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "CpuProfiler.h"
+
+ThreadPool::ThreadPool(u32 _workerCount, const char* _name)
+	: m_name(_name)
+{
+	m_workers.reserve(_workerCount);
+
+	for (u32 i = 0; i < _workerCount; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_isStopping = true;
+	}
+
+	m_wakeUp.notify_all();
+
+	// the tasks still queued are run before the workers exit
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> _task)
+{
+	if (m_workers.empty())
+	{
+		_task();
+		return;
+	}
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_tasks.emplace_back(std::move(_task));
+	}
+
+	m_wakeUp.notify_one();
+}
+
+void ThreadPool::ParallelFor(u32 _count, const std::function<void(u32)>& _job)
+{
+	if (_count == 0)
+		return;
+
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	u32 remaining = _count - 1;
+
+	for (u32 i = 0; i < _count - 1; ++i)
+	{
+		Enqueue([&, i]
+		{
+			_job(i);
+
+			std::lock_guard lock(doneMutex);
+			if (--remaining == 0)
+			{
+				doneCondition.notify_one();
+			}
+		});
+	}
+
+	// the last one runs here instead of waiting idle
+	_job(_count - 1);
+
+	std::unique_lock lock(doneMutex);
+	doneCondition.wait(lock, [&] { return remaining == 0; });
+}
+
+u32 ThreadPool::GetHardwareThreadCount()
+{
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::WorkerLoop(u32 _index)
+{
+	CpuProfiler::SetThreadName(m_name + " " + std::to_string(_index));
+
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_wakeUp.wait(lock, [this] { return m_isStopping || !m_tasks.empty(); });
+
+			if (m_tasks.empty())
+				return;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// Fixed set of worker threads pulling tasks from one queue.
+// Enqueue() is fire and forget, ParallelFor() splits a job in _count tasks and blocks until they are all done,
+// the calling thread runs one of them itself so a pool without workers still works.
+class ThreadPool
+{
+public:
+	// _name prefixes the names of the workers in the traces
+	explicit ThreadPool(u32 _workerCount, const char* _name = "Worker");
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool(ThreadPool&& other) = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+	ThreadPool& operator=(ThreadPool&& other) = delete;
+
+	void Enqueue(std::function<void()> _task);
+
+	// calls _job(i) for every i in [0; _count[, at most GetWorkerCount() + 1 of them at the same time
+	void ParallelFor(u32 _count, const std::function<void(u32)>& _job);
+
+	[[nodiscard]] u32 GetWorkerCount() const { return static_cast<u32>(m_workers.size()); }
+
+	// hardware threads, at least 1
+	[[nodiscard]] static u32 GetHardwareThreadCount();
+
+private:
+	void WorkerLoop(u32 _index);
+
+	std::string m_name;
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	std::deque<std::function<void()>> m_tasks;
+	bool m_isStopping = false;
+};
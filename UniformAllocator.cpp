@@ -0,0 +1,69 @@
+#include "UniformAllocator.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "systems/VulkanContext.h"
+
+static vk::DeviceSize AlignUp(vk::DeviceSize _value, vk::DeviceSize _alignment)
+{
+	return (_value + _alignment - 1) & ~(_alignment - 1);
+}
+
+UniformAllocator::UniformAllocator(vk::DeviceSize _regionSize, u32 _regionCount, vk::DeviceSize _minAlignment)
+	: m_regionCount(_regionCount), m_alignment(_minAlignment)
+{
+	// the spec guarantees minUniformBufferOffsetAlignment is a power of two
+	assert((m_alignment & (m_alignment - 1)) == 0);
+
+	// every region has to start on an aligned offset too
+	m_regionSize = AlignUp(_regionSize, m_alignment);
+
+	VulkanContext::GraphicInstance->CreateBuffer(m_regionSize * m_regionCount, vk::BufferUsageFlagBits::eUniformBuffer
+		, EMemoryPool::Dynamic, m_buffer, m_allocation);
+
+	// kept mapped for the whole life of the allocator
+	m_data = static_cast<u8*>(VulkanContext::s_allocator.mapMemory(m_allocation));
+}
+
+UniformAllocator::~UniformAllocator()
+{
+	VulkanContext::s_allocator.unmapMemory(m_allocation);
+	VulkanContext::GraphicInstance->DestroyBuffer(m_buffer, m_allocation);
+}
+
+void UniformAllocator::BeginFrame(u32 _regionIndex)
+{
+	assert(_regionIndex < m_regionCount);
+
+	m_regionStart = m_regionSize * _regionIndex;
+	m_offset = m_regionStart;
+}
+
+void UniformAllocator::EndFrame()
+{
+	if (m_offset > m_regionStart)
+	{
+		VulkanContext::s_allocator.flushAllocation(m_allocation, m_regionStart, m_offset - m_regionStart);
+	}
+}
+
+bool UniformAllocator::Push(const void* _data, vk::DeviceSize _size, u32& _offset)
+{
+	const vk::DeviceSize offset = m_offset;
+
+	// the descriptors point at this buffer, growing it would mean writing them again mid frame
+	if (offset + _size > m_regionStart + m_regionSize)
+	{
+		std::cout << "[UniformAllocator] " << _size << " bytes don't fit, " << GetUsedBytes() << " / " << m_regionSize << " used in the region" << std::endl;
+		return false;
+	}
+
+	memcpy(m_data + offset, _data, _size);
+
+	m_offset = AlignUp(offset + _size, m_alignment);
+	_offset = static_cast<u32>(offset);
+
+	return true;
+}
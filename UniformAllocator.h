@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "vma/vk_mem_alloc.hpp"
+
+using namespace glm;
+
+// One persistently mapped uniform buffer split in regions, one per frame in flight or per swapchain image.
+// Each frame a region is reset and filled linearly, the returned offsets are meant to be used as dynamic offsets
+// of an eUniformBufferDynamic descriptor pointing at GetBuffer().
+// The caller guarantees the gpu is done with a region before calling BeginFrame() on it again.
+class UniformAllocator
+{
+public:
+	UniformAllocator(vk::DeviceSize _regionSize, u32 _regionCount, vk::DeviceSize _minAlignment);
+	~UniformAllocator();
+
+	UniformAllocator(const UniformAllocator& other) = delete;
+	UniformAllocator(UniformAllocator&& other) = delete;
+	UniformAllocator& operator=(const UniformAllocator& other) = delete;
+	UniformAllocator& operator=(UniformAllocator&& other) = delete;
+
+	void BeginFrame(u32 _regionIndex);
+	// makes the writes of the frame visible to the gpu, does nothing on coherent memory
+	void EndFrame();
+
+	// copies _data in the current region, _offset is its dynamic offset
+	// false when the region is full, nothing is written then, the region does not grow
+	[[nodiscard]] bool Push(const void* _data, vk::DeviceSize _size, u32& _offset);
+
+	template<typename T>
+	[[nodiscard]] bool Push(const T& _data, u32& _offset) { return Push(&_data, sizeof(T), _offset); }
+
+	[[nodiscard]] vk::Buffer GetBuffer() const { return m_buffer; }
+	[[nodiscard]] vk::DeviceSize GetUsedBytes() const { return m_offset - m_regionStart; }
+	[[nodiscard]] vk::DeviceSize GetRegionSize() const { return m_regionSize; }
+	[[nodiscard]] u32 GetRegionCount() const { return m_regionCount; }
+
+private:
+	vk::Buffer m_buffer;
+	vma::Allocation m_allocation;
+	u8* m_data = nullptr;
+
+	vk::DeviceSize m_regionSize;
+	u32 m_regionCount;
+	vk::DeviceSize m_alignment;
+
+	vk::DeviceSize m_regionStart = 0;
+	vk::DeviceSize m_offset = 0;
+};
@@ -0,0 +1,466 @@
+#include "UploadContext.h"
+
+#include <cassert>
+
+#include "systems/VulkanContext.h"
+
+// covers both buffer copies and image copies (4 bytes texels)
+static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+static vk::DeviceSize AlignUp(vk::DeviceSize _value, vk::DeviceSize _alignment)
+{
+	return (_value + _alignment - 1) & ~(_alignment - 1);
+}
+
+static vk::ImageSubresourceRange GetColorSubresourceRange()
+{
+	vk::ImageSubresourceRange range;
+	range.aspectMask = vk::ImageAspectFlagBits::eColor;
+	range.baseArrayLayer = 0;
+	range.baseMipLevel = 0;
+	range.layerCount = 1;
+	range.levelCount = 1;
+
+	return range;
+}
+
+UploadContext::UploadContext(vk::Device _device, const QueueInfo& _transfer, const QueueInfo& _graphics, vk::DeviceSize _ringSize)
+	: m_device(_device), m_transfer(_transfer), m_graphics(_graphics), m_ringSize(_ringSize)
+{
+	vk::SemaphoreTypeCreateInfo timelineInfo;
+	timelineInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+	timelineInfo.initialValue = m_timelineValue;
+
+	vk::SemaphoreCreateInfo semaphoreInfo;
+	semaphoreInfo.pNext = &timelineInfo;
+
+	m_timeline = m_device.createSemaphore(semaphoreInfo);
+
+	if (IsUsingDedicatedQueue())
+	{
+		vk::CommandBufferAllocateInfo allocInfo;
+		allocInfo.commandPool = m_graphics.commandPool;
+		allocInfo.commandBufferCount = MAX_ACQUIRE_FRAMES;
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+
+		const auto cmds = m_device.allocateCommandBuffers(allocInfo);
+		std::copy(cmds.begin(), cmds.end(), m_acquireCommandBuffers.begin());
+	}
+
+	VulkanContext::GraphicInstance->CreateBuffer(m_ringSize, vk::BufferUsageFlagBits::eTransferSrc, EMemoryPool::Staging, m_ringBuffer, m_ringAllocation);
+
+	// kept mapped for the whole life of the context
+	m_ringData = static_cast<u8*>(VulkanContext::s_allocator.mapMemory(m_ringAllocation));
+}
+
+UploadContext::~UploadContext()
+{
+	WaitIdle();
+
+	for (auto& batch : m_freeBatches)
+	{
+		m_device.freeCommandBuffers(m_transfer.commandPool, batch.cmd);
+	}
+
+	if (IsUsingDedicatedQueue())
+	{
+		m_device.freeCommandBuffers(m_graphics.commandPool, m_acquireCommandBuffers);
+	}
+
+	m_device.destroySemaphore(m_timeline);
+
+	VulkanContext::s_allocator.unmapMemory(m_ringAllocation);
+	VulkanContext::GraphicInstance->DestroyBuffer(m_ringBuffer, m_ringAllocation);
+}
+
+UploadContext::BufferReservation UploadContext::ReserveBuffer(vk::Buffer _dst, vk::DeviceSize _size, vk::DeviceSize _dstOffset)
+{
+	assert(!m_isReserving && "the previous reservation was not committed");
+
+	BufferReservation reservation;
+	reservation.staging = Reserve(_size, STAGING_ALIGNMENT);
+	reservation.size = _size;
+	reservation.dst = _dst;
+	reservation.dstOffset = _dstOffset;
+
+	m_isReserving = true;
+
+	return reservation;
+}
+
+void UploadContext::CommitBuffer(const BufferReservation& _reservation)
+{
+	assert(m_isReserving && "nothing was reserved");
+
+	m_isReserving = false;
+
+	EndWrite(_reservation.staging);
+
+	vk::BufferCopy copy;
+	copy.srcOffset = _reservation.staging.offset;
+	copy.dstOffset = _reservation.dstOffset;
+	copy.size = _reservation.size;
+
+	GetCommandBuffer().copyBuffer(_reservation.staging.buffer, _reservation.dst, copy);
+
+	if (IsUsingDedicatedQueue())
+	{
+		vk::BufferMemoryBarrier release;
+		release.buffer = _reservation.dst;
+		release.offset = _reservation.dstOffset;
+		release.size = _reservation.size;
+		release.srcQueueFamilyIndex = m_transfer.family;
+		release.dstQueueFamilyIndex = m_graphics.family;
+		release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		release.dstAccessMask = vk::AccessFlags(); // ignored on the release side
+
+		m_recordingBufferReleases.emplace_back(release);
+	}
+}
+
+void UploadContext::UploadBuffer(vk::Buffer _dst, const void* _data, vk::DeviceSize _size, vk::DeviceSize _dstOffset)
+{
+	const BufferReservation reservation = ReserveBuffer(_dst, _size, _dstOffset);
+
+	memcpy(reservation.GetData(), _data, _size);
+
+	CommitBuffer(reservation);
+}
+
+void UploadContext::UploadImage(vk::Image _dst, const void* _data, vk::DeviceSize _size, u32 _width, u32 _height)
+{
+	assert(!m_isReserving && "a reservation is not committed");
+
+	const StagingRegion staging = Reserve(_size, STAGING_ALIGNMENT);
+
+	memcpy(staging.data, _data, _size);
+	EndWrite(staging);
+
+	auto& cmd = GetCommandBuffer();
+
+	vk::ImageMemoryBarrier barrier;
+	barrier.image = _dst;
+	barrier.oldLayout = vk::ImageLayout::eUndefined;
+	barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcAccessMask = vk::AccessFlagBits::eNoneKHR;
+	barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+	barrier.subresourceRange = GetColorSubresourceRange();
+
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer
+		, vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+	vk::BufferImageCopy copyInfo;
+	copyInfo.bufferOffset = staging.offset;
+	copyInfo.bufferRowLength = 0;
+	copyInfo.bufferImageHeight = 0;
+
+	copyInfo.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+	copyInfo.imageSubresource.baseArrayLayer = 0;
+	copyInfo.imageSubresource.layerCount = 1;
+	copyInfo.imageSubresource.mipLevel = 0;
+
+	copyInfo.imageExtent = vk::Extent3D(_width, _height, 1);
+	copyInfo.imageOffset = vk::Offset3D(0, 0, 0);
+
+	cmd.copyBufferToImage(staging.buffer, _dst, vk::ImageLayout::eTransferDstOptimal, copyInfo);
+
+	barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+	barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+
+	if (IsUsingDedicatedQueue())
+	{
+		// the layout transition is done by the release/acquire pair, both have to describe it
+		barrier.srcQueueFamilyIndex = m_transfer.family;
+		barrier.dstQueueFamilyIndex = m_graphics.family;
+		barrier.dstAccessMask = vk::AccessFlags();
+
+		m_recordingImageReleases.emplace_back(barrier);
+	}
+	else
+	{
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader
+			, vk::DependencyFlags(), nullptr, nullptr, barrier);
+	}
+}
+
+void UploadContext::Flush()
+{
+	// the ring space of the reservation could be given back while it is being written
+	assert(!m_isReserving && "a reservation is not committed");
+
+	// give back the ring space of what is already done
+	while (RetireOldestBatch(false)) {}
+
+	if (!m_isRecording)
+		return;
+
+	if (IsUsingDedicatedQueue())
+	{
+		m_recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe
+			, vk::DependencyFlags(), nullptr, m_recordingBufferReleases, m_recordingImageReleases);
+
+		// the acquire side is the same barrier, with the access of the graphics queue
+		for (auto& release : m_recordingBufferReleases)
+		{
+			release.srcAccessMask = vk::AccessFlags();
+			release.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead;
+			m_pendingBufferAcquires.emplace_back(release);
+		}
+
+		for (auto& release : m_recordingImageReleases)
+		{
+			release.srcAccessMask = vk::AccessFlags();
+			release.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+			m_pendingImageAcquires.emplace_back(release);
+		}
+
+		m_recordingBufferReleases.clear();
+		m_recordingImageReleases.clear();
+	}
+	else
+	{
+		// same queue: makes the copies visible to everything submitted after us
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead
+			| vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead;
+
+		m_recording.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, GetAcquireWaitStages()
+			, vk::DependencyFlags(), barrier, nullptr, nullptr);
+	}
+
+	m_recording.cmd.end();
+
+	m_recording.timelineValue = ++m_timelineValue;
+
+	vk::TimelineSemaphoreSubmitInfo timelineSubmit;
+	timelineSubmit.signalSemaphoreValueCount = 1;
+	timelineSubmit.pSignalSemaphoreValues = &m_recording.timelineValue;
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.pNext = &timelineSubmit;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_recording.cmd;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_timeline;
+
+	m_transfer.queue.submit(submitInfo);
+
+	if (IsUsingDedicatedQueue())
+		m_pendingAcquireValue = m_recording.timelineValue;
+
+	m_recording.ringEnd = m_head;
+	m_inFlight.emplace_back(std::move(m_recording));
+
+	m_recording = Batch();
+	m_isRecording = false;
+
+	++m_submitCount;
+}
+
+void UploadContext::WaitIdle()
+{
+	Flush();
+
+	while (RetireOldestBatch(true)) {}
+}
+
+bool UploadContext::RecordPendingAcquires(u32 _frameIndex, vk::CommandBuffer& _cmd, u64& _waitValue)
+{
+	if (m_pendingBufferAcquires.empty() && m_pendingImageAcquires.empty())
+		return false;
+
+	_cmd = m_acquireCommandBuffers[_frameIndex % MAX_ACQUIRE_FRAMES];
+	_cmd.reset();
+
+	vk::CommandBufferBeginInfo beginInfo;
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+	_cmd.begin(beginInfo);
+
+	// the semaphore wait is done at these stages, chaining with the barrier
+	_cmd.pipelineBarrier(GetAcquireWaitStages(), GetAcquireWaitStages()
+		, vk::DependencyFlags(), nullptr, m_pendingBufferAcquires, m_pendingImageAcquires);
+
+	_cmd.end();
+
+	_waitValue = m_pendingAcquireValue;
+
+	m_pendingBufferAcquires.clear();
+	m_pendingImageAcquires.clear();
+
+	return true;
+}
+
+vk::PipelineStageFlags UploadContext::GetAcquireWaitStages()
+{
+	return vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+}
+
+vk::DeviceSize UploadContext::Allocate(vk::DeviceSize _size, vk::DeviceSize _alignment)
+{
+	vk::DeviceSize offset = 0;
+
+	while (!TryAllocate(_size, _alignment, offset))
+	{
+		// the ring is full, submit what we have and wait for the oldest copies to be done
+		Flush();
+
+		if (!RetireOldestBatch(true))
+		{
+			// nothing is in use anymore
+			m_head = m_tail = 0;
+		}
+	}
+
+	return offset;
+}
+
+bool UploadContext::TryAllocate(vk::DeviceSize _size, vk::DeviceSize _alignment, vk::DeviceSize& _offset)
+{
+	const vk::DeviceSize aligned = AlignUp(m_head, _alignment);
+
+	//head == tail is always an empty ring, the free space is [head; end[ and [0; tail[
+	if (m_head >= m_tail)
+	{
+		if (aligned + _size <= m_ringSize)
+		{
+			_offset = aligned;
+			m_head = aligned + _size;
+			return true;
+		}
+
+		// wrap around, the end of the ring is wasted until the tail goes past it
+		if (_size < m_tail)
+		{
+			_offset = 0;
+			m_head = _size;
+			return true;
+		}
+
+		return false;
+	}
+
+	// strictly lower, to never end up with head == tail on a full ring
+	if (aligned + _size < m_tail)
+	{
+		_offset = aligned;
+		m_head = aligned + _size;
+		return true;
+	}
+
+	return false;
+}
+
+UploadContext::StagingRegion UploadContext::Reserve(vk::DeviceSize _size, vk::DeviceSize _alignment)
+{
+	m_uploadedBytes += _size;
+
+	StagingRegion region;
+
+	if (_size >= m_ringSize)
+	{
+		// too big for the ring, a dedicated staging buffer lives as long as the batch
+		VulkanContext::GraphicInstance->CreateBuffer(_size, vk::BufferUsageFlagBits::eTransferSrc, EMemoryPool::Staging, region.buffer, region.temporaryAllocation);
+
+		region.data = static_cast<u8*>(VulkanContext::s_allocator.mapMemory(region.temporaryAllocation));
+
+		GetCommandBuffer();
+		m_recording.temporaryBuffers.emplace_back(region.buffer, region.temporaryAllocation);
+
+		return region;
+	}
+
+	region.buffer = m_ringBuffer;
+	region.offset = Allocate(_size, _alignment);
+	region.data = m_ringData + region.offset;
+
+	return region;
+}
+
+void UploadContext::EndWrite(const StagingRegion& _region) const
+{
+	// the ring stays mapped
+	if (_region.buffer != m_ringBuffer)
+	{
+		VulkanContext::s_allocator.unmapMemory(_region.temporaryAllocation);
+	}
+}
+
+vk::CommandBuffer& UploadContext::GetCommandBuffer()
+{
+	if (m_isRecording)
+		return m_recording.cmd;
+
+	if (!m_freeBatches.empty())
+	{
+		m_recording = std::move(m_freeBatches.back());
+		m_freeBatches.pop_back();
+
+		m_recording.cmd.reset();
+	}
+	else
+	{
+		vk::CommandBufferAllocateInfo allocInfo;
+		allocInfo.commandPool = m_transfer.commandPool;
+		allocInfo.commandBufferCount = 1;
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+
+		m_recording.cmd = m_device.allocateCommandBuffers(allocInfo)[0];
+	}
+
+	vk::CommandBufferBeginInfo beginInfo;
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+	m_recording.cmd.begin(beginInfo);
+	m_isRecording = true;
+
+	return m_recording.cmd;
+}
+
+bool UploadContext::RetireOldestBatch(bool _wait)
+{
+	if (m_inFlight.empty())
+		return false;
+
+	auto& batch = m_inFlight.front();
+
+	if (_wait)
+	{
+		vk::SemaphoreWaitInfo waitInfo;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &m_timeline;
+		waitInfo.pValues = &batch.timelineValue;
+
+		const auto res = m_device.waitSemaphores(waitInfo, UINT64_MAX);
+		assert(res == vk::Result::eSuccess);
+	}
+	else if (m_device.getSemaphoreCounterValue(m_timeline) < batch.timelineValue)
+	{
+		return false;
+	}
+
+	m_tail = batch.ringEnd;
+
+	ReleaseBatch(batch);
+	m_inFlight.pop_front();
+
+	return true;
+}
+
+void UploadContext::ReleaseBatch(Batch& _batch)
+{
+	for (auto& [buffer, allocation] : _batch.temporaryBuffers)
+	{
+		VulkanContext::GraphicInstance->DestroyBuffer(buffer, allocation);
+	}
+
+	_batch.temporaryBuffers.clear();
+
+	m_freeBatches.emplace_back(std::move(_batch));
+}
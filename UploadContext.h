@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "vma/vk_mem_alloc.hpp"
+
+using namespace glm;
+
+// Batches cpu -> gpu copies through one persistently mapped staging ring.
+// Copies are recorded in a single command buffer and only submitted on Flush() (or when the ring is full),
+// each submit signals a timeline semaphore so the ring space can be reused once the gpu is done with it.
+// When the device has a dedicated transfer family, the copies run on the transfer queue and the resources
+// are released to the graphics family, the matching acquire barriers are recorded by RecordPendingAcquires().
+class UploadContext
+{
+public:
+	struct QueueInfo
+	{
+		vk::Queue queue;
+		vk::CommandPool commandPool; // must be resettable
+		u32 family;
+	};
+
+	UploadContext(vk::Device _device, const QueueInfo& _transfer, const QueueInfo& _graphics, vk::DeviceSize _ringSize);
+	~UploadContext();
+
+	UploadContext(const UploadContext& other) = delete;
+	UploadContext(UploadContext&& other) = delete;
+	UploadContext& operator=(const UploadContext& other) = delete;
+	UploadContext& operator=(UploadContext&& other) = delete;
+
+	// staging memory, in the ring or in a temporary buffer when it does not fit
+	struct StagingRegion
+	{
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		u8* data = nullptr;
+		vma::Allocation temporaryAllocation; // only for a temporary buffer, mapped until the write ends
+	};
+
+	// A buffer copy whose source is written in place by the caller: the data is produced straight in staging memory
+	// instead of in a cpu array copied afterwards. The copy is only recorded by CommitBuffer().
+	// One reservation at a time, nothing else can be uploaded or flushed until it is committed.
+	struct BufferReservation
+	{
+		StagingRegion staging;
+		vk::DeviceSize size = 0;
+
+		vk::Buffer dst;
+		vk::DeviceSize dstOffset = 0;
+
+		[[nodiscard]] u8* GetData() const { return staging.data; }
+	};
+
+	[[nodiscard]] BufferReservation ReserveBuffer(vk::Buffer _dst, vk::DeviceSize _size, vk::DeviceSize _dstOffset = 0);
+	void CommitBuffer(const BufferReservation& _reservation);
+
+	void UploadBuffer(vk::Buffer _dst, const void* _data, vk::DeviceSize _size, vk::DeviceSize _dstOffset = 0);
+	// the image ends up in eShaderReadOnlyOptimal
+	void UploadImage(vk::Image _dst, const void* _data, vk::DeviceSize _size, u32 _width, u32 _height);
+
+	// submits the pending copies without waiting for them
+	void Flush();
+	// flushes and blocks until every submitted copy is done
+	void WaitIdle();
+
+	// Records the acquire side of the ownership transfers flushed since the last call.
+	// The command buffer has to be submitted on the graphics queue, waiting on GetTimelineSemaphore() >= _waitValue at GetAcquireWaitStages().
+	// _frameIndex selects the command buffer to re-record, the caller guarantees the previous submit of this frame is done.
+	[[nodiscard]] bool RecordPendingAcquires(u32 _frameIndex, vk::CommandBuffer& _cmd, u64& _waitValue);
+
+	[[nodiscard]] vk::Semaphore GetTimelineSemaphore() const { return m_timeline; }
+	[[nodiscard]] static vk::PipelineStageFlags GetAcquireWaitStages();
+
+	[[nodiscard]] bool IsUsingDedicatedQueue() const { return m_transfer.family != m_graphics.family; }
+	[[nodiscard]] u32 GetSubmitCount() const { return m_submitCount; }
+	[[nodiscard]] vk::DeviceSize GetUploadedBytes() const { return m_uploadedBytes; }
+
+	static constexpr u32 MAX_ACQUIRE_FRAMES = 3;
+
+private:
+	struct Batch
+	{
+		vk::CommandBuffer cmd;
+		u64 timelineValue = 0;
+		vk::DeviceSize ringEnd = 0;
+
+		// used for uploads too big to fit in the ring, destroyed with the batch
+		std::vector<std::pair<vk::Buffer, vma::Allocation>> temporaryBuffers;
+	};
+
+	// returns the offset in the ring where _size bytes can be written
+	[[nodiscard]] vk::DeviceSize Allocate(vk::DeviceSize _size, vk::DeviceSize _alignment);
+	[[nodiscard]] bool TryAllocate(vk::DeviceSize _size, vk::DeviceSize _alignment, vk::DeviceSize& _offset);
+
+	// _size bytes of staging memory to write in, EndWrite() once they are written
+	[[nodiscard]] StagingRegion Reserve(vk::DeviceSize _size, vk::DeviceSize _alignment);
+	void EndWrite(const StagingRegion& _region) const;
+
+	vk::CommandBuffer& GetCommandBuffer();
+	[[nodiscard]] bool RetireOldestBatch(bool _wait);
+	void ReleaseBatch(Batch& _batch);
+
+	vk::Device m_device;
+
+	QueueInfo m_transfer;
+	QueueInfo m_graphics;
+
+	vk::Semaphore m_timeline;
+	u64 m_timelineValue = 0;
+
+	vk::Buffer m_ringBuffer;
+	vma::Allocation m_ringAllocation;
+	u8* m_ringData = nullptr;
+	vk::DeviceSize m_ringSize;
+
+	// [tail; head[ is in use, by the recording batch or by the gpu
+	vk::DeviceSize m_head = 0;
+	vk::DeviceSize m_tail = 0;
+
+	Batch m_recording;
+	bool m_isRecording = false;
+	bool m_isReserving = false;
+
+	std::deque<Batch> m_inFlight;
+	std::vector<Batch> m_freeBatches;
+
+	// ownership transfers released on the transfer queue, waiting to be acquired on the graphics one
+	std::vector<vk::BufferMemoryBarrier> m_pendingBufferAcquires;
+	std::vector<vk::ImageMemoryBarrier> m_pendingImageAcquires;
+	// the value to wait for before acquiring the pending barriers
+	u64 m_pendingAcquireValue = 0;
+
+	// release barriers recorded in the current batch
+	std::vector<vk::BufferMemoryBarrier> m_recordingBufferReleases;
+	std::vector<vk::ImageMemoryBarrier> m_recordingImageReleases;
+
+	std::array<vk::CommandBuffer, MAX_ACQUIRE_FRAMES> m_acquireCommandBuffers;
+
+	u32 m_submitCount = 0;
+	vk::DeviceSize m_uploadedBytes = 0;
+};
@@ -3,6 +3,8 @@
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.hpp>
 
+#include "GeometryArena.h"
+
 using namespace glm;
 
 struct Attribute
@@ -34,8 +36,7 @@ public:
 	{
 		delete[] m_data;
 
-		VulkanContext::GraphicInstance->GetLogicalDevice().destroyBuffer(buffer);
-		VulkanContext::GraphicInstance->GetLogicalDevice().freeMemory(memory);
+		VulkanContext::GraphicInstance->DestroyBuffer(buffer, memory);
 	}
 
 	[[nodiscard]] void const* GetData() const
@@ -108,15 +109,22 @@ public:
 
 protected:
 	std::vector<Attribute> m_attributes;
-	u8* m_data;
-	uint nbOfElements;
+	u8* m_data = nullptr; // cpu copy, only when it is asked for
+	uint nbOfElements = 0;
 
 	vk::Buffer buffer;
-	vk::DeviceMemory memory;
+	vma::Allocation memory;
 };
 
 struct MeshVertexDecl : VerticesDeclarations
 {
+	// chosen per mesh descriptor ("vertexFormat": "full" or "packed")
+	enum class Format
+	{
+		Full,
+		Packed
+	};
+
 	struct Decl
 	{
 		vec3 pos;
@@ -126,8 +134,98 @@ struct MeshVertexDecl : VerticesDeclarations
 		vec3 bitangent;
 	};
 
-	MeshVertexDecl(std::vector<Decl>&& _decls)
+	// 20 bytes instead of 56, decoded by MeshPacked.glsl
+	struct PackedDecl
+	{
+		u16 pos[4]; // unorm in the bounds of the submesh (DrawData), w is the handedness of the tangent frame (0 or 1)
+		i16 normal[2]; // snorm octahedral
+		i16 tangent[2]; // snorm octahedral, the bitangent is rebuilt from the normal, the tangent and the handedness
+		u16 uv[2]; // half
+	};
+
+	static_assert(sizeof(PackedDecl) == 20, "PackedDecl has to match its attributes");
+
+	[[nodiscard]] static u32 GetStride(Format _format)
+	{
+		return _format == Format::Packed ? sizeof(PackedDecl) : sizeof(Decl);
+	}
+
+	// _decls are dropped once uploaded, unless _keepCpuCopy asks for them (GetData())
+	MeshVertexDecl(std::vector<Decl>&& _decls, bool _keepCpuCopy = false)
+	{
+		AddAttributes(Format::Full);
+
+		nbOfElements = _decls.size();
+
+		const vk::DeviceSize size = sizeof(Decl) * _decls.size();
+
+		AllocateInArena(_decls.data(), size);
+
+		if (_keepCpuCopy)
+		{
+			m_data = new u8[size];
+			memcpy(m_data, _decls.data(), size);
+		}
+
+		_decls.clear();
+		_decls.shrink_to_fit();
+	};
+
+	// uploaded straight from _decls (a mapped file for example), no cpu copy is kept
+	// _decls are Decl or PackedDecl depending on _format
+	MeshVertexDecl(const void* _decls, u32 _count, Format _format)
+	{
+		AddAttributes(_format);
+
+		nbOfElements = _count;
+
+		AllocateInArena(_decls, static_cast<vk::DeviceSize>(_count) * GetStride(_format));
+	}
+
+	~MeshVertexDecl()
 	{
+		VulkanContext::GraphicInstance->GetGeometryArena().FreeVertices(m_range);
+
+		//the buffer is the arena's one
+		buffer = nullptr;
+	}
+
+	// vertexOffset of the draws, GetBuffer() is shared with every other mesh
+	[[nodiscard]] u32 GetFirstVertex() const { return static_cast<u32>(m_range.offset / GetByteSize()); }
+	// false when the arena was full, the range is empty and must not be drawn
+	[[nodiscard]] bool IsAllocated() const { return m_isAllocated; }
+
+private:
+	void AllocateInArena(const void* _decls, vk::DeviceSize _size)
+	{
+		GeometryArena& arena = VulkanContext::GraphicInstance->GetGeometryArena();
+
+		//the arena logs it, the owner checks IsAllocated()
+		m_isAllocated = arena.AllocateVertices(_size, GetByteSize()
+			, [_decls, _size](void* _dst) { memcpy(_dst, _decls, _size); }, m_range);
+
+		buffer = arena.GetVertexBuffer();
+	}
+
+	GeometryArena::Range m_range;
+	bool m_isAllocated = false;
+
+	void AddAttributes(Format _format)
+	{
+		if (_format == Format::Packed)
+		{
+			//position + handedness
+			addAttribute({ sizeof(u16), 4, vk::Format::eR16G16B16A16Unorm, "position" });
+
+			addAttribute({ sizeof(i16), 2, vk::Format::eR16G16Snorm, "normal" });
+
+			addAttribute({ sizeof(i16), 2, vk::Format::eR16G16Snorm, "tangent" });
+
+			addAttribute({ sizeof(u16), 2, vk::Format::eR16G16Sfloat, "uv" });
+
+			return;
+		}
+
 		//position
 		addAttribute({sizeof(float), 3, vk::Format::eR32G32B32Sfloat, "position" });
 
@@ -140,18 +238,7 @@ struct MeshVertexDecl : VerticesDeclarations
 		addAttribute({ sizeof(float), 3, vk::Format::eR32G32B32Sfloat, "tangent" });
 
 		addAttribute({ sizeof(float), 3, vk::Format::eR32G32B32Sfloat, "bitangent" });
-
-		m_data = new u8[4 * sizeof(Decl) * _decls.size()]; // u8 == 1 byte, so 4 == u32
-
-		nbOfElements = _decls.size();
-
-		memcpy(m_data, _decls.data(), sizeof(Decl) * _decls.size());
-
-		const auto [buff, mem] = VulkanContext::GraphicInstance->CreateVertexBuffer(*this);
-
-		buffer = buff;
-		memory = mem;
-	};
+	}
 };
 
 struct TriangleVertexDecl : VerticesDeclarations
@@ -175,7 +262,7 @@ struct TriangleVertexDecl : VerticesDeclarations
 		addAttribute({ sizeof(float), 2, vk::Format::eR32G32Sfloat, "uv"});
 
 
-		m_data = new u8[4 * sizeof(Decl) * _decls.size()]; // u8 == 1 byte, so 4 == u32
+		m_data = new u8[sizeof(Decl) * _decls.size()];
 
 		nbOfElements = _decls.size();
 
@@ -0,0 +1,165 @@
+#version 450
+#ifdef COMPUTE_SHADER
+
+// CULL_GROUP_SIZE in GpuCulling.cpp, one draw per invocation
+layout(local_size_x = 64) in;
+
+// MAX_DRAW_GROUPS in GpuCulling.h
+#define MAX_DRAW_GROUPS 64
+
+// DrawData of DrawBatcher.h
+struct DrawData {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsExtent;
+    uint materialIndex;
+    uint groupIndex;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, binding = 0) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+layout(std430, binding = 1) readonly buffer CandidateBuffer {
+    DrawCommand candidates[];
+};
+
+layout(std430, binding = 2) writeonly buffer VisibleBuffer {
+    DrawCommand visible[];
+};
+
+// cleared before every dispatch
+layout(std430, binding = 3) buffer CounterBuffer {
+    uint groupCounts[MAX_DRAW_GROUPS];
+    uint visibleCount;
+    uint frustumCulledCount;
+    uint occlusionCulledCount;
+};
+
+layout(binding = 4) uniform CullUniforms {
+    mat4 viewProj;
+    mat4 previousViewProj;
+    vec2 pyramidSize;
+    uint drawCount;
+    uint useOcclusion;
+    uvec4 groupFirstDraws[MAX_DRAW_GROUPS / 4];
+} cull;
+
+// max reduction, one fetch gives the farthest depth of the 2x2 texels around it
+layout(binding = 5) uniform sampler2D depthPyramid;
+
+vec3 GetCorner(vec3 boundsMin, vec3 boundsMax, uint i)
+{
+    return mix(boundsMin, boundsMax, vec3(i & 1u, (i >> 1) & 1u, (i >> 2) & 1u));
+}
+
+bool IsInFrustum(mat4 modelViewProj, vec3 boundsMin, vec3 boundsMax)
+{
+    // one bit per plane, the box is out when all its corners are behind the same plane
+    uint outside = 0x3fu;
+
+    for (uint i = 0; i < 8; ++i)
+    {
+        vec4 clip = modelViewProj * vec4(GetCorner(boundsMin, boundsMax, i), 1.0);
+
+        uint planes = 0u;
+        planes |= clip.x < -clip.w ? 1u : 0u;
+        planes |= clip.x > clip.w ? 2u : 0u;
+        planes |= clip.y < -clip.w ? 4u : 0u;
+        planes |= clip.y > clip.w ? 8u : 0u;
+        planes |= clip.z < 0.0 ? 16u : 0u;
+        planes |= clip.z > clip.w ? 32u : 0u;
+
+        outside &= planes;
+    }
+
+    return outside == 0u;
+}
+
+// against the depth of the previous frame, seen from its camera
+bool IsOccluded(mat4 modelViewProj, vec3 boundsMin, vec3 boundsMax)
+{
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearestDepth = 1.0;
+
+    for (uint i = 0; i < 8; ++i)
+    {
+        vec4 clip = modelViewProj * vec4(GetCorner(boundsMin, boundsMax, i), 1.0);
+
+        // goes behind the camera, there is no rectangle to test
+        if (clip.w <= 0.0)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+
+    // off screen last frame, nothing was drawn there to hide it
+    if (any(greaterThan(uvMin, vec2(1.0))) || any(lessThan(uvMax, vec2(0.0))))
+        return false;
+
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    // the level where the box is at most one texel wide, the 2x2 footprint of the fetch covers it whatever its position
+    vec2 size = (uvMax - uvMin) * cull.pyramidSize;
+    float level = ceil(log2(max(max(size.x, size.y), 1.0)));
+
+    float farthestDepth = textureLod(depthPyramid, (uvMin + uvMax) * 0.5, level).x;
+
+    return nearestDepth > farthestDepth;
+}
+
+void main()
+{
+    uint drawIndex = gl_GlobalInvocationID.x;
+
+    if (drawIndex >= cull.drawCount)
+        return;
+
+    DrawData draw = draws[drawIndex];
+    vec3 boundsMin = draw.boundsMin.xyz;
+    vec3 boundsMax = draw.boundsMin.xyz + draw.boundsExtent.xyz;
+
+    // already out of the frustum on the cpu, it only keeps its place in the group
+    if (candidates[drawIndex].instanceCount == 0u)
+    {
+        atomicAdd(frustumCulledCount, 1u);
+        return;
+    }
+
+    if (!IsInFrustum(cull.viewProj * draw.model, boundsMin, boundsMax))
+    {
+        atomicAdd(frustumCulledCount, 1u);
+        return;
+    }
+
+    if (cull.useOcclusion != 0u && IsOccluded(cull.previousViewProj * draw.model, boundsMin, boundsMax))
+    {
+        atomicAdd(occlusionCulledCount, 1u);
+        return;
+    }
+
+    atomicAdd(visibleCount, 1u);
+
+    // packed at the start of the range of its group, the graphics queue draws groupCounts of them
+    uint slot = atomicAdd(groupCounts[draw.groupIndex], 1u);
+    uint groupFirstDraw = cull.groupFirstDraws[draw.groupIndex / 4u][draw.groupIndex % 4u];
+
+    // the firstInstance still points at the draw data
+    visible[groupFirstDraw + slot] = candidates[drawIndex];
+}
+#endif
@@ -0,0 +1,28 @@
+#version 450
+#ifdef COMPUTE_SHADER
+
+// PYRAMID_GROUP_SIZE in GpuCulling.cpp, one texel per invocation
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// the depth for the first level, the previous level otherwise, with a max reduction sampler
+layout(binding = 0) uniform sampler2D source;
+layout(binding = 1, r32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform Level {
+    vec2 outputSize;
+} level;
+
+void main()
+{
+    uvec2 texel = gl_GlobalInvocationID.xy;
+
+    if (any(greaterThanEqual(vec2(texel), level.outputSize)))
+        return;
+
+    // the center of the texel is at the corner of the 2x2 source texels it covers, the linear fetch keeps the farthest
+    // the first level is up to twice smaller than the depth, not a power of two, it can miss a bit of the edge texels there
+    float depth = textureLod(source, (vec2(texel) + 0.5) / level.outputSize, 0.0).x;
+
+    imageStore(destination, ivec2(texel), vec4(depth));
+}
+#endif
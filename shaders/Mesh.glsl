@@ -1,12 +1,25 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 #ifdef VERTEX_SHADER
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// DrawData, one per draw, the firstInstance of a draw is its index
+struct DrawData {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsExtent;
+    uint materialIndex;
+    uint groupIndex; // only read by the culling
+};
+
+layout(std430, binding = 2) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUv;
@@ -15,11 +28,14 @@ layout(location = 4) in vec3 inBiTangent;
 
 layout(location = 0) out vec2 uv;
 layout(location = 1) out mat3 TBN;
+layout(location = 4) flat out uint materialIndex;
 
 void main() {
-    
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    DrawData draw = draws[gl_InstanceIndex];
+
+    gl_Position = ubo.proj * ubo.view * draw.model * vec4(inPosition, 1.0);
     uv = inUv;
+    materialIndex = draw.materialIndex;
 
     vec3 normal = normalize(cross(inTangent, inBiTangent));
     TBN = mat3(normal, inTangent, inBiTangent);
@@ -29,10 +45,14 @@ void main() {
 
 #elif FRAGMENT_SHADER
 
+// MAX_MATERIAL_TEXTURES in VulkanContext.cpp
+#define MAX_MATERIAL_TEXTURES 64
+
 layout(location = 0) in vec2 uv;
 layout(location = 1) in mat3 TBN;
+layout(location = 4) flat in uint materialIndex;
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(binding = 1) uniform sampler2D textures[MAX_MATERIAL_TEXTURES];
 
 layout(location = 0) out vec4 outColor;
 
@@ -40,7 +60,7 @@ void main() {
     //  vec3 normal = texture(texNormal, uv).xyz * 2 - 1.0 remmapping from [-1;1] to [0; 1]
     // normalize(TBN * normal) convert to world space
 
-    
-    outColor = texture(texSampler, uv);
+    // the draws of one indirect call can share a wave
+    outColor = texture(textures[nonuniformEXT(materialIndex)], uv);
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,76 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#ifdef VERTEX_SHADER
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+// DrawData, one per draw, the firstInstance of a draw is its index
+struct DrawData {
+    mat4 model;
+    vec4 boundsMin; // the positions are dequantized in these
+    vec4 boundsExtent;
+    uint materialIndex;
+    uint groupIndex; // only read by the culling
+};
+
+layout(std430, binding = 2) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+layout(location = 0) in vec4 inPosition; // xyz in the bounds, w handedness
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTangent;
+layout(location = 3) in vec2 inUv;
+
+layout(location = 0) out vec2 uv;
+layout(location = 1) out mat3 TBN;
+layout(location = 4) flat out uint materialIndex;
+
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    // unfolds the lower half
+    float t = max(-direction.z, 0.0);
+    direction.x += direction.x >= 0.0 ? -t : t;
+    direction.y += direction.y >= 0.0 ? -t : t;
+
+    return normalize(direction);
+}
+
+void main() {
+    DrawData draw = draws[gl_InstanceIndex];
+
+    vec3 position = draw.boundsMin.xyz + inPosition.xyz * draw.boundsExtent.xyz;
+
+    gl_Position = ubo.proj * ubo.view * draw.model * vec4(position, 1.0);
+    uv = inUv;
+    materialIndex = draw.materialIndex;
+
+    vec3 normal = DecodeOctahedral(inNormal);
+    vec3 tangent = DecodeOctahedral(inTangent);
+    vec3 biTangent = cross(normal, tangent) * (inPosition.w * 2.0 - 1.0);
+
+    TBN = mat3(normal, tangent, biTangent);
+}
+
+#elif FRAGMENT_SHADER
+
+// MAX_MATERIAL_TEXTURES in VulkanContext.cpp
+#define MAX_MATERIAL_TEXTURES 64
+
+layout(location = 0) in vec2 uv;
+layout(location = 1) in mat3 TBN;
+layout(location = 4) flat in uint materialIndex;
+
+layout(binding = 1) uniform sampler2D textures[MAX_MATERIAL_TEXTURES];
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // the draws of one indirect call can share a wave
+    outColor = texture(textures[nonuniformEXT(materialIndex)], uv);
+}
+#endif
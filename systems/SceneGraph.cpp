@@ -1,5 +1,6 @@
 #include "SceneGraph.h"
 
+#include "../CpuProfiler.h"
 #include "../Mesh.h"
 #include "../Node.h"
 
@@ -35,6 +36,8 @@ void SceneGraph::Start()
 
 void SceneGraph::Update()
 {
+	PROFILE_ZONE("SceneGraph::Update");
+
 	for (const auto& node : m_nodes)
 	{
 		node->Update();
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "ISystem.h"
+#include "../CpuProfiler.h"
 
 class SystemManager
 {
@@ -19,6 +20,8 @@ public:
 
 	void Start() const
 	{
+		PROFILE_ZONE("SystemManager::Start");
+
 		for (const auto & system : m_systems)
 		{
 			system->Start();
@@ -27,6 +30,8 @@ public:
 
 	void Update() const
 	{
+		PROFILE_ZONE("SystemManager::Update");
+
 		for (const auto & system : m_systems)
 		{
 			system->Update();
@@ -5,13 +5,29 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <cfloat>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <string>
 
+#include "../Benchmark.h"
 #include "../Camera.h"
+#include "../CpuProfiler.h"
+#include "../GeometryArena.h"
+#include "../GpuCulling.h"
+#include "../GpuProfiler.h"
 #include "../Mesh.h"
+#include "../PipelineCache.h"
+#include "../PipelineStateCache.h"
 #include "../Shader.h"
+#include "../ThreadPool.h"
+#include "../UniformAllocator.h"
+#include "../UploadContext.h"
 #include "SystemManager.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
@@ -21,10 +37,44 @@
 vma::Allocator VulkanContext::s_allocator = nullptr;
 VulkanContext* VulkanContext::GraphicInstance = nullptr;
 
+static constexpr vk::DeviceSize STAGING_RING_SIZE = 32ull * 1024 * 1024;
+// uniform data written by the cpu in one frame
+static constexpr vk::DeviceSize UNIFORM_FRAME_SIZE = 256ull * 1024;
+// indirect commands and draw data written by the cpu in one frame
+static constexpr u32 MAX_DRAWS = 32768;
+// size of the texture array of the mesh shaders, one texture per material, the submeshes sharing their textures share it
+static constexpr u32 MAX_MATERIAL_TEXTURES = 64;
+// every mesh of the scene lives in these two, both fit in one block of the geometry pool
+static constexpr vk::DeviceSize GEOMETRY_VERTEX_CAPACITY = 40ull * 1024 * 1024;
+static constexpr vk::DeviceSize GEOMETRY_INDEX_CAPACITY = 16ull * 1024 * 1024;
+
+static constexpr const char* PIPELINE_CACHE_PATH = "pipeline.cache";
+
+// each one has its gpu scope, they have to fit in the query pools with room left for the passes
+static constexpr u32 MAX_RECORDING_THREADS = 32;
+static_assert(MAX_RECORDING_THREADS + 8 <= GpuProfiler::MAX_SCOPES, "the recording threads need a gpu scope each");
+
+static u32 GetMaxRecordingThreads()
+{
+    return std::min(ThreadPool::GetHardwareThreadCount(), MAX_RECORDING_THREADS);
+}
+
 //TODO: handle resizing with glfw callbacks
 
 void VulkanContext::Init()
 {
+    //the mesh to load comes from it
+    if (!m_options.benchmarkPath.empty())
+    {
+        m_benchmark = new Benchmark(m_options.benchmarkPath);
+
+        //a run without its camera path measures nothing, the scripts calling it see the failure
+        if (!m_benchmark->IsValid())
+        {
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
     InitWindow();
     InitVulkan();
 }
@@ -41,9 +91,29 @@ void VulkanContext::Update()
 
 VulkanContext::~VulkanContext()
 {
+    //both finish their queued tasks first, the compiles still running included
+    delete m_threadPool;
+    delete m_compileThreadPool;
+
     CleanUpSwapChain();
+    DestroySwapChain();
+
+    m_logicalDevice.destroyDescriptorPool(m_descriptorPool);
+
+    m_logicalDevice.destroyShaderModule(m_shaderTriangle->shaderModuleFrag);
+    m_logicalDevice.destroyShaderModule(m_shaderTriangle->shaderModuleVert);
+
+    delete m_shaderTriangle;
+
+    DestroyRecordingResources();
+
+    m_pipelineStateCache->Clear();
+    m_pipeline = nullptr;
+    m_logicalDevice.destroyPipelineLayout(m_pipelineLayout);
+    m_logicalDevice.destroyRenderPass(m_renderPass);
 
     delete m_camera;
+    delete m_benchmark;
 
     m_logicalDevice.destroyDescriptorSetLayout(m_descriptorSetLayout);
 
@@ -54,37 +124,61 @@ VulkanContext::~VulkanContext()
         m_logicalDevice.destroyFence(m_fenceInFlight[i]);
     }
 
+    // frees its command buffers, the pools have to be alive
+    delete m_uploadContext;
+
     m_logicalDevice.destroyCommandPool(m_commandPoolGraphics);
     m_logicalDevice.destroyCommandPool(m_commandPoolTransfer);
     m_logicalDevice.destroyCommandPool(m_commandPoolTransientResources);
     m_logicalDevice.destroyCommandPool(m_commandPoolOneTimeCmd);
 
     //imgui
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!m_options.headless)
+    {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+
+        m_logicalDevice.destroyRenderPass(m_imguiRenderPass);
+        m_logicalDevice.destroyDescriptorPool(m_imguiDescriptorPool);
+    }
+
+    // the mesh owns vma allocations, they need to go before the allocator
+    delete m_uniformAllocator;
+    delete m_drawBatcher;
+    delete m_gpuCulling;
+    delete m_mesh;
+    // after the meshes, they give their ranges back
+    delete m_geometryArena;
 
-    m_logicalDevice.destroyRenderPass(m_imguiRenderPass);
-    m_logicalDevice.destroyDescriptorPool(m_imguiDescriptorPool);
+    DestroyMemPool();
+
+    //written back to disk here, with everything compiled during the run
+    delete m_pipelineStateCache;
+    delete m_pipelineCache;
 
     DestroySurface();
 
     DestroyDevice();
     DestroyInstance();
 
-    vmaDestroyAllocator(s_allocator);
-
-    glfwDestroyWindow(m_window);
+    if (!m_options.headless)
+    {
+        glfwDestroyWindow(m_window);
 
-    glfwTerminate();
+        glfwTerminate();
+    }
 }
 
 void VulkanContext::InitWindow()
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    if (!m_options.headless)
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    m_window = glfwCreateWindow(1280, 720, "Vulkan Render", nullptr, nullptr);
+        m_window = glfwCreateWindow(static_cast<int>(m_options.width), static_cast<int>(m_options.height), "Vulkan Render", nullptr, nullptr);
+    }
 
     const auto extensions = vk::enumerateInstanceExtensionProperties();
 
@@ -98,13 +192,37 @@ void VulkanContext::InitWindow()
 
 void VulkanContext::InitVulkan()
 {
+    PROFILE_ZONE("VulkanContext::InitVulkan");
+
     CreateInstance();
     CreatePhysicalDevice();
     CreateLogicalDevice();
 
+    m_pipelineCache = new PipelineCache(m_logicalDevice, m_physicalDevice.getProperties(), PIPELINE_CACHE_PATH);
+
     CreateMemPool();
     CreateCommandPool();
 
+    //the calling thread is the last worker
+    m_threadPool = new ThreadPool(ThreadPool::GetHardwareThreadCount() - 1);
+    m_recordingThreadCount = GetMaxRecordingThreads();
+
+    //the compiles take their own thread: queued on m_threadPool, the ParallelFor of the frame would wait behind them,
+    //and a pool without workers would run them inline
+    m_compileThreadPool = new ThreadPool(1, "Pipeline compiler");
+    m_pipelineStateCache = new PipelineStateCache(m_logicalDevice, m_pipelineCache->Get(), *m_compileThreadPool);
+
+    if (m_supportsGpuCulling)
+        m_gpuCulling = new GpuCulling(m_logicalDevice, m_physicalDevice, m_familiesAvailable.computeFamily.value_or(-1), m_computeQueue
+            , m_pipelineCache->Get(), m_graphicsComputeFamilies);
+
+    m_uploadContext = new UploadContext(m_logicalDevice
+        , { m_transferQueue, m_commandPoolTransfer, m_familiesAvailable.transferFamily.value_or(-1) }
+        , { m_graphicsQueue, m_commandPoolGraphics, m_familiesAvailable.graphicsFamily.value_or(-1) }
+        , STAGING_RING_SIZE);
+
+    m_geometryArena = new GeometryArena(GEOMETRY_VERTEX_CAPACITY, GEOMETRY_INDEX_CAPACITY);
+
     LoadEntities();
 
     CreateSwapChain();
@@ -114,93 +232,197 @@ void VulkanContext::InitVulkan()
     CreateDescriptorSetLayout();
     CreateGraphicsPipeline();
     CreateFramebuffers();
+    CreateRecordingResources();
 
-    CreateImGuiResources();
+    if (!m_options.headless)
+        CreateImGuiResources();
 
     CreateUniformBuffers();
     CreateDescriptorPool();
     CreateDescriptorSets();
-    CreateCommandBuffers(0);
+
+    if (m_gpuCulling)
+        m_gpuCulling->CreateTargets(*m_drawBatcher, m_actualSwapChainExtent, m_swapchainDepthImagesViews);
     CreateSyncObjects();
+
+    LogMemoryStats();
 }
 
 void VulkanContext::DrawFrame()
 {
+    PROFILE_ZONE("VulkanContext::DrawFrame");
+
     //wait for fences, to make sure we will not use res from fb[0] when going back (with %)
-    auto resFence = m_logicalDevice.waitForFences(m_fenceInFlight[m_currentFrame], true, UINT64_MAX);
+    vk::Result resFence;
+
+    {
+        PROFILE_ZONE("Wait frame fence");
+        resFence = m_logicalDevice.waitForFences(m_fenceInFlight[m_currentFrame], true, UINT64_MAX);
+    }
+
+    if (m_retiredSwapchain && m_isSubmittedSinceRetire[m_currentFrame])
+    {
+        m_isFencePassedSinceRetire[m_currentFrame] = true;
+        ReleaseRetiredSwapChain(false);
+    }
 
     //1) acquire image from swapchain
     //2) execute command buffer
     //3 send result to swap chain
 
     //1)
-    const auto imageIndex = m_logicalDevice.acquireNextImageKHR(m_swapchain, UINT64_MAX, m_semaphoresAcquireImage[m_currentFrame]);
+    //the offscreen targets are used in order, there is nothing to acquire
+    u32 imageIndex = m_currentFrame;
 
-    if(imageIndex.result == vk::Result::eErrorOutOfDateKHR)
+    if (!m_options.headless)
     {
-        RecreateSwapChain();
-        return;
+        PROFILE_ZONE("Acquire image");
+
+        //vulkan-hpp throws on out of date instead of returning it
+        try
+        {
+            imageIndex = m_logicalDevice.acquireNextImageKHR(m_swapchain, UINT64_MAX, m_semaphoresAcquireImage[m_currentFrame]).value;
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            RecreateSwapChain();
+            return;
+        }
     }
 
     //if we want to use an image still in flight
-    if (m_fenceImagesInFlight[imageIndex.value].has_value())
+    if (m_fenceImagesInFlight[imageIndex].has_value())
     {
         //we make sure it's not in flight anymore
-        const auto res = m_logicalDevice.waitForFences(m_fenceImagesInFlight[imageIndex.value].value(), true, UINT64_MAX);
+        const auto res = m_logicalDevice.waitForFences(m_fenceImagesInFlight[imageIndex].value(), true, UINT64_MAX);
 
         assert(res == vk::Result::eSuccess);
     }
 
-    m_fenceImagesInFlight[imageIndex.value] = m_fenceInFlight[m_currentFrame];
+    m_fenceImagesInFlight[imageIndex] = m_fenceInFlight[m_currentFrame];
 
-    UpdateUniformBuffer(imageIndex);
+    const u32 uboOffset = UpdateUniformBuffer(imageIndex);
 
     vk::SubmitInfo submitInfo;
 
-    const vk::Semaphore waitSemaphore[] = {m_semaphoresAcquireImage[m_currentFrame]};
-    constexpr vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+    std::vector<vk::Semaphore> waitSemaphores;
+    std::vector<vk::PipelineStageFlags> waitStages;
+    std::vector<u64> waitValues;
+    std::vector<vk::CommandBuffer> cmds;
+
+    if (!m_options.headless)
+    {
+        waitSemaphores.emplace_back(m_semaphoresAcquireImage[m_currentFrame]);
+        waitStages.emplace_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+        waitValues.emplace_back(0); // ignored for binary semaphores
+    }
+
+    //anything streamed during the frame goes to the transfer queue now
+    //if some resources were released by it, acquire them before rendering
+    m_uploadContext->Flush();
+
+    vk::CommandBuffer acquireCmd;
+    u64 acquireValue = 0;
 
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphore;
+    if (m_uploadContext->RecordPendingAcquires(m_currentFrame, acquireCmd, acquireValue))
+    {
+        waitSemaphores.emplace_back(m_uploadContext->GetTimelineSemaphore());
+        waitStages.emplace_back(UploadContext::GetAcquireWaitStages());
+        waitValues.emplace_back(acquireValue);
+        cmds.emplace_back(acquireCmd);
+    }
+
+    if (!m_options.headless)
+    {
+        ImGui::Render();
 
-    submitInfo.pWaitDstStageMask = waitStages;
+        //todo: check why docking is crashing
+        //i think it's because we need a render pass only for it
+        // yes ?
 
-    ImGui::Render();
+        ImGui::UpdatePlatformWindows();
+        ImGui::RenderPlatformWindowsDefault();
+    }
+
+    m_logicalDevice.resetFences(m_fenceInFlight[m_currentFrame]);
+    CreateCommandBuffers(imageIndex, uboOffset);
 
-    //todo: check why docking is crashing
-    //i think it's because we need a render pass only for it
-    // yes ?
+    cmds.emplace_back(m_commandBuffersGraphics[imageIndex]);
 
-    ImGui::UpdatePlatformWindows();
-    ImGui::RenderPlatformWindowsDefault();
+    std::vector<vk::Semaphore> signalSemaphores;
+    std::vector<u64> signalValues;
 
-    const std::array cmds = { m_commandBuffersGraphics[imageIndex.value] };
+    //this will send a signal once executed, nothing waits on it without presentation
+    const vk::Semaphore finishedRendering = m_semaphoresFinishedRendering[m_currentFrame];
 
-    submitInfo.commandBufferCount = cmds.size();
-    submitInfo.pCommandBuffers = cmds.data();
+    if (!m_options.headless)
+    {
+        signalSemaphores.emplace_back(finishedRendering);
+        signalValues.emplace_back(0); // ignored for binary semaphores
+    }
+
+    //the draws come from the cull submitted while recording, the pyramid built after them is read by the next one
+    if (m_useGpuCulling)
+    {
+        waitSemaphores.emplace_back(m_gpuCulling->GetCullSemaphore());
+        waitStages.emplace_back(GpuCulling::GetGraphicsWaitStages());
+        waitValues.emplace_back(m_gpuCulling->GetFrameValue());
 
-    const vk::Semaphore semaphoreToSignal[] = {m_semaphoresFinishedRendering[m_currentFrame]};
+        signalSemaphores.emplace_back(m_gpuCulling->GetPyramidSemaphore());
+        signalValues.emplace_back(m_gpuCulling->GetFrameValue());
+    }
 
-    //this will send a signal once executed
-    submitInfo.pSignalSemaphores = semaphoreToSignal;
-    submitInfo.signalSemaphoreCount = 1;
+    vk::TimelineSemaphoreSubmitInfo timelineInfo;
+    timelineInfo.waitSemaphoreValueCount = static_cast<u32>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<u32>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    submitInfo.pNext = &timelineInfo;
+
+    submitInfo.waitSemaphoreCount = static_cast<u32>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+
+    submitInfo.pWaitDstStageMask = waitStages.data();
+
+    submitInfo.commandBufferCount = static_cast<u32>(cmds.size());
+    submitInfo.pCommandBuffers = cmds.data();
+
+    submitInfo.signalSemaphoreCount = static_cast<u32>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
 
-    m_logicalDevice.resetFences(m_fenceInFlight[m_currentFrame]);
-    CreateCommandBuffers(m_currentFrame);
     //2)
-    m_graphicsQueue.submit(submitInfo, m_fenceInFlight[m_currentFrame]);
+    {
+        PROFILE_ZONE("Submit");
+        m_graphicsQueue.submit(submitInfo, m_fenceInFlight[m_currentFrame]);
+    }
+
+    m_isSubmittedSinceRetire[m_currentFrame] = true;
+
+    if (m_options.headless)
+        return;
 
     vk::PresentInfoKHR presentInfo;
 
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = semaphoreToSignal;
+    presentInfo.pWaitSemaphores = &finishedRendering;
 
     const vk::SwapchainKHR swapchains[] = {m_swapchain};
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = swapchains;
-    presentInfo.pImageIndices = &imageIndex.value;
+    presentInfo.pImageIndices = &imageIndex;
     //3)
-    const auto res = m_presentationQueue.presentKHR(presentInfo);
+    vk::Result res;
+
+    try
+    {
+        PROFILE_ZONE("Present");
+        res = m_presentationQueue.presentKHR(presentInfo);
+    }
+    catch (const vk::OutOfDateKHRError&)
+    {
+        res = vk::Result::eErrorOutOfDateKHR;
+    }
 
     if(res == vk::Result::eErrorOutOfDateKHR 
         || res == vk::Result::eSuboptimalKHR)
@@ -214,57 +436,200 @@ void VulkanContext::DrawFrame()
 
 void VulkanContext::DrawLoop()
 {
-    while (!glfwWindowShouldClose(m_window))
-    {
-        glfwPollEvents();
+    auto frameStart = std::chrono::high_resolution_clock::now();
+
+    const u32 frameCount = m_benchmark ? m_benchmark->GetTotalFrameCount() : m_options.frameCount;
 
-        if (glfwGetKey(m_window, GLFW_KEY_ESCAPE))
-            glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+    while (m_options.headless || !glfwWindowShouldClose(m_window))
+    {
+        PROFILE_ZONE("Frame");
 
-        auto movement = vec3(0);
+        if (frameCount > 0 && m_frameNumber == frameCount)
+            break;
 
-        if(glfwGetKey(m_window, GLFW_KEY_Z))
-        {
-            movement.z += 1.0f;
-        }
-        else if(glfwGetKey(m_window, GLFW_KEY_S))
+        if (!m_options.headless)
         {
-            movement.z -= 1.0f;
+            glfwPollEvents();
+
+            if (glfwGetKey(m_window, GLFW_KEY_ESCAPE))
+                glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+
+            auto movement = vec3(0);
+
+            if(glfwGetKey(m_window, GLFW_KEY_Z))
+            {
+                movement.z += 1.0f;
+            }
+            else if(glfwGetKey(m_window, GLFW_KEY_S))
+            {
+                movement.z -= 1.0f;
+            }
+
+            if (glfwGetKey(m_window, GLFW_KEY_Q))
+            {
+                movement.x += 1.0f;
+            }
+            else if (glfwGetKey(m_window, GLFW_KEY_S))
+            {
+                movement.x -= 1.0f;
+            }
+
+            if(glfwGetKey(m_window, GLFW_KEY_SPACE))
+            {
+                movement.y += 1;
+            }
+
+            //the benchmark drives the camera
+            if (!m_benchmark)
+                m_camera->Move(movement * 0.16f);
+
+            PROFILE_ZONE("GUI");
+
+            //imgui new frame
+            ImGui_ImplGlfw_NewFrame();
+            ImGui_ImplVulkan_NewFrame();
+
+            ImGui::NewFrame();
+
+            //imgui commands
+            ImGui::ShowDemoWindow();
+            DrawMemoryStatsGUI();
+            DrawRenderingGUI();
+            m_gpuProfiler->DrawGUI();
         }
 
-        if (glfwGetKey(m_window, GLFW_KEY_Q))
+        if (m_benchmark)
+            m_benchmark->ApplyCamera(m_frameNumber, *m_camera);
+
+        DrawFrame();
+
+        m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+        const auto frameEnd = std::chrono::high_resolution_clock::now();
+        m_frameTimesMs.emplace_back(std::chrono::duration<float, std::chrono::milliseconds::period>(frameEnd - frameStart).count());
+        frameStart = frameEnd;
+
+        if (m_benchmark)
         {
-            movement.x += 1.0f;
+            m_benchmark->AddCpuFrameTime(m_frameNumber, m_frameTimesMs.back());
+            m_benchmark->AddDrawCounts(m_frameNumber, m_drawCount, m_triangleCount);
         }
-        else if (glfwGetKey(m_window, GLFW_KEY_S))
+
+        //the gpu results come back a few frames late, each one with the frame it measured
+        CollectGpuFrameTimes();
+
+        m_frameNumber++;
+    }
+
+    m_logicalDevice.waitIdle();
+
+    //the last frames in flight never had their image come back, nothing else reads them
+    m_gpuProfiler->ReadBackAll();
+
+    if (m_gpuCulling)
+        m_gpuCulling->ReadBackAll();
+
+    CollectGpuFrameTimes();
+
+    ReportFrameTimings();
+
+    if (!m_options.gpuTimingsPath.empty())
+    {
+        m_gpuProfiler->ExportJson(m_options.gpuTimingsPath);
+    }
+
+    if (m_benchmark)
+    {
+        Benchmark::RunInfo info;
+        info.deviceName = m_physicalDevice.getProperties().deviceName.data();
+        info.width = m_actualSwapChainExtent.width;
+        info.height = m_actualSwapChainExtent.height;
+        info.headless = m_options.headless;
+
+        if (m_useGpuCulling)
         {
-            movement.x -= 1.0f;
+            info.gpuCulling = true;
+            info.visibleDrawCount = m_gpuCulling->GetStats().visible;
+            info.frustumCulledCount = m_gpuCulling->GetStats().frustumCulled;
+            info.occlusionCulledCount = m_gpuCulling->GetStats().occlusionCulled;
         }
 
-        if(glfwGetKey(m_window, GLFW_KEY_SPACE))
+        m_benchmark->WriteResults(m_options.benchmarkOutPath, info);
+    }
+
+    SystemManager::instance->SetContinueLooping(false);
+}
+
+void VulkanContext::CollectGpuFrameTimes()
+{
+    const std::vector<GpuProfiler::FrameSample> frames = m_gpuProfiler->TakeFrameSamples();
+
+    //read back with the frame that waited on them, at most one per frame
+    std::vector<GpuProfiler::FrameSample> culls;
+
+    if (m_gpuCulling)
+        culls = m_gpuCulling->TakeCullSamples();
+
+    if (!m_benchmark)
+        return;
+
+    for (const GpuProfiler::FrameSample& frame : frames)
+    {
+        //the cull runs before the frame on the compute queue, its timestamps can't be compared with the graphics ones
+        float ms = frame.ms;
+
+        for (const GpuProfiler::FrameSample& cull : culls)
         {
-            movement.y += 1;
+            if (cull.frame == frame.frame)
+                ms += cull.ms;
         }
 
-        m_camera->Move(movement * 0.16f);
+        m_benchmark->AddGpuFrameTime(static_cast<u32>(frame.frame), ms);
+    }
+}
+
+void VulkanContext::ReportFrameTimings() const
+{
+    if (m_frameTimesMs.empty())
+        return;
+
+    //the first frames pay for the pipelines and the uploads, they would skew the average
+    const size_t warmup = std::min<size_t>(m_frameTimesMs.size() / 10, MAX_FRAMES_IN_FLIGHT * 2);
 
-        //imgui new frame
-        ImGui_ImplGlfw_NewFrame();
-        ImGui_ImplVulkan_NewFrame();
+    float total = 0.0f;
+    float minTime = FLT_MAX;
+    float maxTime = 0.0f;
+
+    for (size_t i = warmup; i < m_frameTimesMs.size(); ++i)
+    {
+        total += m_frameTimesMs[i];
+        minTime = std::min(minTime, m_frameTimesMs[i]);
+        maxTime = std::max(maxTime, m_frameTimesMs[i]);
+    }
 
-        ImGui::NewFrame();
+    const float average = total / static_cast<float>(m_frameTimesMs.size() - warmup);
 
-        //imgui commands
-        ImGui::ShowDemoWindow();
+    std::cout << "[Timings] " << m_frameTimesMs.size() << " frames (" << warmup << " warmup) at " << m_actualSwapChainExtent.width << "x"
+        << m_actualSwapChainExtent.height << (m_options.headless ? " offscreen" : "") << ": avg " << average << " ms (" << 1000.0f / average
+        << " fps), min " << minTime << " ms, max " << maxTime << " ms" << std::endl;
 
-        DrawFrame();
+    if (m_options.timingsPath.empty())
+        return;
 
-        m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    std::ofstream file(m_options.timingsPath, std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        std::cout << "[Timings] could not write " << m_options.timingsPath << std::endl;
+        return;
     }
 
-    m_logicalDevice.waitIdle();
+    file << "frame,cpu_ms\n";
 
-    SystemManager::instance->SetContinueLooping(false);
+    for (size_t i = 0; i < m_frameTimesMs.size(); ++i)
+    {
+        file << i << "," << m_frameTimesMs[i] << "\n";
+    }
 }
 
 bool VulkanContext::CheckValidationSupport() const
@@ -308,11 +673,15 @@ void VulkanContext::CreateInstance()
     vk::InstanceCreateInfo instanceInfo;
     instanceInfo.pApplicationInfo = &appInfo;
 
-    u32 glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    //no surface extensions without a window
+    if (!m_options.headless)
+    {
+        u32 glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    instanceInfo.enabledExtensionCount = glfwExtensionCount;
-    instanceInfo.ppEnabledExtensionNames = glfwExtensions;
+        instanceInfo.enabledExtensionCount = glfwExtensionCount;
+        instanceInfo.ppEnabledExtensionNames = glfwExtensions;
+    }
 
     if(enableValidationLayers)
     {
@@ -322,6 +691,9 @@ void VulkanContext::CreateInstance()
 
     m_instance = vk::createInstance(instanceInfo);
 
+    if (m_options.headless)
+        return;
+
     VkSurfaceKHR _surface;
     glfwCreateWindowSurface(m_instance, m_window, nullptr, &_surface);
 
@@ -378,6 +750,7 @@ void VulkanContext::CreateImGuiResources()
     init_info.PhysicalDevice = m_physicalDevice;
     init_info.Device = m_logicalDevice;
     init_info.Queue = m_graphicsQueue;
+    init_info.PipelineCache = m_pipelineCache->Get();
     init_info.DescriptorPool = m_imguiDescriptorPool;
     init_info.MinImageCount = 3;
     init_info.ImageCount = 3;
@@ -399,26 +772,88 @@ void VulkanContext::CreateLogicalDevice()
 {
     m_familiesAvailable = QueueFamilies::FindQueueFamilies(m_physicalDevice, m_surface);
 
+    //no dedicated transfer family, uploads will go through the graphics queue
+    if (!m_familiesAvailable.transferFamily.has_value())
+        m_familiesAvailable.transferFamily = m_familiesAvailable.graphicsFamily;
+
+    //nothing is presented, the queue is only there to keep every family valid
+    if (m_options.headless)
+        m_familiesAvailable.presentFamily = m_familiesAvailable.graphicsFamily;
+
+    //no family dedicated to compute, the culling goes through the graphics queue
+    if (!m_familiesAvailable.computeFamily.has_value())
+        m_familiesAvailable.computeFamily = m_familiesAvailable.graphicsFamily;
+
+    m_graphicsComputeFamilies.clear();
+
+    if (m_familiesAvailable.computeFamily != m_familiesAvailable.graphicsFamily)
+        m_graphicsComputeFamilies = { m_familiesAvailable.graphicsFamily.value(), m_familiesAvailable.computeFamily.value() };
+
     constexpr float priority = 1.0f;
 
-    std::array<vk::DeviceQueueCreateInfo, 3> infos;
+    //a family can only be requested once
+    std::vector<u32> uniqueFamilies;
+    for (const auto& family : { m_familiesAvailable.graphicsFamily, m_familiesAvailable.presentFamily, m_familiesAvailable.transferFamily
+        , m_familiesAvailable.computeFamily })
+    {
+        if (family.has_value() && std::find(uniqueFamilies.begin(), uniqueFamilies.end(), family.value()) == uniqueFamilies.end())
+            uniqueFamilies.emplace_back(family.value());
+    }
+
+    std::vector<vk::DeviceQueueCreateInfo> infos(uniqueFamilies.size());
+
+    for (u32 i = 0; i < uniqueFamilies.size(); ++i)
+    {
+        infos[i].pQueuePriorities = &priority;
+        infos[i].queueCount = 1;
+        infos[i].queueFamilyIndex = uniqueFamilies[i];
+    }
+
+    //only what the device has is enabled, the renderer falls back on simpler paths for the rest
+    const auto supported = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    const vk::PhysicalDeviceFeatures& supported10 = supported.get<vk::PhysicalDeviceFeatures2>().features;
+    const vk::PhysicalDeviceVulkan12Features& supported12 = supported.get<vk::PhysicalDeviceVulkan12Features>();
+
+    //used by the upload context to know when the transfers are done, there is no way around it
+    if (!supported12.timelineSemaphore)
+    {
+        std::cout << "[Vulkan] the device has no timeline semaphores" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    //the geometry is drawn with one indirect call per pipeline, the draw data is found from the firstInstance,
+    //and the material index differs between the draws of one indirect call
+    //without any of them every draw is recorded on its own, with its firstInstance and material known at recording
+    m_useIndirectBatches = supported10.multiDrawIndirect && supported10.drawIndirectFirstInstance
+        && supported12.shaderSampledImageArrayNonUniformIndexing;
+
+    //the gpu culling decides how many draws of each group survive, and builds its depth pyramid with max samplers
+    m_supportsGpuCulling = m_useIndirectBatches && supported12.drawIndirectCount && supported12.samplerFilterMinmax
+        && GpuCulling::IsSupported(m_physicalDevice);
 
-    //graphics queue
-	infos[0].pQueuePriorities = &priority;
-    infos[0].queueCount = 1;
-    infos[0].queueFamilyIndex = m_familiesAvailable.graphicsFamily.value_or(-1);
+    vk::PhysicalDeviceFeatures features;
+    features.multiDrawIndirect = m_useIndirectBatches;
+    features.drawIndirectFirstInstance = m_useIndirectBatches;
 
-    // presentation queue
-    infos[1].pQueuePriorities = &priority;
-    infos[1].queueCount = 1;
-    infos[1].queueFamilyIndex = m_familiesAvailable.presentFamily.value_or(-1);
+    vk::PhysicalDeviceVulkan12Features features12;
+    features12.timelineSemaphore = VK_TRUE;
+    features12.shaderSampledImageArrayNonUniformIndexing = m_useIndirectBatches;
+    features12.drawIndirectCount = m_supportsGpuCulling;
+    features12.samplerFilterMinmax = m_supportsGpuCulling;
+
+    if (!m_useIndirectBatches)
+        std::cout << "[Vulkan] no multi draw indirect or non uniform texture indexing, the draws are recorded one by one" << std::endl;
+
+    if (!m_supportsGpuCulling)
+    {
+        std::cout << "[Vulkan] the gpu culling is not supported by the device, disabled" << std::endl;
+        m_useGpuCulling = false;
+    }
 
-    // transfer queue
-    infos[2].pQueuePriorities = &priority;
-    infos[2].queueCount = 1;
-    infos[2].queueFamilyIndex = m_familiesAvailable.transferFamily.value_or(-1);
+    std::vector<const char*> extensions;
 
-    const std::vector extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    if (!m_options.headless)
+        extensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
     const auto layers = m_physicalDevice.enumerateDeviceExtensionProperties();
 
@@ -427,14 +862,18 @@ void VulkanContext::CreateLogicalDevice()
         std::cout << layer.extensionName << std::endl;
 	}
 
-    m_logicalDevice = m_physicalDevice.createDevice(vk::DeviceCreateInfo(vk::DeviceCreateFlags(), infos, nullptr, extensions));
+    vk::DeviceCreateInfo deviceInfo(vk::DeviceCreateFlags(), infos, nullptr, extensions, &features);
+    deviceInfo.pNext = &features12;
+
+    m_logicalDevice = m_physicalDevice.createDevice(deviceInfo);
 
     m_graphicsQueue = m_logicalDevice.getQueue(m_familiesAvailable.graphicsFamily.value_or(-1), 0);
     m_presentationQueue = m_logicalDevice.getQueue(m_familiesAvailable.presentFamily.value_or(-1), 0);
     m_transferQueue = m_logicalDevice.getQueue(m_familiesAvailable.transferFamily.value_or(-1), 0);
+    m_computeQueue = m_logicalDevice.getQueue(m_familiesAvailable.computeFamily.value_or(-1), 0);
 }
 
-void VulkanContext::CreateMemPool() const
+void VulkanContext::CreateMemPool()
 {
     vma::AllocatorCreateInfo allocatorInfo;
     allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_2;
@@ -443,10 +882,102 @@ void VulkanContext::CreateMemPool() const
     allocatorInfo.instance = m_instance;
 
     s_allocator = vma::createAllocator(allocatorInfo);
+
+    m_memoryProperties = m_physicalDevice.getMemoryProperties();
+
+    struct PoolDesc
+    {
+        vk::BufferUsageFlags usage;
+        vma::MemoryUsage memoryUsage;
+        vk::DeviceSize blockSize;
+        const char* name;
+    };
+
+    //the usage flags are only here to find a memory type that can hold every buffer of the pool
+    const std::array<PoolDesc, static_cast<size_t>(EMemoryPool::Count)> pools =
+    {
+        PoolDesc{ vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst
+            , vma::MemoryUsage::eGpuOnly, 64ull * 1024 * 1024, "Geometry" },
+        PoolDesc{ vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly, 64ull * 1024 * 1024, "Staging" },
+        PoolDesc{ vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eCpuToGpu, 32ull * 1024 * 1024, "Dynamic" },
+        PoolDesc{ vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc
+            | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly, 8ull * 1024 * 1024, "GpuOnly" },
+    };
+
+    for (u32 i = 0; i < pools.size(); ++i)
+    {
+        vk::BufferCreateInfo sampleBufferInfo;
+        sampleBufferInfo.size = 1024;
+        sampleBufferInfo.usage = pools[i].usage;
+        sampleBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+        vma::AllocationCreateInfo sampleAllocInfo;
+        sampleAllocInfo.usage = pools[i].memoryUsage;
+
+        vma::PoolCreateInfo poolInfo;
+        poolInfo.memoryTypeIndex = s_allocator.findMemoryTypeIndexForBufferInfo(sampleBufferInfo, sampleAllocInfo);
+        poolInfo.blockSize = pools[i].blockSize;
+
+        //static geometry goes straight to device local memory that the cpu can write when the device has some worth using,
+        //it saves the staging copy
+        if (i == static_cast<u32>(EMemoryPool::Geometry))
+        {
+            u32 unifiedType;
+            if (FindUnifiedMemoryType(sampleBufferInfo, unifiedType))
+            {
+                poolInfo.memoryTypeIndex = unifiedType;
+                m_geometryDirectWrite = true;
+            }
+        }
+
+        m_poolMemoryTypes[i] = poolInfo.memoryTypeIndex;
+
+        m_memoryPools[i] = s_allocator.createPool(poolInfo);
+        s_allocator.setPoolName(m_memoryPools[i], pools[i].name);
+    }
+}
+
+bool VulkanContext::FindUnifiedMemoryType(const vk::BufferCreateInfo& _sampleBufferInfo, u32& _memoryType) const
+{
+    vma::AllocationCreateInfo allocInfo;
+    allocInfo.requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible
+        | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+    if (s_allocator.findMemoryTypeIndexForBufferInfo(&_sampleBufferInfo, &allocInfo, &_memoryType) != vk::Result::eSuccess)
+        return false;
+
+    //on integrated gpus every heap is the same memory
+    if (m_physicalDevice.getProperties().deviceType == vk::PhysicalDeviceType::eIntegratedGpu)
+        return true;
+
+    //without resizable bar, discrete gpus only expose a 256MB window, too small to hold the geometry,
+    //better keep it for the dynamic data
+    const vk::MemoryHeap& heap = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[_memoryType].heapIndex];
+
+    return heap.size > 256ull * 1024 * 1024;
+}
+
+void VulkanContext::DestroyMemPool()
+{
+    for (auto& pool : m_memoryPools)
+    {
+        s_allocator.destroyPool(pool);
+        pool = nullptr;
+    }
+
+    s_allocator.destroy();
+    s_allocator = nullptr;
 }
 
 void VulkanContext::CreateSwapChain()
 {
+    if (m_options.headless)
+    {
+        CreateOffscreenTargets();
+        return;
+    }
+
     //check for capabilities first
 
     const vk::SurfaceCapabilitiesKHR surfaceCapabilities = m_physicalDevice.getSurfaceCapabilitiesKHR(m_surface);
@@ -522,9 +1053,47 @@ void VulkanContext::CreateSwapChain()
     swapchainInfo.preTransform = surfaceCapabilities.currentTransform;
     swapchainInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque; // don't blend with other windows
 
+    //lets the driver reuse what it can and keeps presenting the old images until the new ones are ready
+    const vk::SwapchainKHR oldSwapchain = m_swapchain;
+    swapchainInfo.oldSwapchain = oldSwapchain;
+
     m_swapchain = m_logicalDevice.createSwapchainKHR(swapchainInfo);
 
+    //nothing renders to its images anymore, but the fences don't cover the presents still queued on them
+    if (oldSwapchain)
+    {
+        //resized again before the previous one could go, the presents are waited for instead
+        ReleaseRetiredSwapChain(true);
+
+        m_retiredSwapchain = oldSwapchain;
+        m_isSubmittedSinceRetire.fill(false);
+        m_isFencePassedSinceRetire.fill(false);
+    }
+
     m_swapchainImages = m_logicalDevice.getSwapchainImagesKHR(m_swapchain);
+
+    //every frame is done when the swapchain is (re)created, nothing is in flight anymore
+    m_fenceImagesInFlight.assign(m_swapchainImages.size(), std::optional<vk::Fence>());
+}
+
+void VulkanContext::CreateOffscreenTargets()
+{
+    //mandatory as a color attachment, the swapchain one is not guaranteed to be
+    m_actualSwapChainFormat = vk::Format::eR8G8B8A8Srgb;
+    m_actualSwapChainExtent = vk::Extent2D{ m_options.width, m_options.height };
+
+    //one per frame in flight, they play the role of the swapchain images
+    m_swapchainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    m_offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        CreateImage(m_actualSwapChainExtent.width, m_actualSwapChainExtent.height, m_actualSwapChainFormat, vk::ImageTiling::eOptimal
+            , vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc
+            , vk::MemoryPropertyFlagBits::eDeviceLocal, m_swapchainImages[i], m_offscreenImagesMemory[i]);
+    }
+
+    m_fenceImagesInFlight.assign(m_swapchainImages.size(), std::optional<vk::Fence>());
 }
 
 void VulkanContext::CreateSwapChainViews()
@@ -562,7 +1131,7 @@ void VulkanContext::CreateDepthResources()
     for (int i = 0; i < m_swapchainDepthImages.size(); ++i)
     {
         CreateImage(m_actualSwapChainExtent.width, m_actualSwapChainExtent.height, vk::Format::eD32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment
-            , vk::MemoryPropertyFlagBits::eDeviceLocal, m_swapchainDepthImages[i], m_swapchainDepthImagesMemory[i]);
+            | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, m_swapchainDepthImages[i], m_swapchainDepthImagesMemory[i]);
 
         m_swapchainDepthImagesViews[i] = CreateImageView(m_swapchainDepthImages[i], vk::Format::eD32Sfloat, vk::ImageAspectFlagBits::eDepth);
     }
@@ -575,111 +1144,71 @@ void VulkanContext::CreateDescriptorSetLayout()
     vk::DescriptorSetLayoutBinding bindingMatrices;
     bindingMatrices.binding = 0;
     bindingMatrices.descriptorCount = 1;
-    bindingMatrices.descriptorType = vk::DescriptorType::eUniformBuffer;
+    bindingMatrices.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
     bindingMatrices.stageFlags = vk::ShaderStageFlagBits::eVertex;
 
+    //indexed with the material index of the draw
     vk::DescriptorSetLayoutBinding bindingSampler;
     bindingSampler.binding = 1;
-    bindingSampler.descriptorCount = 1;
+    bindingSampler.descriptorCount = MAX_MATERIAL_TEXTURES;
     bindingSampler.descriptorType = vk::DescriptorType::eCombinedImageSampler;
     bindingSampler.stageFlags = vk::ShaderStageFlagBits::eFragment;
     //todo: check if pImmutableSamplers = nullptr is necessary
 
-    const std::array bindings = { bindingSampler, bindingMatrices };
+    //DrawData of every draw, the dynamic offset selects the region of the frame
+    vk::DescriptorSetLayoutBinding bindingDrawData;
+    bindingDrawData.binding = 2;
+    bindingDrawData.descriptorCount = 1;
+    bindingDrawData.descriptorType = vk::DescriptorType::eStorageBufferDynamic;
+    bindingDrawData.stageFlags = vk::ShaderStageFlagBits::eVertex;
 
-    vk::DescriptorSetLayoutCreateInfo info;
-    info.bindingCount = bindings.size();
-    info.pBindings = bindings.data();
-    //info.flags = vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR;
+    //combined image samplers count against both limits
+    const vk::PhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
 
-    m_descriptorSetLayout = m_logicalDevice.createDescriptorSetLayout(info);
-}
-
-void VulkanContext::CreateGraphicsPipeline()
-{
-    m_shaderTriangle = new Shader(m_logicalDevice, "shaders/Mesh");
-    m_shaderTriangle->Reflect();
-    vk::PipelineShaderStageCreateInfo infoVert;
-
-    infoVert.module = m_shaderTriangle->shaderModuleVert;
-    infoVert.stage = vk::ShaderStageFlagBits::eVertex;
-    infoVert.pName = "main";
-
-    vk::PipelineShaderStageCreateInfo infoFrag;
-
-    infoFrag.module = m_shaderTriangle->shaderModuleFrag;
-    infoFrag.stage = vk::ShaderStageFlagBits::eFragment;
-    infoFrag.pName = "main";
-    //info.pSpecializationInfo todo: this is to add shader constants at runtime aka shader defines
-
-    vk::PipelineShaderStageCreateInfo shaderStages[] = { infoVert, infoFrag };
-
-    vk::PipelineVertexInputStateCreateInfo vertexInfo;
-
-    auto vertexAttribs = m_mesh->GetSubMeshes()[0]->vertices.GetAttributesDescription();
-    vertexInfo.pVertexAttributeDescriptions = vertexAttribs.data();
-    vertexInfo.vertexAttributeDescriptionCount = static_cast<u32>(vertexAttribs.size());
-
-    auto vertexBinding = m_mesh->GetSubMeshes()[0]->vertices.GetBindingDescription();
-    vertexInfo.pVertexBindingDescriptions = &vertexBinding;
-    vertexInfo.vertexBindingDescriptionCount = 1;
-
-    vk::PipelineInputAssemblyStateCreateInfo assemblyInfo;
-    assemblyInfo.topology = vk::PrimitiveTopology::eTriangleList;
-    assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    vk::Viewport viewport;
-    viewport.maxDepth = 1.0f;
-    viewport.width = static_cast<float>(m_actualSwapChainExtent.width);
-    viewport.height = static_cast<float>(m_actualSwapChainExtent.height);
+    if (limits.maxPerStageDescriptorSampledImages < MAX_MATERIAL_TEXTURES || limits.maxPerStageDescriptorSamplers < MAX_MATERIAL_TEXTURES)
+    {
+        std::cout << "[Vulkan] the device can't bind " << MAX_MATERIAL_TEXTURES << " textures to the fragment shader" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 
-    vk::Rect2D scissor;
-    scissor.extent = m_actualSwapChainExtent;
+    const std::array bindings = { bindingSampler, bindingMatrices, bindingDrawData };
 
-    vk::PipelineViewportStateCreateInfo viewportState;
-    viewportState.pScissors = &scissor;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.viewportCount = 1;
+    vk::DescriptorSetLayoutCreateInfo info;
+    info.bindingCount = bindings.size();
+    info.pBindings = bindings.data();
+    //info.flags = vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR;
 
-    vk::PipelineRasterizationStateCreateInfo rasterizerInfo;
-    rasterizerInfo.depthClampEnable = VK_FALSE;
-    rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+    m_descriptorSetLayout = m_logicalDevice.createDescriptorSetLayout(info);
+}
 
-    rasterizerInfo.polygonMode = vk::PolygonMode::eFill;
-    rasterizerInfo.lineWidth = 1.0f;
+PipelineDesc VulkanContext::MakePipelineDesc(const Shader& _shader) const
+{
+    PipelineDesc desc;
 
-    rasterizerInfo.cullMode = vk::CullModeFlagBits::eNone;
-    rasterizerInfo.frontFace = vk::FrontFace::eCounterClockwise;
+    desc.vertexModule = _shader.shaderModuleVert;
+    desc.fragmentModule = _shader.shaderModuleFrag;
 
-    rasterizerInfo.depthBiasEnable = VK_FALSE;
+    //todo: take the declaration from the material once there is one
+    desc.vertexBinding = m_mesh->GetSubMeshes()[0]->vertices.GetBindingDescription();
+    desc.vertexAttributes = m_mesh->GetSubMeshes()[0]->vertices.GetAttributesDescription();
 
-    vk::PipelineMultisampleStateCreateInfo msaaInfo;
-    //msaaInfo.minSampleShading = 1.0f;
-    msaaInfo.rasterizationSamples = vk::SampleCountFlagBits::e1;
+    desc.layout = m_pipelineLayout;
+    desc.renderPass = m_renderPass;
+    desc.subpass = 0;
 
-    vk::PipelineColorBlendAttachmentState colorBlendAttachment;
-    colorBlendAttachment.colorWriteMask = 
-		vk::ColorComponentFlagBits::eA
-	|   vk::ColorComponentFlagBits::eB
-	| vk::ColorComponentFlagBits::eR
-	| vk::ColorComponentFlagBits::eG;
-    colorBlendAttachment.blendEnable = VK_FALSE; //we don't blend, no transparent objects are allowed for now
+    //no transparent objects are allowed for now
+    desc.blend = false;
 
-    vk::PipelineColorBlendStateCreateInfo blendInfo;
-    blendInfo.attachmentCount = 1;
-    blendInfo.logicOpEnable = VK_FALSE;
-    blendInfo.logicOp = vk::LogicOp::eCopy;
-    blendInfo.pAttachments = &colorBlendAttachment;
+    return desc;
+}
 
-    vk::PipelineDepthStencilStateCreateInfo depthStencilInfo;
-    depthStencilInfo.depthTestEnable = VK_TRUE;
-    depthStencilInfo.depthWriteEnable = VK_TRUE;
-    depthStencilInfo.depthCompareOp = vk::CompareOp::eLess;
-    depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
-    depthStencilInfo.setStencilTestEnable(false);
+void VulkanContext::CreateGraphicsPipeline()
+{
+    //the default pipeline has to read the vertex format of the mesh
+    const bool isPacked = m_mesh->GetVertexFormat() == MeshVertexDecl::Format::Packed;
 
-    //todo: add stencil also here: make sure the image has stencil as well !
+    m_shaderTriangle = new Shader(m_logicalDevice, isPacked ? "shaders/MeshPacked" : "shaders/Mesh");
+    m_shaderTriangle->Reflect();
 
     vk::PipelineLayoutCreateInfo layoutInfo;
     layoutInfo.pSetLayouts = &m_descriptorSetLayout;
@@ -687,52 +1216,16 @@ void VulkanContext::CreateGraphicsPipeline()
 
     m_pipelineLayout = m_logicalDevice.createPipelineLayout(layoutInfo);
 
-    vk::GraphicsPipelineCreateInfo info;
-
-    info.stageCount = 2;
-    info.pStages = shaderStages;
-
-    info.pVertexInputState = &vertexInfo;
-    info.pInputAssemblyState = &assemblyInfo;
-    info.pViewportState = &viewportState;
-    info.pRasterizationState = &rasterizerInfo;
-    info.pMultisampleState = &msaaInfo;
-    info.pDepthStencilState = &depthStencilInfo; 
-    info.pColorBlendState = &blendInfo;
-    info.pDynamicState = nullptr;
+    //the default pipeline is compiled right away, everything waiting for its own pipeline is drawn with it
+    m_pipeline = m_pipelineStateCache->GetOrCreate(MakePipelineDesc(*m_shaderTriangle));
 
-    info.layout = m_pipelineLayout;
-
-    info.renderPass = m_renderPass;
-    info.subpass = 0;
-
-    info.basePipelineHandle = nullptr;
-    info.basePipelineIndex = 0;
-
-    m_pipeline = m_logicalDevice.createGraphicsPipeline(nullptr, info).value;
+    MarkSceneDirty();
 }
 
 void VulkanContext::CreateFramebuffers()
 {
     m_framebuffers.resize(m_swapChainViews.size());
 
-    //TODO: refactor this !!!
-    m_commandBuffersGraphics.resize(m_framebuffers.size());
-
-    vk::CommandBufferAllocateInfo info;
-
-    info.commandPool = m_commandPoolGraphics;
-    info.commandBufferCount = static_cast<u32>(m_commandBuffersGraphics.size());
-    info.level = vk::CommandBufferLevel::ePrimary;
-
-    m_commandBuffersGraphics = m_logicalDevice.allocateCommandBuffers(info);
-
-    info.commandPool = m_commandPoolTransfer;
-    info.commandBufferCount = 1;
-
-    m_commandBuffersTransfer = m_logicalDevice.allocateCommandBuffers(info);
-
-
     for (u32 i = 0; i < m_swapChainViews.size(); ++i)
     {
         const std::array views = { m_swapChainViews[i], m_swapchainDepthImagesViews[i] };
@@ -772,211 +1265,682 @@ void VulkanContext::CreateCommandPool()
 
 void VulkanContext::LoadEntities()
 {
-    m_mesh = new Mesh("assets/meshdesc/mesh.json");
-}
-
-std::pair<vk::Buffer, vk::DeviceMemory> VulkanContext::CreateVertexBuffer(const VerticesDeclarations& _decl)
-{
-    const vk::DeviceSize size = static_cast<vk::DeviceSize>(_decl.GetElementCount()) * _decl.GetByteSize();
-
-    vk::Buffer stagingBuffer;
-    vk::DeviceMemory stagingBufferMemory;
-
-    CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc
-        , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, stagingBuffer, stagingBufferMemory);
+    PROFILE_ZONE("VulkanContext::LoadEntities");
 
-    const auto mappedMem = static_cast<VerticesDeclarations*>(m_logicalDevice.mapMemory(stagingBufferMemory, 0, size));
+    m_mesh = new Mesh(m_benchmark ? m_benchmark->GetMeshDescPath().c_str() : "assets/meshdesc/mesh.json");
 
-    memcpy(mappedMem, _decl.GetData(), size);
-
-    m_logicalDevice.unmapMemory(stagingBufferMemory);
+    //the only mesh of the scene, there is nothing to render without it
+    if (!m_mesh->IsLoaded())
+    {
+        std::cout << "[Mesh] the mesh could not be loaded, see above" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 
-    vk::Buffer buffer;
-    vk::DeviceMemory memory;
+    //the texture array has a fixed size in the shaders, nothing can be drawn past it
+    if (m_mesh->GetMaterialCount() > MAX_MATERIAL_TEXTURES)
+    {
+        std::cout << "[Mesh] " << m_mesh->GetMaterialCount() << " materials, only " << MAX_MATERIAL_TEXTURES
+            << " fit in the texture array, raise MAX_MATERIAL_TEXTURES (and the one of the shaders)" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 
-    CreateBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer
-        , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, buffer, memory);
+    //everything the mesh needs has been queued, send it in one go
+    //the first frame waits on it on the gpu, no need to block here
+    m_uploadContext->Flush();
 
-    CopyBuffer(stagingBuffer, buffer, size);
+    std::cout << "[Upload] " << m_uploadContext->GetUploadedBytes() / 1024 << " KB uploaded in "
+        << m_uploadContext->GetSubmitCount() << " submits" << std::endl;
+}
 
-    m_logicalDevice.destroyBuffer(stagingBuffer);
-    m_logicalDevice.freeMemory(stagingBufferMemory);
+std::pair<vk::Buffer, vma::Allocation> VulkanContext::CreateVertexBuffer(const VerticesDeclarations& _decl)
+{
+    const vk::DeviceSize size = static_cast<vk::DeviceSize>(_decl.GetElementCount()) * _decl.GetByteSize();
 
-    return { buffer, memory };
+    return CreateStaticBuffer(_decl.GetData(), size, vk::BufferUsageFlagBits::eVertexBuffer);
 }
 
-std::pair<vk::Buffer, vk::DeviceMemory> VulkanContext::CreateIndexBuffer(const std::vector<u16>& indices)
+std::pair<vk::Buffer, vma::Allocation> VulkanContext::CreateIndexBuffer(const std::vector<u16>& indices)
 {
 	const vk::DeviceSize size = sizeof(u16) * indices.size();
 
-    vk::Buffer stagingBuffer;
-    vk::DeviceMemory stagingBufferMemory;
-
-    vk::Buffer indexBuffer;
-    vk::DeviceMemory indexBufferMemory;
-
-    CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc
-        , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, stagingBuffer, stagingBufferMemory);
-
-    u16* mappedMem = static_cast<u16*>(m_logicalDevice.mapMemory(stagingBufferMemory, 0, size));
-
-    memcpy(mappedMem, indices.data(), size);
+    return CreateStaticBuffer(indices.data(), size, vk::BufferUsageFlagBits::eIndexBuffer);
+}
 
-    m_logicalDevice.unmapMemory(stagingBufferMemory);
+std::pair<vk::Buffer, vma::Allocation> VulkanContext::CreateStaticBuffer(const void* _data, vk::DeviceSize _size, vk::BufferUsageFlags _usage)
+{
+    return CreateStaticBuffer(_size, _usage, [_data, _size](void* _dst) { memcpy(_dst, _data, _size); });
+}
 
-    CreateBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer
-        , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, indexBuffer, indexBufferMemory);
+std::pair<vk::Buffer, vma::Allocation> VulkanContext::CreateStaticBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, const std::function<void(void* _dst)>& _write)
+{
+    vk::Buffer buffer;
+    vma::Allocation memory;
 
-    CopyBuffer(stagingBuffer, indexBuffer, size);
+    CreateBuffer(_size, m_geometryDirectWrite ? _usage : _usage | vk::BufferUsageFlagBits::eTransferDst, EMemoryPool::Geometry, buffer, memory);
+    WriteStaticBuffer(buffer, memory, 0, _size, _write);
 
-    m_logicalDevice.destroyBuffer(stagingBuffer);
-    m_logicalDevice.freeMemory(stagingBufferMemory);
+    return { buffer, memory };
+}
 
-    return { indexBuffer, indexBufferMemory };
+void VulkanContext::WriteStaticBuffer(vk::Buffer _buffer, vma::Allocation _memory, vk::DeviceSize _offset, vk::DeviceSize _size, const std::function<void(void* _dst)>& _write)
+{
+    if (m_geometryDirectWrite)
+    {
+        //the memory is coherent and the write happens before any submit using the range, no flush or barrier needed
+        u8* data = static_cast<u8*>(s_allocator.mapMemory(_memory));
+        _write(data + _offset);
+        s_allocator.unmapMemory(_memory);
+    }
+    else
+    {
+        //written in the staging ring itself, the copy to the buffer is recorded once it is filled
+        const UploadContext::BufferReservation reservation = m_uploadContext->ReserveBuffer(_buffer, _size, _offset);
+        _write(reservation.GetData());
+        m_uploadContext->CommitBuffer(reservation);
+    }
 }
 
 void VulkanContext::CreateUniformBuffers()
 {
-	m_uboBuffers.resize(m_swapchainImages.size() * m_mesh->GetSubMeshes().size());
-    m_uboBuffersMemory.resize(m_swapchainImages.size() * m_mesh->GetSubMeshes().size());
+    //one region per swapchain image rather than per frame in flight: the offsets of an image never change,
+    //so its cached command buffers stay valid, and its fence already protects the region
+    if (m_uniformAllocator && m_uniformAllocator->GetRegionCount() == m_swapchainImages.size())
+        return;
 
-    for (u32 i = 0; i < m_uboBuffers.size(); ++i)
-    {
-	    constexpr vk::DeviceSize size = sizeof(UBO);
-	    CreateBuffer(size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-	                 m_uboBuffers[i], m_uboBuffersMemory[i]);
-    }
+    delete m_uniformAllocator;
+    delete m_drawBatcher;
+
+    const vk::PhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
+
+    m_uniformAllocator = new UniformAllocator(UNIFORM_FRAME_SIZE, static_cast<u32>(m_swapchainImages.size())
+        , limits.minUniformBufferOffsetAlignment);
+
+    //same rules for the draws
+    m_drawBatcher = new DrawBatcher(MAX_DRAWS, static_cast<u32>(m_swapchainImages.size()), limits.minStorageBufferOffsetAlignment, !m_useIndirectBatches);
 }
 
 void VulkanContext::CreateDescriptorPool()
 {
     vk::DescriptorPoolSize poolSizeUbo;
-    poolSizeUbo.type = vk::DescriptorType::eUniformBuffer;
-    poolSizeUbo.descriptorCount = m_swapchainImages.size() * m_mesh->GetSubMeshes().size();
+    poolSizeUbo.type = vk::DescriptorType::eUniformBufferDynamic;
+    poolSizeUbo.descriptorCount = 1;
 
     vk::DescriptorPoolSize poolSizeSampler;
     poolSizeSampler.type = vk::DescriptorType::eCombinedImageSampler;
-    poolSizeSampler.descriptorCount = m_swapchainImages.size() * m_mesh->GetSubMeshes().size();
+    poolSizeSampler.descriptorCount = MAX_MATERIAL_TEXTURES;
 
-    const std::array poolSizes = { poolSizeUbo, poolSizeSampler};
+    vk::DescriptorPoolSize poolSizeDrawData;
+    poolSizeDrawData.type = vk::DescriptorType::eStorageBufferDynamic;
+    poolSizeDrawData.descriptorCount = 1;
+
+    const std::array poolSizes = { poolSizeUbo, poolSizeSampler, poolSizeDrawData };
 
     vk::DescriptorPoolCreateInfo info;
     info.pPoolSizes = poolSizes.data();
     info.poolSizeCount = poolSizes.size();
-    info.maxSets = m_swapchainImages.size() * m_mesh->GetSubMeshes().size();
+    info.maxSets = 1;
 
     m_descriptorPool = m_logicalDevice.createDescriptorPool(info);
 }
 
 void VulkanContext::CreateDescriptorSets()
 {
-    const std::vector<vk::DescriptorSetLayout> layouts(m_swapchainImages.size() * m_mesh->GetSubMeshes().size(), m_descriptorSetLayout);
+    //the ubo and the draw data are bound with dynamic offsets, one set is enough for every draw
     vk::DescriptorSetAllocateInfo info;
-    info.pSetLayouts = layouts.data();
+    info.pSetLayouts = &m_descriptorSetLayout;
     info.descriptorPool = m_descriptorPool;
-    info.descriptorSetCount = m_swapchainImages.size() * m_mesh->GetSubMeshes().size();
+    info.descriptorSetCount = 1;
+
+    m_descriptorSet = m_logicalDevice.allocateDescriptorSets(info)[0];
+
+    const auto& subMeshes = m_mesh->GetSubMeshes();
 
-    m_descriptorSets = m_logicalDevice.allocateDescriptorSets(info);
+    //checked at load, an index past the array would be read out of bounds by the shader
+    assert(m_mesh->GetMaterialCount() <= MAX_MATERIAL_TEXTURES);
 
-    for (u32 i = 0; i < m_swapchainImages.size(); ++i)
+    //the material index of a draw is the one of its submesh, the slots after the materials repeat the first one
+    //so that the whole array is valid
+    std::array<vk::DescriptorImageInfo, MAX_MATERIAL_TEXTURES> imageInfos;
+
+    for (u32 i = 0; i < MAX_MATERIAL_TEXTURES; ++i)
     {
-	    for (u32 j = 0; j < m_mesh->GetSubMeshes().size(); ++j)
-	    {
-            const auto index = i * m_mesh->GetSubMeshes().size() + j;
-            vk::DescriptorBufferInfo bufferInfo;
-            bufferInfo.offset = 0;
-            bufferInfo.buffer = m_uboBuffers[index];
-            bufferInfo.range = VK_WHOLE_SIZE; // or sizeof(UBO)
+        const Texture2D& texture = subMeshes[0]->textures[0];
 
-            vk::DescriptorImageInfo imageInfo;
-            imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            //todo: refactor this
-            imageInfo.imageView = m_mesh->GetSubMeshes()[j]->textures[0].GetView();
-            imageInfo.sampler = m_mesh->GetSubMeshes()[j]->textures[0].GetSampler();
+        imageInfos[i].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        imageInfos[i].imageView = texture.GetView();
+        imageInfos[i].sampler = texture.GetSampler();
+    }
 
-            vk::WriteDescriptorSet writeBuffer;
-            writeBuffer.dstSet = m_descriptorSets[index];
-            writeBuffer.dstBinding = 0;
-            writeBuffer.dstArrayElement = 0;
+    //the submeshes of a material have the same textures, any of them fills its slot
+    for (const auto& subMesh : subMeshes)
+    {
+        imageInfos[subMesh->materialIndex].imageView = subMesh->textures[0].GetView();
+        imageInfos[subMesh->materialIndex].sampler = subMesh->textures[0].GetSampler();
+    }
 
-            writeBuffer.descriptorType = vk::DescriptorType::eUniformBuffer;
-            writeBuffer.descriptorCount = 1;
+    vk::DescriptorBufferInfo bufferInfo;
+    bufferInfo.offset = 0;
+    bufferInfo.buffer = m_uniformAllocator->GetBuffer();
+    bufferInfo.range = sizeof(UBO);
 
-            writeBuffer.pBufferInfo = &bufferInfo;
+    vk::DescriptorBufferInfo drawDataInfo;
+    drawDataInfo.offset = 0;
+    drawDataInfo.buffer = m_drawBatcher->GetBuffer();
+    drawDataInfo.range = m_drawBatcher->GetDrawDataRange();
 
-            vk::WriteDescriptorSet writeImage;
-            writeImage.dstSet = m_descriptorSets[index];
-            writeImage.dstBinding = 1;
-            writeImage.dstArrayElement = 0;
+    vk::WriteDescriptorSet writeBuffer;
+    writeBuffer.dstSet = m_descriptorSet;
+    writeBuffer.dstBinding = 0;
+    writeBuffer.dstArrayElement = 0;
 
-            writeImage.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-            writeImage.descriptorCount = 1;
+    writeBuffer.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    writeBuffer.descriptorCount = 1;
 
-            writeImage.pImageInfo = &imageInfo;
+    writeBuffer.pBufferInfo = &bufferInfo;
 
-            std::array writes = { writeImage, writeBuffer };
+    vk::WriteDescriptorSet writeImage;
+    writeImage.dstSet = m_descriptorSet;
+    writeImage.dstBinding = 1;
+    writeImage.dstArrayElement = 0;
 
-            m_logicalDevice.updateDescriptorSets(writes.size(), writes.data(), 0, nullptr);
-	    }
-        
+    writeImage.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    writeImage.descriptorCount = MAX_MATERIAL_TEXTURES;
+
+    writeImage.pImageInfo = imageInfos.data();
+
+    vk::WriteDescriptorSet writeDrawData;
+    writeDrawData.dstSet = m_descriptorSet;
+    writeDrawData.dstBinding = 2;
+    writeDrawData.dstArrayElement = 0;
+
+    writeDrawData.descriptorType = vk::DescriptorType::eStorageBufferDynamic;
+    writeDrawData.descriptorCount = 1;
+
+    writeDrawData.pBufferInfo = &drawDataInfo;
+
+    std::array writes = { writeImage, writeBuffer, writeDrawData };
+
+    m_logicalDevice.updateDescriptorSets(writes.size(), writes.data(), 0, nullptr);
+
+    //the cached command buffers bind the old set
+    MarkSceneDirty();
+}
+
+void VulkanContext::CreateRecordingResources()
+{
+    vk::CommandBufferAllocateInfo primaryInfo;
+    primaryInfo.commandPool = m_commandPoolGraphics;
+    primaryInfo.commandBufferCount = static_cast<u32>(m_framebuffers.size());
+    primaryInfo.level = vk::CommandBufferLevel::ePrimary;
+
+    m_commandBuffersGraphics = m_logicalDevice.allocateCommandBuffers(primaryInfo);
+
+    const u32 maxThreads = GetMaxRecordingThreads();
+
+    m_recordingSlots.resize(m_framebuffers.size() * maxThreads);
+
+    //one pool per slot, so the workers never touch the same pool and a slot can be reset as a whole
+    vk::CommandPoolCreateInfo poolInfo;
+    poolInfo.queueFamilyIndex = m_familiesAvailable.graphicsFamily.value_or(-1);
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+    for (auto& slot : m_recordingSlots)
+    {
+        slot.pool = m_logicalDevice.createCommandPool(poolInfo);
+
+        vk::CommandBufferAllocateInfo info;
+        info.commandPool = slot.pool;
+        info.commandBufferCount = 1;
+        info.level = vk::CommandBufferLevel::eSecondary;
+
+        slot.cmd = m_logicalDevice.allocateCommandBuffers(info)[0];
+    }
+
+    vk::CommandBufferAllocateInfo info;
+    info.commandPool = m_commandPoolGraphics;
+    info.commandBufferCount = static_cast<u32>(m_framebuffers.size());
+    info.level = vk::CommandBufferLevel::eSecondary;
+
+    m_commandBuffersImGui = m_logicalDevice.allocateCommandBuffers(info);
+
+    //nothing recorded yet
+    m_recordedGeometry.assign(m_framebuffers.size(), RecordedGeometry());
+
+    const auto families = m_physicalDevice.getQueueFamilyProperties();
+
+    m_gpuProfiler = new GpuProfiler(m_logicalDevice, m_physicalDevice.getProperties()
+        , families[m_familiesAvailable.graphicsFamily.value()].timestampValidBits, static_cast<u32>(m_framebuffers.size()));
+
+    m_gpuScopeMainPass = m_gpuProfiler->RegisterScope("Main pass");
+    m_gpuScopeImGui = m_gpuProfiler->RegisterScope("ImGui");
+    m_gpuScopeDepthPyramid = m_gpuProfiler->RegisterScope("Depth pyramid");
+
+    m_gpuScopesGeometry.resize(maxThreads);
+
+    for (u32 i = 0; i < maxThreads; ++i)
+    {
+        m_gpuScopesGeometry[i] = m_gpuProfiler->RegisterScope("Geometry batch " + std::to_string(i));
+    }
+}
+
+void VulkanContext::DestroyRecordingResources()
+{
+    m_logicalDevice.freeCommandBuffers(m_commandPoolGraphics, m_commandBuffersGraphics);
+    m_commandBuffersGraphics.clear();
+
+    for (const auto& slot : m_recordingSlots)
+    {
+        m_logicalDevice.destroyCommandPool(slot.pool);
     }
+
+    m_recordingSlots.clear();
+
+    m_logicalDevice.freeCommandBuffers(m_commandPoolGraphics, m_commandBuffersImGui);
+    m_commandBuffersImGui.clear();
+
+    delete m_gpuProfiler;
+    m_gpuProfiler = nullptr;
+}
+
+void VulkanContext::MarkSceneDirty()
+{
+    m_sceneVersion++;
 }
 
-void VulkanContext::CreateCommandBuffers(u32 _frameIndex)
+void VulkanContext::SelectLods()
 {
+    const auto& subMeshes = m_mesh->GetSubMeshes();
+
+    m_selectedLods.resize(subMeshes.size(), 0);
+
+    //pixels covered by one unit of error seen from a distance of one unit
+    const float pixelsPerUnit = static_cast<float>(m_actualSwapChainExtent.height) / (2.0f * std::tan(radians(Camera::FIELD_OF_VIEW_DEGREES) * 0.5f));
+    const vec3 cameraPosition = m_camera->GetPosition();
+
+    for (u32 i = 0; i < subMeshes.size(); ++i)
+    {
+        const SubMesh& subMesh = *subMeshes[i];
+        const u32 lodCount = static_cast<u32>(subMesh.lods.size());
+        u32 lod = 0;
+
+        if (m_forcedLod >= 0)
+        {
+            lod = std::min(static_cast<u32>(m_forcedLod), lodCount - 1);
+        }
+        else
+        {
+            //the model matrices are the identity, the bounds are already in world space
+            //every repeated draw of a submesh is at the same place, they all get the same lod
+            const vec3 center = (subMesh.boundsMin + subMesh.boundsMax) * 0.5f;
+            const float radius = subMesh.boundsRadius;
+
+            //from the closest point of the bounds, the finest lod is kept inside them
+            const float distance = std::max(length(center - cameraPosition) - radius, Camera::NEAR_PLANE);
+
+            //the errors grow along the chain, the coarsest lod under the threshold is the last one
+            while (lod + 1 < lodCount && subMesh.lods[lod + 1].error * pixelsPerUnit / distance <= m_lodErrorThresholdPixels)
+            {
+                lod++;
+            }
+        }
+
+        m_selectedLods[i] = lod;
+    }
+}
+
+void VulkanContext::BuildDraws(u32 _imageIndex)
+{
+    PROFILE_ZONE("VulkanContext::BuildDraws");
+
+    const auto& subMeshes = m_mesh->GetSubMeshes();
+
+    //compiled in the background the first time, the default one is used until then
+    vk::Pipeline meshPipeline = m_pipelineStateCache->Request(MakePipelineDesc(m_mesh->GetShader()));
+
+    if (!meshPipeline)
+    {
+        meshPipeline = m_pipeline;
+    }
+
+    //the fence of the last frame that used this image was waited on, its region is free
+    m_drawBatcher->BeginFrame(_imageIndex);
+
+    m_triangleCount = 0;
+
+    //the model matrices are the identity, the bounds of the mesh are tested as they are
+    //the culled submeshes keep their command with no instance, the groups stay the same whatever the camera
+    //and the cached secondaries with them, only the content of the commands changes
+    m_isSubMeshVisible.assign(subMeshes.size(), !m_useCpuCulling);
+
+    if (m_useCpuCulling)
+    {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        m_mesh->GetCullingBounds().Cull(Frustum::FromViewProjection(m_viewProj), m_visibleSubMeshes);
+
+        const float cullTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+        m_cpuCullTimeMs = m_cpuCullTimeMs * 0.95f + cullTime * 0.05f;
+
+        for (const u32 i : m_visibleSubMeshes)
+        {
+            m_isSubMeshVisible[i] = true;
+        }
+    }
+
+    //every submesh goes through the same pipeline for now, they already come sorted by pipeline
+    for (u32 repeat = 0; repeat < m_drawRepeat; ++repeat)
+    {
+        for (u32 i = 0; i < subMeshes.size(); ++i)
+        {
+            const SubMesh& subMesh = *subMeshes[i];
+            const MeshLod& lod = subMesh.lods[m_selectedLods[i]];
+            const bool isVisible = m_isSubMeshVisible[i];
+
+            vk::DrawIndexedIndirectCommand command;
+            command.indexCount = lod.indexCount;
+            command.instanceCount = isVisible ? 1 : 0;
+            command.firstIndex = subMesh.indices.GetFirstIndex() + lod.firstIndex;
+            command.vertexOffset = static_cast<i32>(subMesh.vertices.GetFirstVertex());
+
+            DrawData data{};
+            data.model = mat4(1.0f);
+            data.boundsMin = vec4(subMesh.boundsMin, 0.0f);
+            data.boundsExtent = vec4(subMesh.boundsMax - subMesh.boundsMin, 0.0f);
+            data.materialIndex = subMesh.materialIndex;
+
+            m_drawBatcher->Add(meshPipeline, command, data);
+
+            if (isVisible)
+                m_triangleCount += lod.indexCount / 3;
+        }
+    }
+
+    m_drawBatcher->EndFrame();
+
+    m_drawCount = m_drawBatcher->GetDrawCount();
+}
+
+void VulkanContext::RecordGeometry(u32 _imageIndex, u32 _uboOffset, const vk::CommandBufferInheritanceInfo& _inheritanceInfo)
+{
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    //the commands are split in one contiguous slice per thread, each recorded in its own secondary
+    //a slice is one indirect call per group it overlaps, whatever the number of draws in it
+    //with the gpu culling, the visible draws of a group are only known on the gpu, a group can't be split: one secondary for all of them
+    const std::vector<DrawBatcher::Group>& groups = m_drawBatcher->GetGroups();
+    const u32 drawCount = m_drawBatcher->GetDrawCount();
+    const u32 threadCount = m_useGpuCulling ? 1 : std::min(m_recordingThreadCount, GetMaxRecordingThreads());
+    const u32 drawsPerThread = (drawCount + threadCount - 1) / threadCount;
+
+    //the region of the image never moves, the secondaries stay valid while the commands in it change
+    const std::array dynamicOffsets = { _uboOffset, m_drawBatcher->GetDrawDataOffset() };
+
+    //dynamic state, the pipelines do not depend on the size of the swapchain
+    vk::Viewport viewport;
+    viewport.maxDepth = 1.0f;
+    viewport.width = static_cast<float>(m_actualSwapChainExtent.width);
+    viewport.height = static_cast<float>(m_actualSwapChainExtent.height);
+
+    vk::Rect2D scissor;
+    scissor.extent = m_actualSwapChainExtent;
+
+    m_threadPool->ParallelFor(threadCount, [&](u32 _thread)
+    {
+        PROFILE_ZONE("Record geometry batch");
+
+        const RecordingSlot& slot = m_recordingSlots[_imageIndex * GetMaxRecordingThreads() + _thread];
+
+        m_logicalDevice.resetCommandPool(slot.pool);
+
+        //not one time submit, it is replayed until the scene changes
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+        beginInfo.pInheritanceInfo = &_inheritanceInfo;
+
+        slot.cmd.begin(beginInfo);
+        //the queries of this image are reset by the primary before each replay
+        m_gpuProfiler->Begin(slot.cmd, m_gpuScopesGeometry[_thread]);
+        slot.cmd.setViewport(0, viewport);
+        slot.cmd.setScissor(0, scissor);
+
+        //every submesh is a range of these two, bound once for the whole batch
+        const vk::Buffer vertexBuffers[] = { m_geometryArena->GetVertexBuffer() };
+        constexpr vk::DeviceSize offsets[] = { 0 };
+
+        slot.cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+        slot.cmd.bindIndexBuffer(m_geometryArena->GetIndexBuffer(), 0, vk::IndexType::eUint16);
+        slot.cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0, 1
+            , &m_descriptorSet, static_cast<u32>(dynamicOffsets.size()), dynamicOffsets.data());
+
+        const u32 begin = _thread * drawsPerThread;
+        const u32 end = std::min(drawCount, begin + drawsPerThread);
+
+        for (u32 groupIndex = 0; groupIndex < groups.size(); ++groupIndex)
+        {
+            const DrawBatcher::Group& group = groups[groupIndex];
+            const u32 first = std::max(begin, group.firstDraw);
+            const u32 last = std::min(end, group.firstDraw + group.drawCount);
+
+            if (first >= last)
+                continue;
+
+            slot.cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, group.pipeline);
+
+            if (m_useGpuCulling)
+            {
+                //the survivors are packed at the start of the range of the group, the count is written next to them
+                slot.cmd.drawIndexedIndirectCount(m_gpuCulling->GetVisibleCommandBuffer(), m_gpuCulling->GetVisibleCommandOffset(_imageIndex, first)
+                    , m_gpuCulling->GetCountBuffer(), m_gpuCulling->GetCountOffset(_imageIndex, groupIndex), last - first
+                    , sizeof(vk::DrawIndexedIndirectCommand));
+            }
+            else if (m_useIndirectBatches)
+            {
+                slot.cmd.drawIndexedIndirect(m_drawBatcher->GetBuffer(), m_drawBatcher->GetCommandOffset(first), last - first
+                    , sizeof(vk::DrawIndexedIndirectCommand));
+            }
+            else
+            {
+                //baked in the secondary, the lods have to be recorded again every frame
+                for (u32 draw = first; draw < last; ++draw)
+                {
+                    const vk::DrawIndexedIndirectCommand& command = m_drawBatcher->GetCommand(draw);
+                    slot.cmd.drawIndexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+                }
+            }
+        }
+
+        m_gpuProfiler->End(slot.cmd, m_gpuScopesGeometry[_thread]);
+        slot.cmd.end();
+    });
+
+    RecordedGeometry& recorded = m_recordedGeometry[_imageIndex];
+    recorded.sceneVersion = m_sceneVersion;
+    recorded.uboOffset = _uboOffset;
+    recorded.threadCount = threadCount;
+    recorded.groups = groups;
+
+    const float recordTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    //smoothed, the raw value is too noisy to read
+    m_recordTimeMs = m_recordTimeMs * 0.95f + recordTime * 0.05f;
+    m_geometryRecordCount++;
+}
+
+void VulkanContext::CreateCommandBuffers(u32 _imageIndex, u32 _uboOffset)
+{
+    PROFILE_ZONE("VulkanContext::CreateCommandBuffers");
+
     std::array<vk::ClearValue, 2> clearValues;
     clearValues[0].color.setFloat32({ 0.0f, 0.0f, 0.0f, 1.0f }); //color
     clearValues[1].depthStencil.depth = 1.0f; // 1.0 here because vulkan goes [0;1] 1 == far
 
-    //for (u32 i = 0; i < commandBuffersGraphics.size(); ++i)
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    vk::CommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo.renderPass = m_renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = m_framebuffers[_imageIndex];
+
+    vk::CommandBuffer& cmd = m_commandBuffersGraphics[_imageIndex];
+
+    vk::CommandBufferBeginInfo infoBuffer;
+    cmd.begin(infoBuffer);
+
+    //before any secondary is recorded, they write in the queries of this image
+    m_gpuProfiler->BeginFrame(_imageIndex, cmd, m_frameNumber);
+
+    //pick up the pipelines compiled in the background since the last frame
+    if (m_pipelineStateCache->ConsumeNewlyReady())
     {
-	    const auto i = _frameIndex;
-	    vk::CommandBufferBeginInfo infoBuffer;
-        //infoBuffer.setFlags()
+        MarkSceneDirty();
+    }
 
-        m_commandBuffersGraphics[i].begin(infoBuffer);
+    SelectLods();
+    BuildDraws(_imageIndex);
 
-        vk::RenderPassBeginInfo renderPassBeginInfo;
+    //submitted right away on the compute queue, the graphics submit of the frame waits for it
+    if (m_useGpuCulling)
+    {
+        m_gpuCulling->Cull(_imageIndex, *m_drawBatcher, m_viewProj, m_useOcclusionCulling, m_frameNumber);
+    }
 
-        renderPassBeginInfo.renderPass = m_renderPass;
-        renderPassBeginInfo.framebuffer = m_framebuffers[i];
-        renderPassBeginInfo.renderArea.extent = m_actualSwapChainExtent;
-        //renderPassBeginInfo.renderArea.offset
+    //the camera goes through the ubo and the lods through the indirect commands,
+    //the geometry is only re-recorded when the groups, the pipeline or the descriptors change, or every frame without indirect batches
+    const RecordedGeometry& recorded = m_recordedGeometry[_imageIndex];
 
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
+    if (!m_useIndirectBatches || recorded.sceneVersion != m_sceneVersion || recorded.uboOffset != _uboOffset
+        || recorded.groups != m_drawBatcher->GetGroups())
+    {
+        RecordGeometry(_imageIndex, _uboOffset, inheritanceInfo);
+    }
 
-        m_commandBuffersGraphics[i].beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-        m_commandBuffersGraphics[i].bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline);
+    std::vector<vk::CommandBuffer> secondaries;
+    secondaries.reserve(recorded.threadCount + 1);
 
-        for (int j = 0; j < m_mesh->GetSubMeshes().size(); ++j)
-        {
-            const vk::Buffer vertexBuffers[] = { m_mesh->GetSubMeshes()[j]->vertices.GetBuffer()};
-            constexpr vk::DeviceSize offsets[] = { 0 };
+    for (u32 i = 0; i < recorded.threadCount; ++i)
+    {
+        secondaries.emplace_back(m_recordingSlots[_imageIndex * GetMaxRecordingThreads() + i].cmd);
+    }
 
-            m_commandBuffersGraphics[i].bindVertexBuffers(0, 1, vertexBuffers, offsets);
-            m_commandBuffersGraphics[i].bindIndexBuffer(m_mesh->GetSubMeshes()[j]->indices.GetBuffer(), 0, vk::IndexType::eUint16);
-            m_commandBuffersGraphics[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0, 1
-                , &m_descriptorSets[i * m_mesh->GetSubMeshes().size() + j], 0, nullptr);
+    //imgui changes every frame, it has its own secondary
+    {
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-            m_commandBuffersGraphics[i].drawIndexed(m_mesh->GetSubMeshes()[j]->indices.GetSize(), 1, 0, 0, 0);
-        }
+        m_commandBuffersImGui[_imageIndex].begin(beginInfo);
+        m_gpuProfiler->Begin(m_commandBuffersImGui[_imageIndex], m_gpuScopeImGui);
 
+        if (!m_options.headless && ImGui::GetDrawData())
+            ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffersImGui[_imageIndex]);
 
-        if (ImGui::GetDrawData())
-			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffersGraphics[i]);
+        m_gpuProfiler->End(m_commandBuffersImGui[_imageIndex], m_gpuScopeImGui);
+        m_commandBuffersImGui[_imageIndex].end();
 
-        m_commandBuffersGraphics[i].endRenderPass();
-        m_commandBuffersGraphics[i].end();
+        secondaries.emplace_back(m_commandBuffersImGui[_imageIndex]);
     }
+
+    vk::RenderPassBeginInfo renderPassBeginInfo;
+
+    renderPassBeginInfo.renderPass = m_renderPass;
+    renderPassBeginInfo.framebuffer = m_framebuffers[_imageIndex];
+    renderPassBeginInfo.renderArea.extent = m_actualSwapChainExtent;
+
+    renderPassBeginInfo.clearValueCount = clearValues.size();
+    renderPassBeginInfo.pClearValues = clearValues.data();
+
+    //nothing but executeCommands is allowed in the pass itself, the secondaries time their own work
+    m_gpuProfiler->Begin(cmd, m_gpuScopeMainPass);
+    cmd.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+    cmd.executeCommands(secondaries);
+    cmd.endRenderPass();
+    m_gpuProfiler->End(cmd, m_gpuScopeMainPass);
+
+    //for the occlusion test of the next frame
+    if (m_useGpuCulling)
+    {
+        m_gpuProfiler->Begin(cmd, m_gpuScopeDepthPyramid);
+        m_gpuCulling->RecordDepthPyramid(cmd, _imageIndex, m_swapchainDepthImages[_imageIndex]);
+        m_gpuProfiler->End(cmd, m_gpuScopeDepthPyramid);
+    }
+
+    m_gpuProfiler->EndFrame(cmd);
+    cmd.end();
+
+    const float frameRecordTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    m_frameRecordTimeMs = m_frameRecordTimeMs * 0.95f + frameRecordTime * 0.05f;
+}
+
+void VulkanContext::DrawRenderingGUI()
+{
+    ImGui::Begin("Rendering");
+
+    int threads = static_cast<int>(m_recordingThreadCount);
+    if (ImGui::SliderInt("Recording threads", &threads, 1, static_cast<int>(GetMaxRecordingThreads())))
+    {
+        m_recordingThreadCount = static_cast<u32>(threads);
+        MarkSceneDirty();
+    }
+
+    //only here to stress the draws, the same submeshes are drawn on top of each other
+    const int maxRepeat = std::max(1, static_cast<int>(m_drawBatcher->GetMaxDraws() / m_mesh->GetSubMeshes().size()));
+    int repeat = static_cast<int>(m_drawRepeat);
+    if (ImGui::SliderInt("Draw repeat", &repeat, 1, std::min(1000, maxRepeat)))
+    {
+        m_drawRepeat = static_cast<u32>(repeat);
+        MarkSceneDirty();
+    }
+
+    ImGui::Text("Draws: %u in %u indirect groups", m_drawCount, static_cast<u32>(m_drawBatcher->GetGroups().size()));
+
+    //the culled draws are kept with no instance, the secondaries are not recorded again
+    ImGui::Checkbox("CPU frustum culling", &m_useCpuCulling);
+
+    if (m_useCpuCulling)
+    {
+        ImGui::Text("Visible submeshes: %u / %u, %.3f ms (%s)", static_cast<u32>(m_visibleSubMeshes.size()), m_mesh->GetCullingBounds().GetCount()
+            , m_cpuCullTimeMs, CullingBounds::GetPathName(CullingBounds::GetBestPath()));
+    }
+
+    //the draw calls change, so do the secondaries
+    if (!m_supportsGpuCulling)
+    {
+        ImGui::Text("GPU culling: not supported by the device");
+    }
+    else if (ImGui::Checkbox("GPU culling", &m_useGpuCulling))
+    {
+        MarkSceneDirty();
+    }
+
+    if (m_useGpuCulling)
+    {
+        //read in the uniforms of the cull, nothing to re-record
+        ImGui::Checkbox("Occlusion culling (previous frame depth)", &m_useOcclusionCulling);
+
+        const GpuCulling::Stats& stats = m_gpuCulling->GetStats();
+        ImGui::Text("Visible: %u, frustum culled: %u, occlusion culled: %u", stats.visible, stats.frustumCulled, stats.occlusionCulled);
+    }
+
+    ImGui::SliderFloat("LOD error (pixels)", &m_lodErrorThresholdPixels, 0.1f, 16.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderInt("Forced LOD", &m_forcedLod, -1, static_cast<int>(MeshSimplifier::MAX_LOD_COUNT) - 1);
+    ImGui::Text("Triangles: %llu", static_cast<unsigned long long>(m_triangleCount));
+    ImGui::Text("Geometry record time: %.3f ms (%u recordings)", m_recordTimeMs, m_geometryRecordCount);
+    ImGui::Text("Frame record time: %.3f ms", m_frameRecordTimeMs);
+    ImGui::Text("Pipelines: %u ready, %u compiling", m_pipelineStateCache->GetPipelineCount(), m_pipelineStateCache->GetPendingCount());
+
+    if (ImGui::Button("Force re-record"))
+    {
+        MarkSceneDirty();
+    }
+
+    ImGui::End();
 }
 
 void VulkanContext::CreateSyncObjects()
 {
 	vk::FenceCreateInfo infoFence;
 
-	m_fenceImagesInFlight.fill(std::optional<vk::Fence>());
-
     //to not wait the first time we wait for it
     infoFence.setFlags(vk::FenceCreateFlagBits::eSignaled);
 
@@ -989,7 +1953,7 @@ void VulkanContext::CreateSyncObjects()
     }
 }
 
-void VulkanContext::UpdateUniformBuffer(const vk::ResultValue<unsigned>& imageIndex) const
+u32 VulkanContext::UpdateUniformBuffer(u32 _imageIndex)
 {
     const auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -998,7 +1962,6 @@ void VulkanContext::UpdateUniformBuffer(const vk::ResultValue<unsigned>& imageIn
     const float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
     UBO ubo{};
-    ubo.model = mat4(1.0f);//glm::rotate(glm::mat4(1.0), glm::radians(90.0f), glm::vec3(1, 0, 0));
     ubo.view = m_camera->GetView(); //glm::lookAt(glm::vec3(15.0, 30.0, 15.0), glm::vec3(0), glm::vec3(0, 1, 0));
     ubo.proj = m_camera->GetProjection();//glm::perspective(glm::radians(65.0f),
                                 //static_cast<float>(actualSwapChainExtent.width) / static_cast<float>(actualSwapChainExtent.height), 0.1f,
@@ -1007,16 +1970,24 @@ void VulkanContext::UpdateUniformBuffer(const vk::ResultValue<unsigned>& imageIn
     //flipped y for vulkan
     ubo.proj[1][1] *= -1;
 
-    //todo: add update for all descriptors (one for each submesh), probably use some push constants/ push once and update once
+    m_viewProj = ubo.proj * ubo.view;
 
-    for (u32 i = 0; i < m_mesh->GetSubMeshes().size(); ++i)
-    {
-        auto* data = m_logicalDevice.mapMemory(m_uboBuffersMemory[imageIndex.value * m_mesh->GetSubMeshes().size() + i], 0, sizeof(UBO));
+    //the fence of the last frame that used this image was waited on, its region is free
+    m_uniformAllocator->BeginFrame(_imageIndex);
 
-        memcpy(data, &ubo, sizeof(UBO));
+    //every submesh shares the same matrices for now
+    u32 offset = 0;
 
-        m_logicalDevice.unmapMemory(m_uboBuffersMemory[imageIndex.value * m_mesh->GetSubMeshes().size() + i]);
+    //the region is sized for a frame once, there is no frame to draw without its matrices
+    if (!m_uniformAllocator->Push(ubo, offset))
+    {
+        std::cout << "[Vulkan] the uniforms of the frame don't fit in UNIFORM_FRAME_SIZE" << std::endl;
+        std::exit(EXIT_FAILURE);
     }
+
+    m_uniformAllocator->EndFrame();
+
+    return offset;
 }
 
 void VulkanContext::DestroyDepthResources()
@@ -1024,8 +1995,7 @@ void VulkanContext::DestroyDepthResources()
 	for (int i = 0; i < m_swapchainDepthImages.size(); ++i)
 	{
 		m_logicalDevice.destroyImageView(m_swapchainDepthImagesViews[i]);
-        m_logicalDevice.freeMemory(m_swapchainDepthImagesMemory[i]);
-        m_logicalDevice.destroyImage(m_swapchainDepthImages[i]);
+        DestroyImage(m_swapchainDepthImages[i], m_swapchainDepthImagesMemory[i]);
 	}
 
     m_swapchainDepthImages.clear();
@@ -1035,34 +2005,16 @@ void VulkanContext::DestroyDepthResources()
 
 void VulkanContext::CleanUpSwapChain()
 {
-	for (u32 i = 0; i < m_uboBuffers.size(); ++i)
-	{
-        m_logicalDevice.destroyBuffer(m_uboBuffers[i]);
-        m_logicalDevice.freeMemory(m_uboBuffersMemory[i]);
-	}
-
-    m_logicalDevice.destroyDescriptorPool(m_descriptorPool);
-
-    m_logicalDevice.destroyShaderModule(m_shaderTriangle->shaderModuleFrag);
-    m_logicalDevice.destroyShaderModule(m_shaderTriangle->shaderModuleVert);
-
-    delete m_shaderTriangle;
-
-    m_logicalDevice.freeCommandBuffers(m_commandPoolGraphics, m_commandBuffersGraphics);
-    m_logicalDevice.freeCommandBuffers(m_commandPoolTransfer, m_commandBuffersTransfer);
-
+    //only what depends on the size of the window, the swapchain itself is kept to be passed as oldSwapchain
     DestroyFramebuffers();
-    m_logicalDevice.destroyPipeline(m_pipeline);
-    m_logicalDevice.destroyPipelineLayout(m_pipelineLayout);
-    m_logicalDevice.destroyRenderPass(m_renderPass);
-
     DestroySwapChainImageViews();
-    DestroySwapChain();
     DestroyDepthResources();
 }
 
 void VulkanContext::RecreateSwapChain()
 {
+    PROFILE_ZONE("VulkanContext::RecreateSwapChain");
+
     int width, height;
 
     glfwGetFramebufferSize(m_window, &width, &height);
@@ -1074,20 +2026,51 @@ void VulkanContext::RecreateSwapChain()
         glfwGetFramebufferSize(m_window, &width, &height);
     }
 
-    m_logicalDevice.waitIdle();
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    //only the frames still rendering to the old images need to finish, uploads and other queues keep going
+    const auto res = m_logicalDevice.waitForFences(m_fenceInFlight, true, UINT64_MAX);
+    assert(res == vk::Result::eSuccess);
+
+    const size_t previousImageCount = m_swapchainImages.size();
+    const vk::Format previousFormat = m_actualSwapChainFormat;
 
     CleanUpSwapChain();
 
     CreateSwapChain();
     CreateSwapChainViews();
     CreateDepthResources();
-    m_renderPass = CreateRenderPass(true, true, false, true);
-    CreateGraphicsPipeline();
     CreateFramebuffers();
-    CreateUniformBuffers();
-    CreateDescriptorPool();
-    CreateDescriptorSets();
-    CreateCommandBuffers(m_currentFrame);
+
+    //the render pass, pipelines and descriptors do not depend on the size, the format is always the same one
+    assert(previousFormat == m_actualSwapChainFormat);
+
+    //the per image resources only have to follow when the driver gives a different number of images
+    if (m_swapchainImages.size() != previousImageCount)
+    {
+        DestroyRecordingResources();
+        CreateRecordingResources();
+
+        CreateUniformBuffers();
+
+        m_logicalDevice.destroyDescriptorPool(m_descriptorPool);
+        CreateDescriptorPool();
+        CreateDescriptorSets();
+    }
+
+    //the pyramid follows the size, and the batcher may have been created again with the images
+    if (m_gpuCulling)
+    {
+        m_gpuCulling->DestroyTargets();
+        m_gpuCulling->CreateTargets(*m_drawBatcher, m_actualSwapChainExtent, m_swapchainDepthImagesViews);
+    }
+
+    //the cached secondaries reference the old framebuffers and extent
+    MarkSceneDirty();
+
+    std::cout << "[Swapchain] recreated at " << m_actualSwapChainExtent.width << "x" << m_actualSwapChainExtent.height << " in "
+        << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count()
+        << " ms" << std::endl;
 }
 
 void VulkanContext::DestroyFramebuffers()const
@@ -1106,11 +2089,47 @@ void VulkanContext::DestroySwapChainImageViews() const
 	}
 }
 
-void VulkanContext::DestroySwapChain() const
+void VulkanContext::DestroySwapChain()
 {
+    if (m_options.headless)
+    {
+        for (u32 i = 0; i < m_swapchainImages.size(); ++i)
+        {
+            DestroyImage(m_swapchainImages[i], m_offscreenImagesMemory[i]);
+        }
+
+        m_swapchainImages.clear();
+        m_offscreenImagesMemory.clear();
+        return;
+    }
+
+    //a resize in the last frames leaves one behind
+    ReleaseRetiredSwapChain(true);
     vkDestroySwapchainKHR(m_logicalDevice, m_swapchain, nullptr);
 }
 
+void VulkanContext::ReleaseRetiredSwapChain(bool _waitPresents)
+{
+    if (!m_retiredSwapchain)
+        return;
+
+    if (_waitPresents)
+    {
+        m_presentationQueue.waitIdle();
+    }
+    else
+    {
+        for (const bool isPassed : m_isFencePassedSinceRetire)
+        {
+            if (!isPassed)
+                return;
+        }
+    }
+
+    m_logicalDevice.destroySwapchainKHR(m_retiredSwapchain);
+    m_retiredSwapchain = nullptr;
+}
+
 void VulkanContext::DestroyInstance() const
 {
     m_instance.destroy();
@@ -1138,8 +2157,8 @@ auto VulkanContext::FindMemoryType(u32 _typeFilter, vk::MemoryPropertyFlags _fla
     return -1;
 }
 
-void VulkanContext::CreateBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, vk::MemoryPropertyFlags _property,
-                                 vk::Buffer& _buffer, vk::DeviceMemory& bufferMemory)
+void VulkanContext::CreateBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, EMemoryPool _pool,
+                                 vk::Buffer& _buffer, vma::Allocation& _allocation, const std::vector<u32>& _concurrentFamilies) const
 {
     vk::BufferCreateInfo bufferInfo;
 
@@ -1147,29 +2166,34 @@ void VulkanContext::CreateBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usa
     bufferInfo.usage = _usage;
     bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-    _buffer = m_logicalDevice.createBuffer(bufferInfo);
-
-   /* vma::AllocationCreateInfo info;
-    info.usage = vma::MemoryUsage::eCpuCopy;
-	VmaAllocationCreateInfo allocInfo{};
-    allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    //no ownership transfer to record, for what goes back and forth between queues every frame
+    if (!_concurrentFamilies.empty())
+    {
+        bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+        bufferInfo.queueFamilyIndexCount = static_cast<u32>(_concurrentFamilies.size());
+        bufferInfo.pQueueFamilyIndices = _concurrentFamilies.data();
+    }
 
-    vmaCreateBuffer(s_allocator, reinterpret_cast<VkBufferCreateInfo*>(&bufferInfo), &allocInfo
-        , reinterpret_cast<VkBuffer*>(&vertexBuffer), &vertexAlloc, nullptr);*/
+    //the memory type comes from the pool, no need to give a usage here
+    vma::AllocationCreateInfo allocInfo;
+    allocInfo.pool = m_memoryPools[static_cast<size_t>(_pool)];
 
+    const auto [buffer, allocation] = s_allocator.createBuffer(bufferInfo, allocInfo);
 
-    const auto memReq = m_logicalDevice.getBufferMemoryRequirements(_buffer);
+    _buffer = buffer;
+    _allocation = allocation;
+}
 
-    vk::MemoryAllocateInfo allocInfo;
-    allocInfo.allocationSize = memReq.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memReq.memoryTypeBits, _property);
+void VulkanContext::DestroyBuffer(vk::Buffer& _buffer, vma::Allocation& _allocation) const
+{
+    s_allocator.destroyBuffer(_buffer, _allocation);
 
-    bufferMemory = m_logicalDevice.allocateMemory(allocInfo);
-    m_logicalDevice.bindBufferMemory(_buffer, bufferMemory, 0);
+    _buffer = nullptr;
+    _allocation = nullptr;
 }
 
 void VulkanContext::CreateImage(u32 _width, u32 _height, vk::Format _format, vk::ImageTiling _tiling,
-	vk::ImageUsageFlags _usage, vk::MemoryPropertyFlags _property, vk::Image& _image, vk::DeviceMemory& _memory)
+	vk::ImageUsageFlags _usage, vk::MemoryPropertyFlags _property, vk::Image& _image, vma::Allocation& _allocation) const
 {
     vk::ImageCreateInfo imageInfo;
     imageInfo.extent.height = _height;
@@ -1189,16 +2213,98 @@ void VulkanContext::CreateImage(u32 _width, u32 _height, vk::Format _format, vk:
     imageInfo.sharingMode = vk::SharingMode::eExclusive;
     imageInfo.usage = _usage;
 
-    _image = m_logicalDevice.createImage(imageInfo);
+    vma::AllocationCreateInfo allocInfo;
+    allocInfo.usage = vma::MemoryUsage::eGpuOnly;
+    allocInfo.requiredFlags = _property;
+
+    const auto [image, allocation] = s_allocator.createImage(imageInfo, allocInfo);
 
-    const auto memRequirement = m_logicalDevice.getImageMemoryRequirements(_image);
+    _image = image;
+    _allocation = allocation;
+}
+
+void VulkanContext::DestroyImage(vk::Image& _image, vma::Allocation& _allocation) const
+{
+    s_allocator.destroyImage(_image, _allocation);
+
+    _image = nullptr;
+    _allocation = nullptr;
+}
+
+void VulkanContext::LogMemoryStats() const
+{
+    const vma::Stats stats = s_allocator.calculateStats();
+
+    std::cout << "[Memory] " << stats.total.blockCount << " device memory blocks (max "
+        << m_physicalDevice.getProperties().limits.maxMemoryAllocationCount << "), "
+        << stats.total.allocationCount << " allocations, "
+        << stats.total.usedBytes / 1024 << " KB used" << std::endl;
+
+    for (u32 i = 0; i < m_memoryPools.size(); ++i)
+    {
+        const vma::PoolStats poolStats = s_allocator.getPoolStats(m_memoryPools[i]);
+        const u32 memoryType = m_poolMemoryTypes[i];
+
+        std::cout << "[Memory]   " << s_allocator.getPoolName(m_memoryPools[i]) << ": " << poolStats.allocationCount << " allocations in "
+            << poolStats.blockCount << " blocks, " << (poolStats.size - poolStats.unusedSize) / 1024 << "/" << poolStats.size / 1024 << " KB"
+            << ", type " << memoryType << " (" << vk::to_string(m_memoryProperties.memoryTypes[memoryType].propertyFlags)
+            << ") on heap " << m_memoryProperties.memoryTypes[memoryType].heapIndex << std::endl;
+    }
 
-    vk::MemoryAllocateInfo allocInfo;
-    allocInfo.allocationSize = memRequirement.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirement.memoryTypeBits, _property);
+    std::cout << "[Memory] geometry is " << (m_geometryDirectWrite ? "written directly (unified memory)" : "uploaded through staging") << std::endl;
+
+    const auto budgets = s_allocator.getBudget();
+
+    for (u32 i = 0; i < budgets.size(); ++i)
+    {
+        std::cout << "[Memory]   heap " << i << (m_memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal ? " (device local)" : "")
+            << ": " << budgets[i].allocationBytes / 1024 << " KB allocated, " << budgets[i].blockBytes / 1024 << " KB in blocks, "
+            << budgets[i].usage / (1024 * 1024) << "/" << budgets[i].budget / (1024 * 1024) << " MB used (whole process)" << std::endl;
+    }
+}
+
+void VulkanContext::DrawMemoryStatsGUI() const
+{
+    ImGui::Begin("Memory");
+
+    const vma::Stats stats = s_allocator.calculateStats();
+
+    ImGui::Text("Device memory blocks: %u / %u", stats.total.blockCount, m_physicalDevice.getProperties().limits.maxMemoryAllocationCount);
+    ImGui::Text("Allocations: %u (%llu KB)", stats.total.allocationCount, stats.total.usedBytes / 1024);
+
+    ImGui::Separator();
+
+    for (u32 i = 0; i < m_memoryPools.size(); ++i)
+    {
+        const vma::PoolStats poolStats = s_allocator.getPoolStats(m_memoryPools[i]);
+
+        ImGui::Text("%s: %llu allocations, %llu blocks, %llu/%llu KB, heap %u", s_allocator.getPoolName(m_memoryPools[i])
+            , static_cast<unsigned long long>(poolStats.allocationCount), static_cast<unsigned long long>(poolStats.blockCount)
+            , (poolStats.size - poolStats.unusedSize) / 1024, poolStats.size / 1024
+            , m_memoryProperties.memoryTypes[m_poolMemoryTypes[i]].heapIndex);
+    }
+
+    ImGui::Text("Geometry: %s", m_geometryDirectWrite ? "direct writes (unified memory)" : "staging uploads");
+    m_geometryArena->DrawGUI();
+
+    ImGui::Separator();
+
+    const auto budgets = s_allocator.getBudget();
+
+    for (u32 i = 0; i < budgets.size(); ++i)
+    {
+        const bool isDeviceLocal = static_cast<bool>(m_memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+
+        ImGui::Text("Heap %u%s: %llu KB allocated, %llu KB in blocks", i, isDeviceLocal ? " (device local)" : ""
+            , budgets[i].allocationBytes / 1024, budgets[i].blockBytes / 1024);
+
+        const float usage = budgets[i].budget > 0 ? static_cast<float>(budgets[i].usage) / static_cast<float>(budgets[i].budget) : 0.0f;
+        const std::string overlay = std::to_string(budgets[i].usage / (1024 * 1024)) + "/" + std::to_string(budgets[i].budget / (1024 * 1024)) + " MB";
+
+        ImGui::ProgressBar(usage, ImVec2(-1.0f, 0.0f), overlay.c_str());
+    }
 
-    _memory = m_logicalDevice.allocateMemory(allocInfo);
-    m_logicalDevice.bindImageMemory(_image, _memory, 0);
+    ImGui::End();
 }
 
 vk::ImageView VulkanContext::CreateImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlagBits aspectFlag) const
@@ -1346,7 +2452,9 @@ vk::RenderPass VulkanContext::CreateRenderPass(bool _useColor, bool _useDepth, b
     colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
 
     colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-    colorAttachment.finalLayout = _isLastRenderPass ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eColorAttachmentOptimal;
+    //offscreen, the last pass leaves the image ready to be copied out
+    const vk::ImageLayout lastLayout = m_options.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+    colorAttachment.finalLayout = _isLastRenderPass ? lastLayout : vk::ImageLayout::eColorAttachmentOptimal;
 
     vk::AttachmentReference colorAttachmentRef;
     colorAttachmentRef.attachment = 0; // refers to attachment Description
@@ -1367,7 +2475,8 @@ vk::RenderPass VulkanContext::CreateRenderPass(bool _useColor, bool _useDepth, b
         depthAttachment.samples = vk::SampleCountFlagBits::e1;
 
         depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-        depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+        //the depth pyramid of the gpu culling is built from it after the pass
+        depthAttachment.storeOp = vk::AttachmentStoreOp::eStore;
 
         depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
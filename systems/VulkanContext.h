@@ -7,14 +7,21 @@
 
 #include <GLFW/glfw3.h>
 
+#include <functional>
 #include <optional>
 
 #include <glm/glm.hpp>
 
 #include "ISystem.h"
+#include "../DrawBatcher.h"
+#include "../LaunchOptions.h"
 
 class Shader;
+class Benchmark;
 class Camera;
+class GeometryArena;
+class GpuCulling;
+class GpuProfiler;
 class VerticesDeclarations;
 const std::vector validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -28,30 +35,52 @@ const std::vector validationLayers = {
 
 
 class Mesh;
+class PipelineCache;
+class PipelineStateCache;
+struct PipelineDesc;
+class ThreadPool;
+class UniformAllocator;
+class UploadContext;
 
 //todo: cache the families indices
-//todo: use vma to allocate a big chunk of memory, and sub allocate after. To do that, have a function that converts vulkan memory type to vma ones (see if .hpp has it)
 
 using namespace glm;
 
 static constexpr u32 MAX_FRAMES_IN_FLIGHT = 3;
 
+// every buffer is sub allocated from one of these vma pools, depending on how it is used
+enum class EMemoryPool : u8
+{
+	Geometry, // device local, vertices and indices, also host visible when the device has unified memory (ReBAR/UMA)
+	Staging, // host visible, only used as a transfer source
+	Dynamic, // host visible, rewritten by the cpu every frame (ubo...)
+	GpuOnly, // device local, written and read by the gpu only (culling outputs...)
+	Count
+};
+
 class VulkanContext : public ISystem
 {
 public:
 	void Init() override;
 	void Start() override;
 	void Update() override;
-	VulkanContext() { GraphicInstance = this; };
+	explicit VulkanContext(LaunchOptions _options) : m_options(std::move(_options)) { GraphicInstance = this; };
 	~VulkanContext() override;
 
 	void InitWindow();
 	void InitVulkan();
 	void DrawFrame();
 	void DrawLoop();
-
-	void CreateBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, vk::MemoryPropertyFlags _property, vk::Buffer& _buffer, vk::DeviceMemory& bufferMemory);
-	void CreateImage(u32 _width, u32 _height, vk::Format _format, vk::ImageTiling _tiling, vk::ImageUsageFlags _usage, vk::MemoryPropertyFlags _property, vk::Image& _image, vk::DeviceMemory& _memory);
+	// hands the gpu time of the frames read back since the last call to the benchmark, the cull included
+	void CollectGpuFrameTimes();
+	void ReportFrameTimings() const;
+
+	// shared concurrently between _concurrentFamilies when there are any, exclusive otherwise
+	void CreateBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, EMemoryPool _pool, vk::Buffer& _buffer, vma::Allocation& _allocation
+		, const std::vector<u32>& _concurrentFamilies = {}) const;
+	void CreateImage(u32 _width, u32 _height, vk::Format _format, vk::ImageTiling _tiling, vk::ImageUsageFlags _usage, vk::MemoryPropertyFlags _property, vk::Image& _image, vma::Allocation& _allocation) const;
+	void DestroyBuffer(vk::Buffer& _buffer, vma::Allocation& _allocation) const;
+	void DestroyImage(vk::Image& _image, vma::Allocation& _allocation) const;
 	[[nodiscard]] vk::ImageView CreateImageView(const vk::Image& image, vk::Format format, vk::ImageAspectFlagBits aspectFlag = vk::ImageAspectFlagBits::eColor) const;
 	[[nodiscard]] vk::Sampler CreateTextureSampler() const;
 	void CopyBuffer(vk::Buffer _srcBuffer, vk::Buffer _dstBuffer, vk::DeviceSize _size) const;
@@ -60,8 +89,14 @@ public:
 
 	[[nodiscard]] vk::RenderPass CreateRenderPass(bool _useColor, bool _useDepth, bool _blend, bool _isLastRenderPass);
 
-	[[nodiscard]] std::pair<vk::Buffer, vk::DeviceMemory> CreateVertexBuffer(const VerticesDeclarations& _decl);
-	[[nodiscard]] std::pair<vk::Buffer, vk::DeviceMemory> CreateIndexBuffer(const std::vector<u16>& indices);
+	[[nodiscard]] std::pair<vk::Buffer, vma::Allocation> CreateVertexBuffer(const VerticesDeclarations& _decl);
+	[[nodiscard]] std::pair<vk::Buffer, vma::Allocation> CreateIndexBuffer(const std::vector<u16>& indices);
+	// geometry pool buffer filled with _data, written directly when the pool is host visible, through the upload context otherwise
+	[[nodiscard]] std::pair<vk::Buffer, vma::Allocation> CreateStaticBuffer(const void* _data, vk::DeviceSize _size, vk::BufferUsageFlags _usage);
+	// same, but _write produces the _size bytes straight in the mapped buffer or staging memory, no cpu array is needed
+	[[nodiscard]] std::pair<vk::Buffer, vma::Allocation> CreateStaticBuffer(vk::DeviceSize _size, vk::BufferUsageFlags _usage, const std::function<void(void* _dst)>& _write);
+	// writes [_offset; _offset + _size[ of a geometry pool buffer the same way, the gpu must not be using that range
+	void WriteStaticBuffer(vk::Buffer _buffer, vma::Allocation _memory, vk::DeviceSize _offset, vk::DeviceSize _size, const std::function<void(void* _dst)>& _write);
 
 	[[nodiscard]] vk::CommandBuffer BeginSingleTimeCommands() const;
 	void EndSingleTimeCommands(vk::CommandBuffer& _commandBuffer) const;
@@ -71,20 +106,36 @@ public:
 
 	vk::Device& GetLogicalDevice() { return m_logicalDevice; }
 	vk::PhysicalDevice& GetPhysicalDevice() { return m_physicalDevice; }
+	UploadContext& GetUploadContext() { return *m_uploadContext; }
+	GeometryArena& GetGeometryArena() { return *m_geometryArena; }
+	ThreadPool& GetThreadPool() { return *m_threadPool; }
+	// for the resources used by both queues, empty when they are the same family
+	[[nodiscard]] const std::vector<u32>& GetGraphicsComputeFamilies() const { return m_graphicsComputeFamilies; }
 
 	[[nodiscard]] vk::Extent2D GetWindowSize() const { return m_actualSwapChainExtent; }
 
+	void LogMemoryStats() const;
+	void DrawMemoryStatsGUI() const;
+	void DrawRenderingGUI();
+
+	// the cached geometry command buffers are re-recorded on the next frame of every swapchain image
+	void MarkSceneDirty();
+
 private:
 	[[nodiscard]] bool CheckValidationSupport() const;
 	void CreateInstance();
 	void CreatePhysicalDevice();
 	void CreateImGuiResources();
 	void CreateLogicalDevice();
-	void CreateMemPool() const;
+	void CreateMemPool();
+	void DestroyMemPool();
+	[[nodiscard]] bool FindUnifiedMemoryType(const vk::BufferCreateInfo& _sampleBufferInfo, u32& _memoryType) const;
 	void CreateSwapChain();
+	void CreateOffscreenTargets();
 	void CreateSwapChainViews();
 	void CreateDepthResources();
 	void CreateDescriptorSetLayout();
+	[[nodiscard]] PipelineDesc MakePipelineDesc(const Shader& _shader) const;
 	void CreateGraphicsPipeline();
 	void CreateFramebuffers();
 	void CreateCommandPool();
@@ -92,10 +143,18 @@ private:
 	void CreateUniformBuffers();
 	void CreateDescriptorPool();
 	void CreateDescriptorSets();
-	void CreateCommandBuffers(u32 _frameIndex);
+	void CreateRecordingResources();
+	void DestroyRecordingResources();
+	// picks the lod of every submesh from its projected error, it only changes the indirect commands
+	void SelectLods();
+	// fills the draw batcher region of the image, every frame
+	void BuildDraws(u32 _imageIndex);
+	void RecordGeometry(u32 _imageIndex, u32 _uboOffset, const vk::CommandBufferInheritanceInfo& _inheritanceInfo);
+	void CreateCommandBuffers(u32 _imageIndex, u32 _uboOffset);
 	void CreateSyncObjects();
 
-	void UpdateUniformBuffer(const vk::ResultValue<unsigned>& imageIndex) const;
+	// returns the dynamic offset of the frame ubo
+	[[nodiscard]] u32 UpdateUniformBuffer(u32 _imageIndex);
 
 	void DestroyDepthResources();
 	void CleanUpSwapChain();
@@ -103,7 +162,9 @@ private:
 
 	void DestroyFramebuffers() const;
 	void DestroySwapChainImageViews() const;
-	void DestroySwapChain() const;
+	void DestroySwapChain();
+	// once every frame in flight has passed its fence again since the swapchain was replaced, or right away with _waitPresents
+	void ReleaseRetiredSwapChain(bool _waitPresents);
 	void DestroySurface() const;
 	void DestroyInstance() const;
 	void DestroyDevice() const;
@@ -164,6 +225,13 @@ private:
 
 			}
 
+			//the graphics family is never picked for presentation above, but it is the only one able to on most devices
+			if (_surface && !families.presentFamily.has_value() && families.graphicsFamily.has_value()
+				&& _physicalDevice.getSurfaceSupportKHR(families.graphicsFamily.value(), _surface))
+			{
+				families.presentFamily = families.graphicsFamily;
+			}
+
 			return families;
 		}
 	};
@@ -171,6 +239,8 @@ private:
 	[[nodiscard]] u32 FindMemoryType(u32 _typeFilter, vk::MemoryPropertyFlags _flags) const;
 private:
 
+	LaunchOptions m_options;
+
 	GLFWwindow* m_window{};
 	vk::Instance m_instance;
 	vk::Device m_logicalDevice;
@@ -178,21 +248,36 @@ private:
 
 	QueueFamilies m_familiesAvailable;
 
+	std::array<vma::Pool, static_cast<size_t>(EMemoryPool::Count)> m_memoryPools;
+	std::array<u32, static_cast<size_t>(EMemoryPool::Count)> m_poolMemoryTypes{};
+	vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+	bool m_geometryDirectWrite = false;
+
 	vk::Queue m_graphicsQueue;
 	vk::Queue m_presentationQueue;
 	vk::Queue m_transferQueue;
+	// the graphics queue when there is no other compute family
+	vk::Queue m_computeQueue;
+	std::vector<u32> m_graphicsComputeFamilies;
 
 	vk::SurfaceKHR m_surface;
 
 	vk::SwapchainKHR m_swapchain;
+	// replaced by m_swapchain, the presents queued before may still read its images
+	vk::SwapchainKHR m_retiredSwapchain;
+	// [frame in flight], since the swapchain was retired
+	std::array<bool, MAX_FRAMES_IN_FLIGHT> m_isSubmittedSinceRetire{};
+	std::array<bool, MAX_FRAMES_IN_FLIGHT> m_isFencePassedSinceRetire{};
 	std::vector<vk::Image> m_swapchainImages;
 	std::vector<vk::ImageView> m_swapChainViews;
+	// only used headless, the images of m_swapchainImages are ours then
+	std::vector<vma::Allocation> m_offscreenImagesMemory;
 
 	//this could be without a vector of them
 	//because only une subpass is running, due to the semaphores used
 	std::vector<vk::Image> m_swapchainDepthImages;
 	std::vector<vk::ImageView> m_swapchainDepthImagesViews;
-	std::vector<vk::DeviceMemory> m_swapchainDepthImagesMemory;
+	std::vector<vma::Allocation> m_swapchainDepthImagesMemory;
 
 	std::vector<vk::Framebuffer> m_framebuffers;
 
@@ -204,9 +289,20 @@ private:
 	vk::DescriptorSetLayout m_descriptorSetLayout;
 	vk::PipelineLayout m_pipelineLayout;
 
+	// default pipeline, owned by m_pipelineStateCache
 	vk::Pipeline m_pipeline;
+	PipelineCache* m_pipelineCache{};
+	PipelineStateCache* m_pipelineStateCache{};
 
 	u32 m_currentFrame = 0;
+	// frames drawn since the start, the gpu timings are tagged with it
+	u32 m_frameNumber = 0;
+
+	// cpu time between two frames, waits on the gpu included
+	std::vector<float> m_frameTimesMs;
+
+	// scripted camera, only with --benchmark
+	Benchmark* m_benchmark{};
 
 	//used for GPU GPU sync
 	std::array<vk::Semaphore, MAX_FRAMES_IN_FLIGHT> m_semaphoresAcquireImage;
@@ -214,13 +310,60 @@ private:
 
 	//used for CPU GPU sync
 	std::array<vk::Fence, MAX_FRAMES_IN_FLIGHT> m_fenceInFlight;
-	std::array<std::optional<vk::Fence>, MAX_FRAMES_IN_FLIGHT> m_fenceImagesInFlight;// used to sync if max images in flight is > than the nb of image of the swapchain or if out of order rendering is used
+	std::vector<std::optional<vk::Fence>> m_fenceImagesInFlight;// used to sync if max images in flight is > than the nb of image of the swapchain or if out of order rendering is used
 
 	vk::CommandPool m_commandPoolGraphics;
 	std::vector<vk::CommandBuffer> m_commandBuffersGraphics;
 
 	vk::CommandPool m_commandPoolTransfer;
-	std::vector<vk::CommandBuffer> m_commandBuffersTransfer;
+
+	// secondary command buffer recorded by one thread for one swapchain image
+	struct RecordingSlot
+	{
+		vk::CommandPool pool;
+		vk::CommandBuffer cmd;
+	};
+
+	// [image * max recording threads + thread], the hardware threads up to MAX_RECORDING_THREADS
+	std::vector<RecordingSlot> m_recordingSlots;
+	std::vector<vk::CommandBuffer> m_commandBuffersImGui;
+
+	// what the geometry secondaries of a swapchain image were recorded with
+	struct RecordedGeometry
+	{
+		u32 sceneVersion = ~0u;
+		u32 uboOffset = 0;
+		u32 threadCount = 0;
+		// the secondaries bake the indirect calls, not what the commands contain
+		std::vector<DrawBatcher::Group> groups;
+	};
+
+	std::vector<RecordedGeometry> m_recordedGeometry;
+	u32 m_sceneVersion = 0;
+
+	ThreadPool* m_threadPool{};
+	// only the background pipeline compiles
+	ThreadPool* m_compileThreadPool{};
+	u32 m_recordingThreadCount = 1;
+	u32 m_drawRepeat = 1;
+	// [submesh], picked every frame
+	std::vector<u32> m_selectedLods;
+	float m_lodErrorThresholdPixels = 1.0f;
+	i32 m_forcedLod = -1; // -1 selects them from the error
+	float m_recordTimeMs = 0.0f;
+	float m_frameRecordTimeMs = 0.0f;
+	u32 m_geometryRecordCount = 0;
+	// of the last frame
+	u32 m_drawCount = 0;
+	u64 m_triangleCount = 0;
+
+	// one slot per swapchain image, like the command buffers writing in it
+	GpuProfiler* m_gpuProfiler{};
+	u32 m_gpuScopeMainPass = 0;
+	u32 m_gpuScopeImGui = 0;
+	u32 m_gpuScopeDepthPyramid = 0;
+	// [thread], one per geometry secondary
+	std::vector<u32> m_gpuScopesGeometry;
 
 	vk::CommandPool m_commandPoolTransientResources;
 	std::vector<vk::CommandBuffer> m_commandBuffersTransientResources;
@@ -228,20 +371,39 @@ private:
 	vk::CommandPool m_commandPoolOneTimeCmd;
 	std::vector<vk::CommandBuffer> m_commandBuffersOneTime;
 
+	UploadContext* m_uploadContext{};
+	GeometryArena* m_geometryArena{};
+
 	Shader* m_shaderTriangle{};
 
+	// the model matrices are in the DrawData of each draw
 	struct UBO
 	{
-		mat4 model;
 		mat4 view;
 		mat4 proj;
 	};
 
-	std::vector<vk::Buffer> m_uboBuffers;
-	std::vector<vk::DeviceMemory> m_uboBuffersMemory;
+	UniformAllocator* m_uniformAllocator{};
+	DrawBatcher* m_drawBatcher{};
+	GpuCulling* m_gpuCulling{}; // null when the device can't run it
+	bool m_supportsGpuCulling = true;
+	bool m_useGpuCulling = true;
+	// multi draw indirect, first instance and non uniform texture indexing, every draw is recorded on its own otherwise
+	bool m_useIndirectBatches = true;
+	bool m_useOcclusionCulling = true;
+	// of the last ubo, the culling tests the bounds with it
+	mat4 m_viewProj = mat4(1.0f);
+	// the submeshes out of the frustum are not even sent to the gpu culling, the same frustum for every repeat
+	bool m_useCpuCulling = true;
+	// [index in the submeshes], of the last frame
+	std::vector<u32> m_visibleSubMeshes;
+	// [submesh], all true without the cpu culling
+	std::vector<u8> m_isSubMeshVisible;
+	float m_cpuCullTimeMs = 0.0f;
 
 	vk::DescriptorPool m_descriptorPool;
-	std::vector<vk::DescriptorSet> m_descriptorSets;
+	// shared by every draw, the textures of all the materials are in it
+	vk::DescriptorSet m_descriptorSet;
 
 	Mesh* m_mesh{};
 